@@ -0,0 +1,71 @@
+//acquire/release throughput of common::FileHandleCache: a hot set that always hits, then uniform access over more
+//files than the descriptor budget so every thread keeps missing and evicting.
+//usage: thru_bench_fhc [files=4096] [maxFds=256] [threads=hardware] [opsPerThread=200000]
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <thread>
+#include <vector>
+#include <spdlog/spdlog.h>
+
+#include "../common/FileHandleCache.hpp"
+
+namespace {
+    size_t arg(const int argc, char **argv, const int i, const size_t fallback) {
+        return argc > i ? std::strtoull(argv[i], nullptr, 10) : fallback;
+    }
+
+    void run(common::FileHandleCache &cache, const char *name, const size_t threads, const size_t ops,
+             const uint32_t span) {
+        std::vector<std::thread> workers;
+        std::atomic<size_t> failures{0};
+        const auto start = std::chrono::steady_clock::now();
+        for (size_t t = 0; t < threads; ++t) {
+            workers.emplace_back([&cache, &failures, ops, span, seed = t]() {
+                std::mt19937 rng(static_cast<uint32_t>(seed));
+                std::uniform_int_distribution<uint32_t> pick(0, span - 1);
+                for (size_t i = 0; i < ops; ++i) {
+                    const uint32_t id = pick(rng);
+                    if (!cache.acquire(id)) {
+                        ++failures;
+                        continue;
+                    }
+                    cache.release(id);
+                }
+            });
+        }
+        for (auto &w: workers) w.join();
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        spdlog::info("{:<6} {} threads x {} ops over {} files: {:.2f} Mops/s, {} open, {} failed", name, threads, ops,
+                     span, static_cast<double>(threads * ops) / seconds / 1e6, cache.openCount(), failures.load());
+    }
+}
+
+int main(const int argc, char **argv) {
+    const size_t files = std::max<size_t>(arg(argc, argv, 1, 4096), 1);
+    const size_t maxFds = arg(argc, argv, 2, 256);
+    const size_t threads = arg(argc, argv, 3, std::max(1u, std::thread::hardware_concurrency()));
+    const size_t ops = arg(argc, argv, 4, 200000);
+
+    common::FileHandleCache::raiseFdLimit();
+    const auto dir = std::filesystem::temp_directory_path() / "thru_bench_fhc";
+    std::filesystem::create_directories(dir);
+
+    common::FileHandleCache cache;
+    cache.reset(files, maxFds);
+    for (uint32_t id = 0; id < files; ++id) {
+        const auto path = dir / std::to_string(id);
+        std::ofstream(path) << id;
+        cache.registerPath(id, path.string());
+    }
+
+    run(cache, "hot", threads, ops, static_cast<uint32_t>(std::clamp<size_t>(maxFds / 2, 1, files)));
+    run(cache, "churn", threads, ops, static_cast<uint32_t>(files));
+
+    cache.closeAll();
+    std::error_code ec;
+    std::filesystem::remove_all(dir, ec);
+    return 0;
+}
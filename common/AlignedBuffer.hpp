@@ -0,0 +1,101 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <new>
+#include <unordered_map>
+#include <vector>
+
+namespace common {
+    //satisfies O_DIRECT / FILE_FLAG_NO_BUFFERING alignment on every filesystem we care about
+    inline constexpr size_t IO_ALIGNMENT = 4096;
+
+    //recycles released blocks per size so per-stream buffers don't churn the allocator
+    class AlignedBufferPool {
+        inline static std::mutex mutex_;
+        inline static std::unordered_map<size_t, std::vector<uint8_t *> > free_;
+        inline static constexpr size_t MAX_FREE_PER_SIZE = 8;
+
+    public:
+        static uint8_t *take(const size_t size) {
+            {
+                std::lock_guard lock(mutex_);
+                auto &list = free_[size];
+                if (!list.empty()) {
+                    uint8_t *p = list.back();
+                    list.pop_back();
+                    return p;
+                }
+            }
+            return static_cast<uint8_t *>(::operator new(size, std::align_val_t{IO_ALIGNMENT}));
+        }
+
+        static void give(uint8_t *p, const size_t size) {
+            {
+                std::lock_guard lock(mutex_);
+                auto &list = free_[size];
+                if (list.size() < MAX_FREE_PER_SIZE) {
+                    list.push_back(p);
+                    return;
+                }
+            }
+            ::operator delete(p, std::align_val_t{IO_ALIGNMENT});
+        }
+    };
+
+    class AlignedBuffer {
+        uint8_t *data_ = nullptr;
+        size_t size_ = 0;
+
+    public:
+        AlignedBuffer() = default;
+
+        explicit AlignedBuffer(const size_t size) {
+            resize(size);
+        }
+
+        AlignedBuffer(const AlignedBuffer &) = delete;
+
+        AlignedBuffer &operator=(const AlignedBuffer &) = delete;
+
+        AlignedBuffer(AlignedBuffer &&other) noexcept : data_(other.data_), size_(other.size_) {
+            other.data_ = nullptr;
+            other.size_ = 0;
+        }
+
+        AlignedBuffer &operator=(AlignedBuffer &&other) noexcept {
+            if (this != &other) {
+                clear();
+                data_ = other.data_;
+                size_ = other.size_;
+                other.data_ = nullptr;
+                other.size_ = 0;
+            }
+            return *this;
+        }
+
+        ~AlignedBuffer() {
+            clear();
+        }
+
+        //contents are not preserved
+        void resize(const size_t size) {
+            if (size == size_) return;
+            clear();
+            if (size == 0) return;
+            data_ = AlignedBufferPool::take(size);
+            size_ = size;
+        }
+
+        void clear() {
+            if (data_) AlignedBufferPool::give(data_, size_);
+            data_ = nullptr;
+            size_ = 0;
+        }
+
+        uint8_t *data() { return data_; }
+        const uint8_t *data() const { return data_; }
+        size_t size() const { return size_; }
+        bool empty() const { return size_ == 0; }
+    };
+}
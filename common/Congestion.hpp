@@ -0,0 +1,76 @@
+#pragma once
+#include <array>
+#include <mutex>
+#include <optional>
+#include <string>
+
+namespace common {
+    //values of lsquic's es_cc_algo
+    enum class CongestionControl : int { CUBIC = 1, BBR = 2, ADAPTIVE = 3 };
+
+    inline const char *congestionControlName(const CongestionControl cc) {
+        switch (cc) {
+            case CongestionControl::CUBIC: return "cubic";
+            case CongestionControl::BBR: return "bbr";
+            case CongestionControl::ADAPTIVE: return "adaptive";
+        }
+        return "unknown";
+    }
+
+    //nullopt for "auto"
+    inline std::optional<CongestionControl> parseCongestionControl(const std::string &name) {
+        if (name == "cubic") return CongestionControl::CUBIC;
+        if (name == "bbr") return CongestionControl::BBR;
+        if (name == "adaptive") return CongestionControl::ADAPTIVE;
+        return std::nullopt;
+    }
+
+    //learns, per class of path, whether cubic or bbr moves more data for the loss it causes.
+    //a live connection cannot change controller, so every connection is a probe for the ones after it:
+    //a class tries each algorithm once, then sticks to the best scoring one
+    class CongestionSelector {
+    public:
+        enum PathClass { DIRECT, RELAYED, PATH_CLASSES };
+
+    private:
+        struct Score {
+            double value = 0.0;
+            int samples = 0;
+        };
+
+        inline static constexpr CongestionControl CANDIDATES[] = {CongestionControl::BBR, CongestionControl::CUBIC};
+        inline static constexpr double SCORE_ALPHA = 0.5;
+
+        std::mutex mutex_;
+        std::array<std::array<Score, 2>, PATH_CLASSES> scores_{};
+
+        static size_t indexOf(const CongestionControl cc) {
+            return cc == CongestionControl::CUBIC ? 1 : 0;
+        }
+
+    public:
+        //goodput to loss: bytes per second, divided down by each percent of packets lost
+        static double score(const double goodput, const double lossPercent) {
+            return goodput / (1.0 + lossPercent);
+        }
+
+        CongestionControl choose(const PathClass path) {
+            std::lock_guard lock(mutex_);
+            const auto &s = scores_[path];
+            for (const auto cc: CANDIDATES) {
+                if (s[indexOf(cc)].samples == 0) return cc;
+            }
+            return s[indexOf(CongestionControl::CUBIC)].value > s[indexOf(CongestionControl::BBR)].value
+                       ? CongestionControl::CUBIC
+                       : CongestionControl::BBR;
+        }
+
+        void record(const PathClass path, const CongestionControl cc, const double goodput, const double lossPercent) {
+            std::lock_guard lock(mutex_);
+            auto &s = scores_[path][indexOf(cc)];
+            const double value = score(goodput, lossPercent);
+            s.value = s.samples == 0 ? value : SCORE_ALPHA * value + (1 - SCORE_ALPHA) * s.value;
+            ++s.samples;
+        }
+    };
+}
@@ -0,0 +1,256 @@
+#pragma once
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <utility>
+#include <llfio/llfio.hpp>
+
+#include "AlignedBuffer.hpp"
+#include "Extents.hpp"
+
+#if defined(__linux__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#if defined(__linux__)
+#include <linux/fiemap.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#endif
+
+namespace llfio = LLFIO_V2_NAMESPACE;
+
+namespace common {
+    class DiskIO {
+    public:
+        static bool isAligned(const uint64_t v) {
+            return v % IO_ALIGNMENT == 0;
+        }
+
+        static uint64_t alignUp(const uint64_t v) {
+            return (v + IO_ALIGNMENT - 1) / IO_ALIGNMENT * IO_ALIGNMENT;
+        }
+
+        //positional I/O through a page cache handle (see FileHandleCache::buffered); the fallback for ranges direct
+        //I/O cannot take
+        static bool readBuffered(llfio::file_handle &fh, const uint64_t offset, uint8_t *buf, const size_t len) {
+            size_t got = 0;
+            while (got < len) {
+                llfio::byte_io_handle::buffer_type reqBuf({reinterpret_cast<llfio::byte *>(buf + got), len - got});
+                llfio::file_handle::io_request<llfio::file_handle::buffers_type> req(
+                    llfio::file_handle::buffers_type{&reqBuf, 1},
+                    offset + got
+                );
+                auto result = fh.read(req);
+                if (!result || result.bytes_transferred() == 0) return false;
+                got += result.bytes_transferred();
+            }
+            return true;
+        }
+
+        static bool writeBuffered(llfio::file_handle &fh, const uint64_t offset, const uint8_t *buf,
+                                  const size_t len) {
+            llfio::byte_io_handle::const_buffer_type reqBuf({reinterpret_cast<const llfio::byte *>(buf), len});
+            llfio::file_handle::io_request<llfio::file_handle::const_buffers_type> req(
+                llfio::file_handle::const_buffers_type{&reqBuf, 1},
+                offset
+            );
+            auto result = fh.write(req);
+            return result && result.bytes_transferred() == len;
+        }
+
+        //reserves extents for the whole file up front so later writes never stall on block allocation
+        static bool preallocate(llfio::file_handle &fh, const uint64_t size) {
+            if (size == 0) return true;
+#if defined(__linux__)
+            const int fd = fh.native_handle().fd;
+            if (fallocate(fd, 0, 0, static_cast<off_t>(size)) == 0) return true;
+            //filesystems without extent support simply keep growing on write
+            return errno == EOPNOTSUPP || errno == ENOSYS;
+#elif defined(__APPLE__)
+            const int fd = fh.native_handle().fd;
+            const off_t have = lseek(fd, 0, SEEK_END);
+            if (have < 0 || static_cast<uint64_t>(have) >= size) return true;
+            fstore_t store{F_ALLOCATECONTIG | F_ALLOCATEALL, F_PEOFPOSMODE, 0, static_cast<off_t>(size) - have, 0};
+            if (fcntl(fd, F_PREALLOCATE, &store) == 0) return true;
+            store.fst_flags = F_ALLOCATEALL;
+            if (fcntl(fd, F_PREALLOCATE, &store) == 0) return true;
+            return errno == ENOTSUP;
+#else
+            //NTFS allocates lazily without zero-filling; nothing to gain here
+            (void) fh;
+            return true;
+#endif
+        }
+
+        //opens its own handle so it can run on a worker thread ahead of the writer
+        static bool preallocate(const std::string &path, const uint64_t size) {
+            if (size == 0) return true;
+            auto opened = llfio::file({}, path, llfio::file_handle::mode::write, llfio::file_handle::creation::if_needed);
+            if (!opened) return false;
+            auto fh = std::move(opened).value();
+            const bool ok = preallocate(fh, size);
+            (void) fh.close();
+            return ok;
+        }
+
+        //page cache hints; all of them are best effort and silently do nothing where the OS has no equivalent
+        static void adviseSequential(llfio::file_handle &fh) {
+#if defined(__linux__)
+            (void) posix_fadvise(fh.native_handle().fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#else
+            (void) fh;
+#endif
+        }
+
+        static void adviseWillNeed(llfio::file_handle &fh, const uint64_t offset, const uint64_t len) {
+#if defined(__linux__)
+            (void) posix_fadvise(fh.native_handle().fd, static_cast<off_t>(offset), static_cast<off_t>(len),
+                                 POSIX_FADV_WILLNEED);
+#elif defined(__APPLE__)
+            radvisory advice{static_cast<off_t>(offset), static_cast<int>(std::min<uint64_t>(len, INT32_MAX))};
+            (void) fcntl(fh.native_handle().fd, F_RDADVISE, &advice);
+#else
+            (void) fh;
+            (void) offset;
+            (void) len;
+#endif
+        }
+
+        static void adviseDontNeed(llfio::file_handle &fh, const uint64_t offset, const uint64_t len) {
+#if defined(__linux__)
+            (void) posix_fadvise(fh.native_handle().fd, static_cast<off_t>(offset), static_cast<off_t>(len),
+                                 POSIX_FADV_DONTNEED);
+#else
+            (void) fh;
+            (void) offset;
+            (void) len;
+#endif
+        }
+
+        //kicks off writeback of freshly written pages without waiting for it
+        static void startWriteback(llfio::file_handle &fh, const uint64_t offset, const uint64_t len) {
+#if defined(__linux__)
+            (void) sync_file_range(fh.native_handle().fd, static_cast<off_t>(offset), static_cast<off_t>(len),
+                                   SYNC_FILE_RANGE_WRITE);
+#else
+            (void) fh;
+            (void) offset;
+            (void) len;
+#endif
+        }
+
+        //waits for an older range to reach the disk, then evicts it; clean pages drop immediately
+        static void dropWritten(llfio::file_handle &fh, const uint64_t offset, const uint64_t len) {
+#if defined(__linux__)
+            (void) sync_file_range(fh.native_handle().fd, static_cast<off_t>(offset), static_cast<off_t>(len),
+                                   SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE |
+                                   SYNC_FILE_RANGE_WAIT_AFTER);
+#endif
+            adviseDontNeed(fh, offset, len);
+        }
+
+        //sort key for on-disk layout: files on the same device sort by where their data starts
+        using Placement = std::pair<uint64_t, uint64_t>;
+
+        static Placement inodePlacement(const std::string &path) {
+#if defined(__linux__) || defined(__APPLE__)
+            struct stat st{};
+            if (::stat(path.c_str(), &st) == 0) {
+                return {static_cast<uint64_t>(st.st_dev), static_cast<uint64_t>(st.st_ino)};
+            }
+#else
+            (void) path;
+#endif
+            return {UINT64_MAX, UINT64_MAX};
+        }
+
+        //physical offset of the first extent (FIEMAP / F_LOG2PHYS_EXT); nullopt for empty or unmappable files
+        static std::optional<Placement> physicalPlacement(const std::string &path) {
+#if defined(__linux__) || defined(__APPLE__)
+            struct stat st{};
+            if (::stat(path.c_str(), &st) != 0 || st.st_size == 0) return std::nullopt;
+            const int fd = ::open(path.c_str(), O_RDONLY);
+            if (fd < 0) return std::nullopt;
+            std::optional<Placement> placement;
+#if defined(__linux__)
+            alignas(fiemap) uint8_t req[sizeof(fiemap) + sizeof(fiemap_extent)]{};
+            auto *map = reinterpret_cast<fiemap *>(req);
+            map->fm_start = 0;
+            map->fm_length = FIEMAP_MAX_OFFSET;
+            map->fm_extent_count = 1;
+            if (ioctl(fd, FS_IOC_FIEMAP, map) == 0 && map->fm_mapped_extents > 0) {
+                placement = Placement{static_cast<uint64_t>(st.st_dev), map->fm_extents[0].fe_physical};
+            }
+#else
+            log2phys l2p{};
+            l2p.l2p_contigbytes = 1;
+            l2p.l2p_devoffset = 0;
+            if (fcntl(fd, F_LOG2PHYS_EXT, &l2p) == 0) {
+                placement = Placement{static_cast<uint64_t>(st.st_dev), static_cast<uint64_t>(l2p.l2p_devoffset)};
+            }
+#endif
+            ::close(fd);
+            return placement;
+#else
+            (void) path;
+            return std::nullopt;
+#endif
+        }
+
+        //cheap pre-check so only files with fewer allocated blocks than their size get their extents walked
+        static bool mayBeSparse(const std::string &path, const uint64_t size) {
+            if (size == 0) return false;
+#if defined(__linux__) || defined(__APPLE__)
+            struct stat st{};
+            if (::stat(path.c_str(), &st) != 0) return false;
+            return static_cast<uint64_t>(st.st_blocks) * 512 < size;
+#else
+            (void) path;
+            return false;
+#endif
+        }
+
+        //data extents as reported by the filesystem (SEEK_DATA/SEEK_HOLE on POSIX)
+        static std::optional<ExtentMap> dataExtents(const std::string &path) {
+            auto opened = llfio::file({}, path);
+            if (!opened) return std::nullopt;
+            auto fh = std::move(opened).value();
+            auto listed = fh.extents();
+            if (!listed) return std::nullopt;
+
+            ExtentMap extents;
+            extents.reserve(listed.value().size());
+            for (const auto &e: listed.value()) {
+                if (!extents.empty() && extents.back().offset + extents.back().length == e.offset) {
+                    extents.back().length += e.length;
+                } else {
+                    extents.push_back({e.offset, e.length});
+                }
+            }
+            (void) fh.close();
+            return extents;
+        }
+
+        //sizes a sparse file without allocating it and deallocates every hole at or after from
+        static bool recreateHoles(llfio::file_handle &fh, const ExtentMap &extents, const uint64_t size,
+                                  const uint64_t from) {
+            const auto existing = fh.maximum_extent();
+            if (!fh.truncate(size)) return false;
+            //a freshly created file is all hole already
+            if (!existing || existing.value() == 0) return true;
+
+            uint64_t cursor = from;
+            while (cursor < size) {
+                const auto [start, end] = Extents::dataAt(extents, cursor, size);
+                if (start > cursor && !fh.zero({cursor, start - cursor})) return false;
+                cursor = end;
+            }
+            return true;
+        }
+    };
+}
@@ -0,0 +1,87 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+namespace common {
+    struct Extent {
+        uint64_t offset = 0;
+        uint64_t length = 0;
+    };
+
+    //data extents of a sparse file, sorted by offset; an empty map means the file is dense
+    using ExtentMap = std::vector<Extent>;
+
+    class Extents {
+    public:
+        //returns [start, end) of the first data run at or after offset; start == size when only holes remain
+        static std::pair<uint64_t, uint64_t> dataAt(const ExtentMap &extents, const uint64_t offset,
+                                                    const uint64_t size) {
+            auto it = std::upper_bound(extents.begin(), extents.end(), offset,
+                                       [](const uint64_t off, const Extent &e) { return off < e.offset; });
+            if (it != extents.begin()) {
+                const auto &prev = *std::prev(it);
+                if (offset < prev.offset + prev.length) {
+                    return {offset, std::min(prev.offset + prev.length, size)};
+                }
+            }
+            if (it == extents.end() || it->offset >= size) return {size, size};
+            return {it->offset, std::min(it->offset + it->length, size)};
+        }
+
+        static uint64_t dataBytes(const ExtentMap &extents) {
+            uint64_t total = 0;
+            for (const auto &e: extents) total += e.length;
+            return total;
+        }
+
+        //[u32 fileCount] then per sparse file [u32 id][u32 n][n x (u64 offset, u64 length)]
+        static void encode(const std::vector<std::pair<uint32_t, const ExtentMap *> > &files, std::vector<uint8_t> &out) {
+            size_t size = 4;
+            for (const auto &f: files) size += 8 + f.second->size() * 16;
+            const size_t base = out.size();
+            out.resize(base + size);
+            uint8_t *p = out.data() + base;
+            const uint32_t count = static_cast<uint32_t>(files.size());
+            memcpy(p, &count, 4);
+            p += 4;
+            for (const auto &[id, extents]: files) {
+                const uint32_t n = static_cast<uint32_t>(extents->size());
+                memcpy(p, &id, 4);
+                memcpy(p + 4, &n, 4);
+                p += 8;
+                for (const auto &e: *extents) {
+                    memcpy(p, &e.offset, 8);
+                    memcpy(p + 8, &e.length, 8);
+                    p += 16;
+                }
+            }
+        }
+
+        static bool decode(const uint8_t *p, const size_t len, std::vector<ExtentMap> &out) {
+            const uint8_t *end = p + len;
+            if (len < 4) return false;
+            uint32_t count;
+            memcpy(&count, p, 4);
+            p += 4;
+            for (uint32_t i = 0; i < count; ++i) {
+                if (end - p < 8) return false;
+                uint32_t id, n;
+                memcpy(&id, p, 4);
+                memcpy(&n, p + 4, 4);
+                p += 8;
+                if (id >= out.size() || static_cast<uint64_t>(end - p) < static_cast<uint64_t>(n) * 16) return false;
+                auto &extents = out[id];
+                extents.resize(n);
+                for (uint32_t k = 0; k < n; ++k) {
+                    memcpy(&extents[k].offset, p, 8);
+                    memcpy(&extents[k].length, p + 8, 8);
+                    p += 16;
+                }
+            }
+            return p == end;
+        }
+    };
+}
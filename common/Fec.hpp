@@ -0,0 +1,477 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <optional>
+#include <span>
+#include <vector>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSSE3__)
+#include <tmmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace common {
+    inline constexpr uint8_t FEC_DATAGRAM_SYMBOL = 0x01;
+    //type + block sequence + block length + k + m + symbol index
+    inline constexpr size_t FEC_HEADER_SIZE = 1 + 8 + 4 + 1 + 1 + 1;
+    //header and symbol fit a DATAGRAM frame in a 1200 byte packet, so fec never depends on path MTU discovery
+    inline constexpr size_t FEC_SYMBOL_SIZE = 1100;
+    inline constexpr size_t FEC_SOURCE_SYMBOLS = 128;
+    inline constexpr size_t FEC_BLOCK_BYTES = FEC_SOURCE_SYMBOLS * FEC_SYMBOL_SIZE;
+    inline constexpr size_t FEC_MIN_REPAIR = 2;
+    inline constexpr size_t FEC_MAX_REPAIR = 64;
+    //repair symbols per expected loss; per-block loss is bursty, so plan for twice the average
+    inline constexpr double FEC_REPAIR_MARGIN = 2.0;
+    //blocks sent but not yet delivered in order at the receiver; bounds memory on both ends
+    inline constexpr uint64_t FEC_WINDOW_BLOCKS = 256;
+    //a block still missing once this many later blocks decoded is fetched over the integrity stream
+    inline constexpr uint64_t FEC_NACK_DISTANCE = 8;
+    //no progress for this long and the tail is fetched (receiver) or resent (sender) over the integrity stream
+    inline constexpr auto FEC_STALL_TIMEOUT = std::chrono::milliseconds(1000);
+
+    //GF(2^8) with the 0x11d polynomial
+    class Gf256 {
+        struct Tables {
+            std::array<uint8_t, 512> exp{};
+            std::array<uint8_t, 256> log{};
+
+            Tables() {
+                unsigned x = 1;
+                for (unsigned i = 0; i < 255; ++i) {
+                    exp[i] = static_cast<uint8_t>(x);
+                    log[x] = static_cast<uint8_t>(i);
+                    x <<= 1;
+                    if (x & 0x100) x ^= 0x11d;
+                }
+                for (unsigned i = 255; i < exp.size(); ++i) exp[i] = exp[i - 255];
+            }
+        };
+
+        static const Tables &tables() {
+            static const Tables t;
+            return t;
+        }
+
+    public:
+        static uint8_t mul(const uint8_t a, const uint8_t b) {
+            if (a == 0 || b == 0) return 0;
+            const auto &t = tables();
+            return t.exp[t.log[a] + t.log[b]];
+        }
+
+        static uint8_t inv(const uint8_t a) {
+            const auto &t = tables();
+            return t.exp[255 - t.log[a]];
+        }
+
+        //dst ^= c * src, a byte at a time through two 16 entry nibble tables: c*x = lo[x & 15] ^ hi[x >> 4].
+        //the tables fit one shuffle register, so the vector paths do 16 or 32 multiplies per instruction
+        static void mulAdd(uint8_t *dst, const uint8_t *src, const uint8_t c, const size_t len) {
+            if (c == 0) return;
+            size_t i = 0;
+            if (c == 1) {
+                for (; i < len; ++i) dst[i] ^= src[i];
+                return;
+            }
+            alignas(16) uint8_t lo[16];
+            alignas(16) uint8_t hi[16];
+            for (uint8_t n = 0; n < 16; ++n) {
+                lo[n] = mul(c, n);
+                hi[n] = mul(c, static_cast<uint8_t>(n << 4));
+            }
+#if defined(__AVX2__)
+            const __m256i tlo = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i *>(lo)));
+            const __m256i thi = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i *>(hi)));
+            const __m256i mask = _mm256_set1_epi8(0x0f);
+            for (; i + 32 <= len; i += 32) {
+                const __m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+                const __m256i l = _mm256_shuffle_epi8(tlo, _mm256_and_si256(s, mask));
+                const __m256i h = _mm256_shuffle_epi8(thi, _mm256_and_si256(_mm256_srli_epi64(s, 4), mask));
+                const __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(dst + i));
+                _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), _mm256_xor_si256(d, _mm256_xor_si256(l, h)));
+            }
+#elif defined(__SSSE3__)
+            const __m128i tlo = _mm_load_si128(reinterpret_cast<const __m128i *>(lo));
+            const __m128i thi = _mm_load_si128(reinterpret_cast<const __m128i *>(hi));
+            const __m128i mask = _mm_set1_epi8(0x0f);
+            for (; i + 16 <= len; i += 16) {
+                const __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+                const __m128i l = _mm_shuffle_epi8(tlo, _mm_and_si128(s, mask));
+                const __m128i h = _mm_shuffle_epi8(thi, _mm_and_si128(_mm_srli_epi64(s, 4), mask));
+                const __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i *>(dst + i));
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_xor_si128(d, _mm_xor_si128(l, h)));
+            }
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+            const uint8x16_t tlo = vld1q_u8(lo);
+            const uint8x16_t thi = vld1q_u8(hi);
+            const uint8x16_t mask = vdupq_n_u8(0x0f);
+            for (; i + 16 <= len; i += 16) {
+                const uint8x16_t s = vld1q_u8(src + i);
+                const uint8x16_t p = veorq_u8(vqtbl1q_u8(tlo, vandq_u8(s, mask)), vqtbl1q_u8(thi, vshrq_n_u8(s, 4)));
+                vst1q_u8(dst + i, veorq_u8(vld1q_u8(dst + i), p));
+            }
+#endif
+            for (; i < len; ++i) dst[i] ^= lo[src[i] & 0x0f] ^ hi[src[i] >> 4];
+        }
+    };
+
+    //systematic Reed-Solomon: k source symbols followed by m repair symbols drawn from a Cauchy matrix,
+    //so any k of the k + m symbols rebuild the block. k + m is at most 256
+    class ReedSolomon {
+    public:
+        static uint8_t coefficient(const size_t repair, const size_t source, const size_t k) {
+            return Gf256::inv(static_cast<uint8_t>((k + repair) ^ source));
+        }
+
+        static void encode(const std::vector<const uint8_t *> &source, const std::vector<uint8_t *> &repair,
+                           const size_t len) {
+            const size_t k = source.size();
+            for (size_t i = 0; i < repair.size(); ++i) {
+                std::memset(repair[i], 0, len);
+                for (size_t j = 0; j < k; ++j) Gf256::mulAdd(repair[i], source[j], coefficient(i, j, k), len);
+            }
+        }
+
+        //symbols[i] holds symbol i of the block or is empty; fills in the missing source symbols.
+        //false when fewer than k symbols are present
+        static bool decode(std::vector<std::vector<uint8_t> > &symbols, const size_t k, const size_t len) {
+            std::vector<size_t> missing;
+            for (size_t j = 0; j < k; ++j) {
+                if (symbols[j].empty()) missing.push_back(j);
+            }
+            if (missing.empty()) return true;
+            std::vector<size_t> rows;
+            for (size_t r = k; r < symbols.size() && rows.size() < missing.size(); ++r) {
+                if (!symbols[r].empty()) rows.push_back(r);
+            }
+            const size_t e = missing.size();
+            if (rows.size() < e) return false;
+
+            //strip the known sources out of each repair symbol, leaving combinations of the missing ones only
+            std::vector<std::vector<uint8_t> > syndromes(e);
+            for (size_t a = 0; a < e; ++a) {
+                syndromes[a] = symbols[rows[a]];
+                for (size_t j = 0; j < k; ++j) {
+                    if (symbols[j].empty()) continue;
+                    Gf256::mulAdd(syndromes[a].data(), symbols[j].data(), coefficient(rows[a] - k, j, k), len);
+                }
+            }
+
+            //every square submatrix of a Cauchy matrix is invertible, so Gauss-Jordan never runs out of pivots
+            std::vector<std::vector<uint8_t> > m(e, std::vector<uint8_t>(2 * e, 0));
+            for (size_t a = 0; a < e; ++a) {
+                for (size_t b = 0; b < e; ++b) m[a][b] = coefficient(rows[a] - k, missing[b], k);
+                m[a][e + a] = 1;
+            }
+            for (size_t col = 0; col < e; ++col) {
+                size_t pivot = col;
+                while (pivot < e && m[pivot][col] == 0) ++pivot;
+                if (pivot == e) return false;
+                std::swap(m[pivot], m[col]);
+                const uint8_t scale = Gf256::inv(m[col][col]);
+                for (auto &v: m[col]) v = Gf256::mul(v, scale);
+                for (size_t r = 0; r < e; ++r) {
+                    if (r == col || m[r][col] == 0) continue;
+                    const uint8_t f = m[r][col];
+                    for (size_t c = 0; c < 2 * e; ++c) m[r][c] ^= Gf256::mul(f, m[col][c]);
+                }
+            }
+
+            for (size_t b = 0; b < e; ++b) {
+                auto &out = symbols[missing[b]];
+                out.assign(len, 0);
+                for (size_t a = 0; a < e; ++a) Gf256::mulAdd(out.data(), syndromes[a].data(), m[b][e + a], len);
+            }
+            return true;
+        }
+    };
+
+    struct FecSymbolHeader {
+        uint64_t block = 0;
+        uint32_t blockLen = 0;
+        uint8_t k = 0;
+        uint8_t m = 0;
+        uint8_t index = 0;
+
+        void write(uint8_t *p) const {
+            *p++ = FEC_DATAGRAM_SYMBOL;
+            memcpy(p, &block, 8);
+            p += 8;
+            memcpy(p, &blockLen, 4);
+            p += 4;
+            *p++ = k;
+            *p++ = m;
+            *p = index;
+        }
+
+        static std::optional<FecSymbolHeader> read(const uint8_t *p, const size_t len) {
+            if (len != FEC_HEADER_SIZE + FEC_SYMBOL_SIZE || p[0] != FEC_DATAGRAM_SYMBOL) return std::nullopt;
+            FecSymbolHeader h;
+            memcpy(&h.block, p + 1, 8);
+            memcpy(&h.blockLen, p + 9, 4);
+            h.k = p[13];
+            h.m = p[14];
+            h.index = p[15];
+            if (h.k == 0 || h.k > FEC_SOURCE_SYMBOLS || h.m > FEC_MAX_REPAIR || h.index >= h.k + h.m) {
+                return std::nullopt;
+            }
+            if (h.blockLen == 0 || h.blockLen > h.k * FEC_SYMBOL_SIZE || h.blockLen <= (h.k - 1) * FEC_SYMBOL_SIZE) {
+                return std::nullopt;
+            }
+            return h;
+        }
+    };
+
+    //sender side: cuts the ordered byte stream into blocks and hands out each block's symbols as datagrams.
+    //a block's source bytes stay in its slab of the ring until the receiver has delivered it, so it can be resent
+    //reliably; the window bounds the ring, and symbols are written straight into the datagram buffer
+    class FecEncoder {
+        inline static constexpr double LOSS_ALPHA = 0.25;
+
+        uint64_t nextBlock_ = 0;
+        uint64_t acked_ = 0;
+        //slab i holds block seq with seq % FEC_WINDOW_BLOCKS == i, allocated on first use and reused after
+        std::vector<std::vector<uint8_t> > slabs_ = std::vector<std::vector<uint8_t> >(FEC_WINDOW_BLOCKS);
+        std::array<uint32_t, FEC_WINDOW_BLOCKS> lens_{};
+        std::array<bool, FEC_WINDOW_BLOCKS> resent_{};
+        //repair symbols of the block being sent; only one block is ever in flight as datagrams
+        std::vector<uint8_t> repair_ = std::vector<uint8_t>(FEC_MAX_REPAIR * FEC_SYMBOL_SIZE);
+        std::vector<const uint8_t *> sourcePtrs_;
+        std::vector<uint8_t *> repairPtrs_;
+        FecSymbolHeader current_{};
+        size_t nextIndex_ = 0;
+        double loss_ = 0.0;
+        uint64_t lastSent_ = 0;
+        uint64_t lastLost_ = 0;
+
+        static size_t slot(const uint64_t seq) {
+            return static_cast<size_t>(seq % FEC_WINDOW_BLOCKS);
+        }
+
+    public:
+        //folds lsquic's cumulative packet counters into the loss estimate the repair count is sized from
+        void observeLoss(const uint64_t sent, const uint64_t lost) {
+            if (sent > lastSent_ && lost >= lastLost_) {
+                const double fraction = static_cast<double>(lost - lastLost_) / static_cast<double>(sent - lastSent_);
+                loss_ = LOSS_ALPHA * std::min(fraction, 1.0) + (1 - LOSS_ALPHA) * loss_;
+            }
+            lastSent_ = sent;
+            lastLost_ = lost;
+        }
+
+        double loss() const {
+            return loss_;
+        }
+
+        size_t repairFor(const size_t k) const {
+            const auto wanted = static_cast<size_t>(std::ceil(static_cast<double>(k) * loss_ * FEC_REPAIR_MARGIN));
+            return std::clamp(wanted + FEC_MIN_REPAIR, FEC_MIN_REPAIR, FEC_MAX_REPAIR);
+        }
+
+        bool windowFull() const {
+            return nextBlock_ - acked_ >= FEC_WINDOW_BLOCKS;
+        }
+
+        bool hasDatagram() const {
+            return nextIndex_ < static_cast<size_t>(current_.k) + current_.m;
+        }
+
+        bool drained() const {
+            return acked_ == nextBlock_ && !hasDatagram();
+        }
+
+        //FEC_BLOCK_BYTES to fill with the next block before encode(); only valid while the window is not full
+        uint8_t *slab() {
+            auto &s = slabs_[slot(nextBlock_)];
+            if (s.empty()) s.resize(FEC_BLOCK_BYTES);
+            return s.data();
+        }
+
+        //queues the symbols of the len bytes just written to slab(); only once the previous block is sent
+        void encode(const size_t len) {
+            if (windowFull() || hasDatagram() || len == 0 || len > FEC_BLOCK_BYTES) return;
+            const size_t k = (len + FEC_SYMBOL_SIZE - 1) / FEC_SYMBOL_SIZE;
+            const size_t m = repairFor(k);
+            uint8_t *source = slab();
+            //the last source symbol is zero padded in place; blockLen tells the receiver where the data ends
+            std::memset(source + len, 0, k * FEC_SYMBOL_SIZE - len);
+
+            sourcePtrs_.resize(k);
+            repairPtrs_.resize(m);
+            for (size_t j = 0; j < k; ++j) sourcePtrs_[j] = source + j * FEC_SYMBOL_SIZE;
+            for (size_t i = 0; i < m; ++i) repairPtrs_[i] = repair_.data() + i * FEC_SYMBOL_SIZE;
+            ReedSolomon::encode(sourcePtrs_, repairPtrs_, FEC_SYMBOL_SIZE);
+
+            current_ = FecSymbolHeader{
+                .block = nextBlock_,
+                .blockLen = static_cast<uint32_t>(len),
+                .k = static_cast<uint8_t>(k),
+                .m = static_cast<uint8_t>(m)
+            };
+            nextIndex_ = 0;
+            lens_[slot(nextBlock_)] = static_cast<uint32_t>(len);
+            resent_[slot(nextBlock_)] = false;
+            ++nextBlock_;
+        }
+
+        //writes the next datagram into buf; 0 if there is none or it does not fit
+        size_t pop(uint8_t *buf, const size_t size) {
+            constexpr size_t n = FEC_HEADER_SIZE + FEC_SYMBOL_SIZE;
+            if (!hasDatagram() || size < n) return 0;
+            current_.index = static_cast<uint8_t>(nextIndex_);
+            current_.write(buf);
+            const uint8_t *symbol = nextIndex_ < current_.k
+                                        ? sourcePtrs_[nextIndex_]
+                                        : repairPtrs_[nextIndex_ - current_.k];
+            memcpy(buf + FEC_HEADER_SIZE, symbol, FEC_SYMBOL_SIZE);
+            ++nextIndex_;
+            return n;
+        }
+
+        //the receiver has delivered every block below deliveredBelow
+        void ack(const uint64_t deliveredBelow) {
+            if (deliveredBelow <= acked_ || deliveredBelow > nextBlock_) return;
+            acked_ = deliveredBelow;
+        }
+
+        //source bytes of a block the receiver could not decode; empty once it was acked
+        std::span<const uint8_t> block(const uint64_t seq) {
+            if (seq < acked_ || seq >= nextBlock_) return {};
+            resent_[slot(seq)] = true;
+            return {slabs_[slot(seq)].data(), lens_[slot(seq)]};
+        }
+
+        //unacked blocks never resent yet, for when the receiver went quiet
+        std::vector<uint64_t> unresent() const {
+            std::vector<uint64_t> out;
+            for (uint64_t seq = acked_; seq < nextBlock_; ++seq) {
+                if (!resent_[slot(seq)]) out.push_back(seq);
+            }
+            return out;
+        }
+    };
+
+    //receiver side: gathers symbols per block and hands decoded blocks out in order
+    class FecReassembler {
+        struct Partial {
+            uint8_t k = 0;
+            uint32_t len = 0;
+            size_t have = 0;
+            std::vector<std::vector<uint8_t> > symbols;
+        };
+
+        uint64_t next_ = 0;
+        size_t frontRead_ = 0;
+        std::optional<uint64_t> highestDecoded_;
+        std::optional<uint64_t> highestSeen_;
+        std::map<uint64_t, Partial> partial_;
+        std::map<uint64_t, std::vector<uint8_t> > ready_;
+        std::map<uint64_t, std::chrono::steady_clock::time_point> nacked_;
+        std::chrono::steady_clock::time_point lastProgress_ = std::chrono::steady_clock::now();
+
+        void complete(const uint64_t seq, std::vector<uint8_t> bytes) {
+            partial_.erase(seq);
+            nacked_.erase(seq);
+            ready_[seq] = std::move(bytes);
+            if (!highestDecoded_ || seq > *highestDecoded_) highestDecoded_ = seq;
+            lastProgress_ = std::chrono::steady_clock::now();
+        }
+
+        bool wanted(const uint64_t seq) const {
+            return seq >= next_ && seq < next_ + FEC_WINDOW_BLOCKS && !ready_.contains(seq);
+        }
+
+    public:
+        //true when the symbol completed a block
+        bool addSymbol(const uint8_t *dg, const size_t len) {
+            const auto h = FecSymbolHeader::read(dg, len);
+            if (!h || !wanted(h->block)) return false;
+            highestSeen_ = std::max(highestSeen_.value_or(0), h->block);
+
+            auto &p = partial_[h->block];
+            if (p.symbols.empty()) {
+                p.k = h->k;
+                p.len = h->blockLen;
+                p.symbols.resize(h->k + h->m);
+            }
+            if (p.k != h->k || p.len != h->blockLen || h->index >= p.symbols.size() || !p.symbols[h->index].empty()) {
+                return false;
+            }
+            p.symbols[h->index].assign(dg + FEC_HEADER_SIZE, dg + FEC_HEADER_SIZE + FEC_SYMBOL_SIZE);
+            if (++p.have < p.k) return false;
+
+            if (!ReedSolomon::decode(p.symbols, p.k, FEC_SYMBOL_SIZE)) return false;
+            std::vector<uint8_t> bytes(p.len);
+            for (size_t j = 0; j < p.k; ++j) {
+                const size_t off = j * FEC_SYMBOL_SIZE;
+                memcpy(bytes.data() + off, p.symbols[j].data(), std::min<size_t>(FEC_SYMBOL_SIZE, p.len - off));
+            }
+            complete(h->block, std::move(bytes));
+            return true;
+        }
+
+        //a block resent whole over the reliable stream
+        bool addBlock(const uint64_t seq, std::vector<uint8_t> bytes) {
+            if (!wanted(seq) || bytes.empty() || bytes.size() > FEC_BLOCK_BYTES) return false;
+            highestSeen_ = std::max(highestSeen_.value_or(0), seq);
+            complete(seq, std::move(bytes));
+            return true;
+        }
+
+        //reads in-order bytes like a stream: 0 when the next block is not there yet
+        size_t read(uint8_t *dst, const size_t max) {
+            size_t got = 0;
+            while (got < max) {
+                const auto it = ready_.find(next_);
+                if (it == ready_.end()) break;
+                const size_t n = std::min(max - got, it->second.size() - frontRead_);
+                memcpy(dst + got, it->second.data() + frontRead_, n);
+                got += n;
+                frontRead_ += n;
+                if (frontRead_ == it->second.size()) {
+                    ready_.erase(it);
+                    ++next_;
+                    frontRead_ = 0;
+                }
+            }
+            return got;
+        }
+
+        //blocks below this were handed out in full
+        uint64_t delivered() const {
+            return next_;
+        }
+
+        //blocks worth fetching over the integrity stream: ones FEC_NACK_DISTANCE behind the newest decoded block,
+        //or, after FEC_STALL_TIMEOUT without progress, every outstanding one. each is asked for again only
+        //after another stall
+        std::vector<uint64_t> takeNacks() {
+            const auto now = std::chrono::steady_clock::now();
+            const bool stalled = now - lastProgress_ >= FEC_STALL_TIMEOUT;
+            uint64_t upTo = 0;
+            if (stalled && highestSeen_) {
+                upTo = *highestSeen_ + 1;
+            } else if (highestDecoded_ && *highestDecoded_ >= FEC_NACK_DISTANCE) {
+                upTo = *highestDecoded_ - FEC_NACK_DISTANCE + 1;
+            }
+
+            std::vector<uint64_t> out;
+            for (uint64_t seq = next_; seq < upTo; ++seq) {
+                if (ready_.contains(seq)) continue;
+                const auto it = nacked_.find(seq);
+                if (it != nacked_.end() && now - it->second < FEC_STALL_TIMEOUT) continue;
+                nacked_[seq] = now;
+                out.push_back(seq);
+            }
+            if (stalled) lastProgress_ = now;
+            return out;
+        }
+    };
+}
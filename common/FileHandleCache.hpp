@@ -0,0 +1,388 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <llfio/llfio.hpp>
+#include <spdlog/spdlog.h>
+
+#include "ThreadManager.hpp"
+
+#if defined(__linux__) || defined(__APPLE__)
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <sys/resource.h>
+#endif
+
+namespace llfio = LLFIO_V2_NAMESPACE;
+
+namespace common {
+    //descriptors left for sockets, the resume state and other short lived opens
+    inline static constexpr size_t FD_HEADROOM = 256;
+    inline static constexpr size_t MAX_CACHED_FDS = 16384;
+    //ids map to shards by their low bits so neighbouring files never contend on one lock
+    inline static constexpr size_t CACHE_SHARDS = 16;
+
+    //open handles shared by every I/O thread. hits only touch the entry's atomics; misses and evictions
+    //take the lock of one shard, and the close of an evicted handle happens after that lock is dropped.
+    //the entry table is sized once per file set by reset, so pinned handle pointers stay valid until the next
+    //reset. reset, registerPath and closeAll must not race with acquire/release
+    class FileHandleCache {
+        //set in pins while an evictor owns the entry; acquirers that see it back off to the slow path
+        inline static constexpr uint32_t EVICTING = 1u << 31;
+
+        struct Entry {
+            llfio::file_handle fh{};
+            //with directIo, a page cache handle to the same file for ranges direct I/O cannot take
+            llfio::file_handle buffered{};
+            std::atomic<uint32_t> pins{0};
+            std::atomic<bool> open{false};
+            std::atomic<bool> bufferedOpen{false};
+            //CLOCK reference bit, set on every hit and cleared as the hand sweeps past
+            std::atomic<bool> referenced{false};
+            std::atomic<bool> prefetching{false};
+        };
+
+        struct alignas(64) Shard {
+            std::mutex mutex;
+            std::vector<uint32_t> ring;
+            size_t hand = 0;
+        };
+
+        std::unique_ptr<Entry[]> entries_;
+        size_t entryCount_ = 0;
+        std::array<Shard, CACHE_SHARDS> shards_;
+        std::atomic<size_t> openCount_{0};
+        std::atomic<size_t> prefetchesInFlight_{0};
+        //bumped on reset so handles prefetched for a previous file set are dropped
+        std::atomic<uint64_t> generation_{0};
+        //prefetch completions check this so a cache torn down with opens in flight is left alone
+        std::shared_ptr<bool> alive_ = std::make_shared<bool>(true);
+
+    public:
+        size_t maxFds = defaultMaxFds();
+        //open file data with the page cache bypassed; callers must keep offsets, lengths and buffers aligned
+        bool directIo = false;
+        std::vector<std::string> paths;
+
+        FileHandleCache() = default;
+
+        explicit FileHandleCache(size_t fileCount, size_t maxFds_ = defaultMaxFds()) {
+            reset(fileCount, maxFds_);
+        }
+
+        FileHandleCache(const FileHandleCache &) = delete;
+
+        FileHandleCache &operator=(const FileHandleCache &) = delete;
+
+        ~FileHandleCache() { closeAll(); }
+
+        //raises the soft RLIMIT_NOFILE towards the hard limit; call once at startup, before any cache is sized
+        static void raiseFdLimit() {
+#if defined(__linux__) || defined(__APPLE__)
+            rlimit rl{};
+            if (getrlimit(RLIMIT_NOFILE, &rl) != 0) return;
+            rlim_t want = std::min<rlim_t>(rl.rlim_max, MAX_CACHED_FDS + FD_HEADROOM);
+#if defined(__APPLE__)
+            want = std::min<rlim_t>(want, OPEN_MAX);
+#endif
+            if (rl.rlim_cur == RLIM_INFINITY || want <= rl.rlim_cur) return;
+            rl.rlim_cur = want;
+            if (setrlimit(RLIMIT_NOFILE, &rl) != 0) {
+                spdlog::debug("Could not raise the open file limit to {}: {}", want, strerror(errno));
+            }
+#endif
+        }
+
+        //the current soft RLIMIT_NOFILE minus headroom
+        static size_t defaultMaxFds() {
+#if defined(__linux__) || defined(__APPLE__)
+            rlimit rl{};
+            if (getrlimit(RLIMIT_NOFILE, &rl) != 0) return size_t{128};
+            const uint64_t soft = rl.rlim_cur == RLIM_INFINITY ? MAX_CACHED_FDS + FD_HEADROOM : rl.rlim_cur;
+            return std::clamp<size_t>(soft > FD_HEADROOM ? soft - FD_HEADROOM : 0, 32, MAX_CACHED_FDS);
+#else
+            //windows handles are not bound by the CRT descriptor table
+            return size_t{2048};
+#endif
+        }
+
+        void reset(size_t fileCount, size_t maxFds_ = defaultMaxFds()) {
+            closeAll();
+            generation_.fetch_add(1, std::memory_order_relaxed);
+            prefetchesInFlight_.store(0, std::memory_order_relaxed);
+            maxFds = maxFds_;
+            paths.clear();
+            paths.resize(fileCount);
+            entries_ = std::make_unique<Entry[]>(fileCount);
+            entryCount_ = fileCount;
+        }
+
+        //ids must be below the count given to reset; the table never grows under pinned handles
+        bool registerPath(uint32_t id, std::string p) {
+            if (id >= entryCount_) {
+                spdlog::error("FileHandleCache: file id {} is outside the {} registered files", id, entryCount_);
+                return false;
+            }
+            paths[id] = std::move(p);
+            return true;
+        }
+
+        size_t size() const { return entryCount_; }
+
+        size_t openCount() const { return openCount_.load(std::memory_order_relaxed); }
+
+        bool isOpen(uint32_t id) const {
+            return id < entryCount_ && entries_[id].open.load(std::memory_order_acquire);
+        }
+
+        //pins the handle until the matching release; safe from any thread
+        llfio::file_handle *acquire(uint32_t id, bool write = false) {
+            if (id >= entryCount_ || id >= paths.size() || paths[id].empty()) return nullptr;
+            Entry &e = entries_[id];
+            if (tryPin(e)) return &e.fh;
+
+            //open outside any lock; if another thread wins the race our handle is simply closed
+            auto opened = open(paths[id], write, directIo);
+            if (!opened) {
+                spdlog::error("Failed to open file id {} path='{}' err={}", id, paths[id], opened.error().message());
+                return nullptr;
+            }
+            llfio::file_handle fh = std::move(opened).value();
+
+            makeRoom(shardOf(id));
+            if (openCount_.load(std::memory_order_relaxed) >= maxFds + CACHE_SHARDS) {
+                spdlog::error("FileHandleCache: cannot evict maxFds={}", maxFds);
+                return nullptr;
+            }
+
+            Shard &s = shards_[shardOf(id)];
+            {
+                std::lock_guard lock(s.mutex);
+                if (!e.open.load(std::memory_order_relaxed)) {
+                    install(s, id, std::move(fh));
+                }
+                //under the shard lock nobody can be evicting this entry
+                e.pins.fetch_add(1, std::memory_order_acquire);
+                e.referenced.store(true, std::memory_order_relaxed);
+            }
+            if (fh.is_valid()) (void) fh.close();
+            return &e.fh;
+        }
+
+        //the handle for unaligned ranges of a file the caller has pinned: the pinned handle itself, or with
+        //directIo a buffered one opened next to it on first use. it lives and dies with the pinned entry
+        llfio::file_handle *buffered(uint32_t id, bool write = false) {
+            if (id >= entryCount_) return nullptr;
+            Entry &e = entries_[id];
+            if (!directIo) return &e.fh;
+            if (e.bufferedOpen.load(std::memory_order_acquire)) return &e.buffered;
+
+            auto opened = open(paths[id], write, false);
+            if (!opened) {
+                spdlog::error("Failed to open file id {} path='{}' err={}", id, paths[id], opened.error().message());
+                return nullptr;
+            }
+            llfio::file_handle fh = std::move(opened).value();
+            {
+                std::lock_guard lock(shards_[shardOf(id)].mutex);
+                if (!e.bufferedOpen.load(std::memory_order_relaxed)) {
+                    e.buffered = std::move(fh);
+                    e.bufferedOpen.store(true, std::memory_order_release);
+                    openCount_.fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+            if (fh.is_valid()) (void) fh.close();
+            return &e.buffered;
+        }
+
+        void release(uint32_t id) {
+            if (id >= entryCount_) return;
+            Entry &e = entries_[id];
+            uint32_t pins = e.pins.load(std::memory_order_relaxed);
+            while ((pins & ~EVICTING) > 0 &&
+                   !e.pins.compare_exchange_weak(pins, pins - 1, std::memory_order_release, std::memory_order_relaxed)) {
+            }
+        }
+
+        //opens a file on the worker pool ahead of its acquire; the handle is adopted back on the data plane thread.
+        //prepare runs on the worker with the fresh handle (e.g. preallocation). false when over budget
+        bool prefetch(uint32_t id, bool write = false, std::function<void(llfio::file_handle &)> prepare = {}) {
+            if (id >= entryCount_ || id >= paths.size() || paths[id].empty()) return false;
+            Entry &e = entries_[id];
+            if (e.open.load(std::memory_order_acquire) || e.prefetching.load(std::memory_order_relaxed)) return true;
+            //never let prefetched handles push pinned ones out
+            if (openCount_.load(std::memory_order_relaxed) +
+                prefetchesInFlight_.load(std::memory_order_relaxed) >= maxFds / 2)
+                return false;
+            if (e.prefetching.exchange(true, std::memory_order_relaxed)) return true;
+
+            prefetchesInFlight_.fetch_add(1, std::memory_order_relaxed);
+            ThreadManager::postWork([this, id, write, direct = directIo, path = paths[id],
+                                     gen = generation_.load(std::memory_order_relaxed),
+                                     token = std::weak_ptr<bool>(alive_),
+                                     prepare = std::move(prepare)]() {
+                auto opened = open(path, write, direct);
+                std::shared_ptr<llfio::file_handle> fh;
+                if (opened) {
+                    fh = std::make_shared<llfio::file_handle>(std::move(opened).value());
+                    if (prepare) prepare(*fh);
+                }
+                ThreadManager::postTask([this, id, gen, fh, token]() {
+                    if (token.expired()) return;
+                    adopt(id, gen, fh);
+                });
+            }, WorkStage::IO);
+            return true;
+        }
+
+        //closes one unpinned handle, sweeping shards from start; false when everything open is pinned
+        bool evictOne(size_t start = 0) {
+            for (size_t i = 0; i < CACHE_SHARDS; ++i) {
+                Shard &s = shards_[(start + i) % CACHE_SHARDS];
+                llfio::file_handle victim, victimBuffered;
+                uint32_t victimId = UINT32_MAX;
+                {
+                    std::lock_guard lock(s.mutex);
+                    victimId = sweep(s, victim, victimBuffered);
+                }
+                if (victimId != UINT32_MAX) {
+                    closeRetired(victimId, victim);
+                    closeRetired(victimId, victimBuffered);
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        void closeAll() {
+            for (auto &s: shards_) {
+                std::lock_guard lock(s.mutex);
+                s.ring.clear();
+                s.hand = 0;
+            }
+            for (size_t i = 0; i < entryCount_; ++i) {
+                Entry &e = entries_[i];
+                if (e.open.load(std::memory_order_relaxed) && e.fh.is_valid()) {
+                    auto r = e.fh.close();
+                    if (!r) spdlog::warn("close('{}') failed: {}", paths[i], r.error().message());
+                }
+                if (e.buffered.is_valid()) (void) e.buffered.close();
+                e.fh = llfio::file_handle{};
+                e.buffered = llfio::file_handle{};
+                e.open.store(false, std::memory_order_relaxed);
+                e.bufferedOpen.store(false, std::memory_order_relaxed);
+                e.pins.store(0, std::memory_order_relaxed);
+                e.referenced.store(false, std::memory_order_relaxed);
+            }
+            openCount_.store(0, std::memory_order_relaxed);
+        }
+
+    private:
+        static size_t shardOf(uint32_t id) {
+            return id % CACHE_SHARDS;
+        }
+
+        static llfio::result<llfio::file_handle> open(const std::string &path, bool write, bool direct) {
+            const auto caching = direct ? llfio::file_handle::caching::only_metadata : llfio::file_handle::caching::all;
+            return write
+                       ? llfio::file({}, path, llfio::file_handle::mode::write,
+                                     llfio::file_handle::creation::if_needed, caching)
+                       : llfio::file({}, path, llfio::file_handle::mode::read,
+                                     llfio::file_handle::creation::open_existing, caching);
+        }
+
+        //lock-free hit path: pin first, then make sure no evictor got there before us
+        static bool tryPin(Entry &e) {
+            const uint32_t before = e.pins.fetch_add(1, std::memory_order_acquire);
+            if (!(before & EVICTING) && e.open.load(std::memory_order_acquire)) {
+                e.referenced.store(true, std::memory_order_relaxed);
+                return true;
+            }
+            e.pins.fetch_sub(1, std::memory_order_release);
+            return false;
+        }
+
+        //evicts until there is a free slot, preferring the caller's own shard; never holds two shard locks
+        void makeRoom(size_t start) {
+            while (openCount_.load(std::memory_order_relaxed) >= maxFds) {
+                if (!evictOne(start)) return;
+            }
+        }
+
+        //caller holds s.mutex
+        void install(Shard &s, uint32_t id, llfio::file_handle &&fh) {
+            Entry &e = entries_[id];
+            e.fh = std::move(fh);
+            e.referenced.store(true, std::memory_order_relaxed);
+            e.open.store(true, std::memory_order_release);
+            s.ring.push_back(id);
+            openCount_.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        //CLOCK sweep under s.mutex; the victim's handle is moved out so it can be closed without the lock
+        uint32_t sweep(Shard &s, llfio::file_handle &victim, llfio::file_handle &victimBuffered) {
+            for (size_t steps = 0; steps < 2 * s.ring.size(); ++steps) {
+                if (s.hand >= s.ring.size()) s.hand = 0;
+                const uint32_t id = s.ring[s.hand];
+                Entry &e = entries_[id];
+                if (e.referenced.exchange(false, std::memory_order_relaxed)) {
+                    ++s.hand;
+                    continue;
+                }
+                uint32_t expected = 0;
+                if (!e.pins.compare_exchange_strong(expected, EVICTING, std::memory_order_acquire,
+                                                    std::memory_order_relaxed)) {
+                    ++s.hand;
+                    continue;
+                }
+                victim = std::move(e.fh);
+                e.fh = llfio::file_handle{};
+                if (e.bufferedOpen.exchange(false, std::memory_order_relaxed)) {
+                    victimBuffered = std::move(e.buffered);
+                    e.buffered = llfio::file_handle{};
+                    openCount_.fetch_sub(1, std::memory_order_relaxed);
+                }
+                e.open.store(false, std::memory_order_release);
+                //late pinners that saw EVICTING undo their own increment, so only the flag is cleared
+                e.pins.fetch_and(~EVICTING, std::memory_order_release);
+                s.ring[s.hand] = s.ring.back();
+                s.ring.pop_back();
+                openCount_.fetch_sub(1, std::memory_order_relaxed);
+                return id;
+            }
+            return UINT32_MAX;
+        }
+
+        void closeRetired(uint32_t id, llfio::file_handle &fh) {
+            if (!fh.is_valid()) return;
+            auto r = fh.close();
+            if (!r) spdlog::warn("failed to close {} : {}", paths[id], r.error().message());
+        }
+
+        void adopt(uint32_t id, uint64_t gen, const std::shared_ptr<llfio::file_handle> &fh) {
+            if (gen != generation_.load(std::memory_order_relaxed) || id >= entryCount_) return;
+            Entry &e = entries_[id];
+            e.prefetching.store(false, std::memory_order_relaxed);
+            if (prefetchesInFlight_.load(std::memory_order_relaxed) > 0)
+                prefetchesInFlight_.fetch_sub(1, std::memory_order_relaxed);
+            //a handle nobody adopts closes when the last reference goes away
+            if (!fh || e.open.load(std::memory_order_acquire)) return;
+
+            makeRoom(shardOf(id));
+            if (openCount_.load(std::memory_order_relaxed) >= maxFds) return;
+            Shard &s = shards_[shardOf(id)];
+            std::lock_guard lock(s.mutex);
+            if (e.open.load(std::memory_order_relaxed)) return;
+            install(s, id, std::move(*fh));
+            //prefetched files haven't been used yet; let the clock take them before hot ones
+            e.referenced.store(false, std::memory_order_relaxed);
+        }
+    };
+}
@@ -0,0 +1,75 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+//header-only build lets the compiler pick the widest vector path enabled for the target (SSE2/AVX2/AVX-512/NEON)
+#define XXH_INLINE_ALL
+#include <xxhash.h>
+
+namespace common {
+    struct Digest128 {
+        uint64_t low = 0;
+        uint64_t high = 0;
+
+        bool operator==(const Digest128 &other) const {
+            return low == other.low && high == other.high;
+        }
+
+        bool operator!=(const Digest128 &other) const {
+            return !(*this == other);
+        }
+    };
+
+    inline static constexpr size_t DIGEST_SIZE = 16;
+
+    class Hash {
+    public:
+        static Digest128 digest(const void *data, const size_t len) {
+            const XXH128_hash_t h = XXH3_128bits(data, len);
+            return {h.low64, h.high64};
+        }
+
+        static void write(uint8_t *out, const Digest128 &d) {
+            memcpy(out, &d.low, 8);
+            memcpy(out + 8, &d.high, 8);
+        }
+
+        static Digest128 read(const uint8_t *in) {
+            Digest128 d;
+            memcpy(&d.low, in, 8);
+            memcpy(&d.high, in + 8, 8);
+            return d;
+        }
+
+        static std::string toHex(const Digest128 &d) {
+            char buf[33];
+            snprintf(buf, sizeof(buf), "%016llx%016llx", static_cast<unsigned long long>(d.high),
+                     static_cast<unsigned long long>(d.low));
+            return std::string(buf);
+        }
+    };
+
+    //incremental XXH3-128 for data that arrives in pieces
+    class StreamingHash {
+        XXH3_state_t state_{};
+
+    public:
+        StreamingHash() {
+            reset();
+        }
+
+        void reset() {
+            XXH3_128bits_reset(&state_);
+        }
+
+        void update(const void *data, const size_t len) {
+            XXH3_128bits_update(&state_, data, len);
+        }
+
+        Digest128 digest() const {
+            const XXH128_hash_t h = XXH3_128bits_digest(&state_);
+            return {h.low64, h.high64};
+        }
+    };
+}
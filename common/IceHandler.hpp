@@ -1,5 +1,6 @@
 #pragma once
 #include <future>
+#include <set>
 #include <string>
 #include <boost/asio/post.hpp>
 
@@ -21,10 +22,20 @@ namespace common {
 
     using CandidatesCallback = std::function<void (CandidatesResult result)>;
 
+    using RestartCallback = std::function<void (const std::string &receiverId, CandidatesResult result,
+                                                int generation)>;
+
+    //with several components, how long the rest get once the first is ready; slower ones are left out
+    inline constexpr guint MULTIPATH_GRACE_MS = 3000;
+
     struct IceStreamState {
         int totalComponents;
         int readyComponents = 0;
+        int settledComponents = 0;
+        std::set<guint> settled;
         bool alreadyFired = false;
+        bool established = false;
+        bool graceArmed = false;
         ConnectionCallback callback;
 
         IceStreamState(const int n, ConnectionCallback callback) : totalComponents(n), callback(std::move(callback)) {
@@ -37,6 +48,10 @@ namespace common {
     struct IceAgentContext {
         NiceAgent *agent;
         guint streamId;
+        int components = 1;
+        //bumped by every ICE restart, by whichever side started it; the other side answers in the same generation
+        int generation = 0;
+        bool restarting = false;
     };
 
 
@@ -44,6 +59,7 @@ namespace common {
     inline static std::vector<TurnServer> turnServers_;
     inline static std::unordered_map<std::string, IceAgentContext> agentsMap_;
     inline static IceAgentContext receiverAgentContext_;
+    inline static RestartCallback restartCallback_;
 
     class IceHandler {
     public:
@@ -108,6 +124,85 @@ namespace common {
         }
 
 
+        //distinct local interface addresses, in the order libnice gathered them
+        static std::vector<NiceAddress> hostBases(NiceAgent *agent, const guint streamId) {
+            std::vector<NiceAddress> bases;
+            GSList *candidates = nice_agent_get_local_candidates(agent, streamId, 1);
+            for (const GSList *it = candidates; it != nullptr; it = it->next) {
+                const auto *candidate = static_cast<NiceCandidate *>(it->data);
+                if (candidate->type != NICE_CANDIDATE_TYPE_HOST || candidate->transport != NICE_CANDIDATE_TRANSPORT_UDP) {
+                    continue;
+                }
+                const bool seen = std::ranges::any_of(bases, [candidate](const NiceAddress &b) {
+                    return nice_address_equal_no_port(&b, &candidate->base_addr);
+                });
+                if (!seen) bases.push_back(candidate->base_addr);
+            }
+            g_slist_free_full(candidates, reinterpret_cast<GDestroyNotify>(nice_candidate_free));
+            return bases;
+        }
+
+        static CandidatesResult localCandidates(const bool isSender, NiceAgent *agent, const guint stream_id,
+                                                const int n) {
+            auto serializedCandidates = nlohmann::json::array();
+            //--connections wants every component on the same route; only --multipath spreads them
+            const bool diverse = isSender
+                                     ? sender::SenderConfig::multipath > 1
+                                     : receiver::ReceiverConfig::multipath > 1;
+            const auto bases = diverse ? hostBases(agent, stream_id) : std::vector<NiceAddress>{};
+            gchar *ufrag = nullptr;
+            gchar *password = nullptr;
+            nice_agent_get_local_credentials(agent, stream_id, &ufrag, &password);
+
+            for (int i = 1; i <= n; i++) {
+                GSList *candidates = nice_agent_get_local_candidates(agent, stream_id, i);
+                for (const GSList *iterator = candidates; iterator != nullptr; iterator = iterator->next) {
+                    const auto candidate = static_cast<NiceCandidate *>(iterator->data);
+
+                    // spdlog::info("Cand: type={} transport={} addr={} base={} prio={}",
+                    //              (int) candidate->type,
+                    //              (int) candidate->transport,
+                    //              niceAddrToString(candidate->addr),
+                    //              niceAddrToString(candidate->base_addr),
+                    //              (uint32_t) candidate->priority);
+
+                    if (candidate->transport != NICE_CANDIDATE_TRANSPORT_UDP) {
+                        continue;
+                    }
+                    if ((isSender && sender::SenderConfig::forceTurn) || (
+                            !isSender && receiver::ReceiverConfig::forceTurn)) {
+                        if (candidate->type != NICE_CANDIDATE_TYPE_RELAYED) {
+                            continue;
+                        }
+                    }
+                    //each component advertises one local address (relays always), so the pairs libnice
+                    //settles on spread over the host's interfaces instead of all taking the best one
+                    if (bases.size() > 1 && candidate->type != NICE_CANDIDATE_TYPE_RELAYED &&
+                        !nice_address_equal_no_port(&candidate->base_addr, &bases[(i - 1) % bases.size()])) {
+                        continue;
+                    }
+                    if (gchar *cand_str = nice_agent_generate_local_candidate_sdp(agent, candidate)) {
+                        serializedCandidates.push_back({
+                            {"candidate", cand_str},
+                            {"componentId", i}
+                        });
+                        g_free(cand_str);
+                    }
+                }
+                g_slist_free_full(candidates, reinterpret_cast<GDestroyNotify>(nice_candidate_free));
+            }
+
+            auto result = CandidatesResult{
+                .ufrag = ufrag ? std::string(ufrag) : "",
+                .password = password ? std::string(password) : "",
+                .serializedCandidates = std::move(serializedCandidates)
+            };
+
+            g_free(ufrag);
+            g_free(password);
+            return result;
+        }
+
         static void gatherLocalCandidates(const bool isSender, const std::string receiverId, const int n,
                                           const CandidatesCallback callback
         ) {
@@ -115,6 +210,8 @@ namespace common {
 
 
             g_object_set(agent, "controlling-mode", isSender, NULL);
+            //keepalives are real connectivity checks, so a route that died under a running transfer is noticed
+            g_object_set(agent, "keepalive-conncheck", TRUE, NULL);
 
             if (!stunServers_.empty()) {
                 g_object_set(agent, "stun-server", stunServers_[0].host.c_str(), NULL);
@@ -126,16 +223,18 @@ namespace common {
             if (isSender) {
                 agentsMap_.emplace(std::move(receiverId), IceAgentContext{
                                        .agent = agent,
-                                       .streamId = stream_id
+                                       .streamId = stream_id,
+                                       .components = n
                                    });
             } else {
                 receiverAgentContext_.agent = agent;
                 receiverAgentContext_.streamId = stream_id;
+                receiverAgentContext_.components = n;
             }
 
             for (int i = 1; i <= n; i++) {
                 nice_agent_set_port_range(agent, stream_id, i, 49152, 65535);
-                nice_agent_attach_recv(agent, stream_id, 1, common::ThreadManager::getContext(),
+                nice_agent_attach_recv(agent, stream_id, i, common::ThreadManager::getContext(),
                                        [](NiceAgent *agent, guint stream_id, guint component_id,
                                           guint len, gchar *buf, gpointer user_data) {
                                        },
@@ -152,53 +251,7 @@ namespace common {
 
 
             const auto onGatheringDoneCallback = [isSender, n, agent, stream_id, callback = std::move(callback)]() {
-                auto serializedCandidates = nlohmann::json::array();
-                gchar *ufrag = nullptr;
-                gchar *password = nullptr;
-                nice_agent_get_local_credentials(agent, stream_id, &ufrag, &password);
-
-                for (int i = 1; i <= n; i++) {
-                    GSList *localCandidates = nice_agent_get_local_candidates(agent, stream_id, i);
-                    for (const GSList *iterator = localCandidates; iterator != nullptr; iterator = iterator->next) {
-                        const auto candidate = static_cast<NiceCandidate *>(iterator->data);
-
-                        // spdlog::info("Cand: type={} transport={} addr={} base={} prio={}",
-                        //              (int) candidate->type,
-                        //              (int) candidate->transport,
-                        //              niceAddrToString(candidate->addr),
-                        //              niceAddrToString(candidate->base_addr),
-                        //              (uint32_t) candidate->priority);
-
-                        if (candidate->transport != NICE_CANDIDATE_TRANSPORT_UDP) {
-                            continue;
-                        }
-                        if ((isSender && sender::SenderConfig::forceTurn) || (
-                                !isSender && receiver::ReceiverConfig::forceTurn)) {
-                            if (candidate->type != NICE_CANDIDATE_TYPE_RELAYED) {
-                                continue;
-                            }
-                        }
-                        if (gchar *cand_str = nice_agent_generate_local_candidate_sdp(agent, candidate)) {
-                            serializedCandidates.push_back({
-                                {"candidate", cand_str},
-                                {"componentId", i}
-                            });
-                            g_free(cand_str);
-                        }
-                    }
-                    g_slist_free_full(localCandidates, reinterpret_cast<GDestroyNotify>(nice_candidate_free));
-                }
-
-                auto result = CandidatesResult{
-                    .ufrag = ufrag ? std::string(ufrag) : "",
-                    .password = password ? std::string(password) : "",
-                    .serializedCandidates = std::move(serializedCandidates)
-                };
-
-                g_free(ufrag);
-                g_free(password);
-
-                callback(std::move(result));
+                callback(localCandidates(isSender, agent, stream_id, n));
             };
 
 
@@ -219,67 +272,116 @@ namespace common {
             nice_agent_gather_candidates(agent, stream_id);
         }
 
+        //returns how many components got candidates, or -1 if the credentials were refused
+        static int setRemote(NiceAgent *agent, const guint streamId, const int components,
+                             const CandidatesResult &remoteCredentials) {
+            if (!nice_agent_set_remote_credentials(agent, streamId, remoteCredentials.ufrag.c_str(),
+                                                   remoteCredentials.password.c_str())) {
+                return -1;
+            }
+
+            std::map<int, GSList *> componentListsMap;
+
+            for (const auto &item: remoteCredentials.serializedCandidates) {
+                int componentId = item["componentId"];
+                //the peer may offer more paths than we do; both sides end up using the smaller count
+                if (componentId < 1 || componentId > components) continue;
+                std::string candidateString = item["candidate"];
+                NiceCandidate *candidate = nice_agent_parse_remote_candidate_sdp(agent, componentId,
+                    candidateString.c_str());
+                if (candidate) {
+                    componentListsMap[componentId] = g_slist_append(componentListsMap[componentId], candidate);
+                }
+            }
+
+            const int n = static_cast<int>(componentListsMap.size());
+
+            for (auto &[componentId, list]: componentListsMap) {
+                nice_agent_set_remote_candidates(agent, streamId, componentId, list);
+                g_slist_free_full(list, reinterpret_cast<GDestroyNotify>(nice_candidate_free));
+            }
+            return n;
+        }
+
         static void establishConnection(bool isSender, const std::string receiverId,
                                         const CandidatesResult &remoteCredentials,
                                         const ConnectionCallback &callback
         ) {
             NiceAgent *agent = nullptr;
             int streamId = -1;
+            int components = 1;
             if (isSender) {
                 auto it = agentsMap_.find(std::move(receiverId));
                 if (it != agentsMap_.end()) {
                     agent = it->second.agent;
                     streamId = it->second.streamId;
+                    components = it->second.components;
                 }
             } else {
                 agent = receiverAgentContext_.agent;
                 streamId = receiverAgentContext_.streamId;
+                components = receiverAgentContext_.components;
             }
 
             if (!agent || streamId < 0) {
                 return;
             }
 
-            if (!nice_agent_set_remote_credentials(agent, streamId, remoteCredentials.ufrag.c_str(),
-                                                   remoteCredentials.password.c_str())) {
+            const int n = setRemote(agent, streamId, components, remoteCredentials);
+            if (n < 0) {
                 callback(nullptr, false, streamId, -1);
                 return;
             }
 
-            std::map<int, GSList *> componentListsMap;
-
-            for (const auto &item: remoteCredentials.serializedCandidates) {
-                int componentId = item["componentId"];
-                std::string candidateString = item["candidate"];
-                NiceCandidate *candidate = nice_agent_parse_remote_candidate_sdp(agent, componentId,
-                    candidateString.c_str());
-                if (candidate) {
-                    componentListsMap[componentId] = g_slist_append(componentListsMap[componentId], candidate);
-                }
-            }
-
-            int n = componentListsMap.size();
-
-            for (auto &[componentId, list]: componentListsMap) {
-                nice_agent_set_remote_candidates(agent, streamId, componentId, list);
-                g_slist_free_full(list, reinterpret_cast<GDestroyNotify>(nice_candidate_free));
-            }
-
 
             auto streamState = std::make_shared<IceStreamState>(n,
                                                                 std::move(callback));
 
-            auto componentStateChangedCallback = [streamState = std::move(streamState), agent,n
-                    ](guint stream_id, guint state) {
-                if (streamState->alreadyFired) return;
+            //component 1 carries the session and decides success; the others only add paths, so the callback
+            //waits until every component settled, or the grace period after component 1 came up ran out
+            auto componentStateChangedCallback = [streamState = std::move(streamState), agent, n, isSender, receiverId
+                    ](guint stream_id, guint component_id, guint state) {
+                if (streamState->alreadyFired) {
+                    if (streamState->established && component_id == 1) followRoute(isSender, receiverId, state);
+                    return;
+                }
+                if (state != NICE_COMPONENT_STATE_READY && state != NICE_COMPONENT_STATE_FAILED) return;
+                if (!streamState->settled.insert(component_id).second) return;
+                ++streamState->settledComponents;
+                if (state == NICE_COMPONENT_STATE_READY) ++streamState->readyComponents;
 
-                if (state == NICE_COMPONENT_STATE_READY) {
-                    streamState->alreadyFired = true;
-                    streamState->callback(agent, true, stream_id, n);
-                } else if (state == NICE_COMPONENT_STATE_FAILED) {
+                if (component_id == 1 && state == NICE_COMPONENT_STATE_FAILED) {
                     streamState->alreadyFired = true;
                     streamState->callback(nullptr, false, stream_id, n);
+                    return;
                 }
+                if (!streamState->settled.contains(1)) return;
+                if (streamState->settledComponents >= streamState->totalComponents) {
+                    streamState->alreadyFired = true;
+                    streamState->established = true;
+                    streamState->callback(agent, true, stream_id, n);
+                    return;
+                }
+                if (streamState->graceArmed) return;
+                streamState->graceArmed = true;
+                struct Grace {
+                    std::shared_ptr<IceStreamState> state;
+                    NiceAgent *agent;
+                    guint streamId;
+                    int n;
+                };
+                ThreadManager::addTimeout(MULTIPATH_GRACE_MS, [](gpointer data) -> gboolean {
+                    const auto *grace = static_cast<Grace *>(data);
+                    if (!grace->state->alreadyFired) {
+                        spdlog::warn("{} of {} ICE paths connected; continuing without the rest",
+                                     grace->state->readyComponents, grace->n);
+                        grace->state->alreadyFired = true;
+                        grace->state->established = true;
+                        grace->state->callback(grace->agent, true, grace->streamId, grace->n);
+                    }
+                    delete grace;
+                    return G_SOURCE_REMOVE;
+                }, new Grace{streamState, agent, stream_id, n});
             };
 
             auto componentStateChangedCallbackPtr = new decltype(componentStateChangedCallback)(
@@ -292,7 +394,7 @@ namespace common {
                                           data) {
 
                                       auto *c = static_cast<decltype(componentStateChangedCallback) *>(data);
-                                      (*c)(stream_id, state);
+                                      (*c)(stream_id, component_id, state);
 
                                       }),
                                   componentStateChangedCallbackPtr,
@@ -302,5 +404,61 @@ namespace common {
                                   static_cast<GConnectFlags>(0)
             );
         }
+
+        static void onRestart(RestartCallback callback) {
+            restartCallback_ = std::move(callback);
+        }
+
+        //fresh credentials and candidates from the peer, either starting a restart or answering ours
+        static void applyRestart(const bool isSender, const std::string &receiverId,
+                                 const CandidatesResult &remoteCredentials, const int generation) {
+            auto *ice = agentContext(isSender, receiverId);
+            if (!ice || generation < ice->generation) return;
+            if (generation > ice->generation && !restart(isSender, receiverId, *ice, generation)) return;
+            if (setRemote(ice->agent, ice->streamId, ice->components, remoteCredentials) < 0) {
+                spdlog::warn("ICE restart rejected the peer's credentials");
+            }
+        }
+
+    private:
+        static IceAgentContext *agentContext(const bool isSender, const std::string &receiverId) {
+            if (!isSender) return receiverAgentContext_.agent ? &receiverAgentContext_ : nullptr;
+            const auto it = agentsMap_.find(receiverId);
+            return it == agentsMap_.end() ? nullptr : &it->second;
+        }
+
+        //the route under a running transfer failed: restart ICE once and let the QUIC connection ride it out on
+        //its idle timeout; if the restart finds nothing either, the connection times out and resume takes over
+        static void followRoute(const bool isSender, const std::string &receiverId, const guint state) {
+            auto *ice = agentContext(isSender, receiverId);
+            if (!ice) return;
+            if (state == NICE_COMPONENT_STATE_READY) {
+                if (ice->restarting) spdlog::info("P2P route recovered");
+                ice->restarting = false;
+                return;
+            }
+            if (state != NICE_COMPONENT_STATE_FAILED) return;
+            if (ice->restarting) {
+                spdlog::warn("ICE restart found no new route");
+                return;
+            }
+            spdlog::warn("P2P route lost; restarting ICE");
+            restart(isSender, receiverId, *ice, ice->generation + 1);
+        }
+
+        static bool restart(const bool isSender, const std::string &receiverId, IceAgentContext &ice,
+                            const int generation) {
+            ice.generation = generation;
+            ice.restarting = true;
+            if (!nice_agent_restart_stream(ice.agent, ice.streamId)) {
+                spdlog::warn("ICE restart failed");
+                return false;
+            }
+            if (restartCallback_) {
+                restartCallback_(receiverId, localCandidates(isSender, ice.agent, ice.streamId, ice.components),
+                                 generation);
+            }
+            return true;
+        }
     };
 }
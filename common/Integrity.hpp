@@ -0,0 +1,190 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <string>
+#include <vector>
+#include <lsquic.h>
+#include <llfio/llfio.hpp>
+
+#include "AlignedBuffer.hpp"
+#include "FileHandleCache.hpp"
+#include "Hash.hpp"
+
+namespace llfio = LLFIO_V2_NAMESPACE;
+
+namespace common {
+    //sender -> receiver records on the integrity stream
+    inline constexpr uint8_t INTEGRITY_CHUNK_DIGEST = 0x01;
+    inline constexpr uint8_t INTEGRITY_CHUNK_REPAIR = 0x02;
+    inline constexpr uint8_t INTEGRITY_DIGESTS_END = 0x03;
+    //a whole fec block (offset carries its sequence) the datagram path could not deliver
+    inline constexpr uint8_t INTEGRITY_FEC_BLOCK = 0x07;
+    //receiver -> sender records on the integrity stream
+    inline constexpr uint8_t INTEGRITY_CHUNK_RETRY = 0x04;
+    //every fec block below offset has been delivered
+    inline constexpr uint8_t INTEGRITY_FEC_ACK = 0x05;
+    //fec block at offset could not be decoded; asks for INTEGRITY_FEC_BLOCK
+    inline constexpr uint8_t INTEGRITY_FEC_NACK = 0x06;
+
+    //kind + fileId + offset + len + digest
+    inline constexpr size_t INTEGRITY_RECORD_SIZE = 1 + 4 + 8 + 4 + DIGEST_SIZE;
+    inline constexpr int INTEGRITY_MAX_RETRIES = 3;
+
+    struct ChunkDigest {
+        uint32_t fileId = 0;
+        uint64_t offset = 0;
+        uint32_t len = 0;
+        Digest128 digest{};
+    };
+
+    //one bidirectional stream carrying chunk digests, retry requests, repaired chunks and fec feedback
+    struct IntegrityChannel {
+        lsquic_stream_t *stream = nullptr;
+        std::vector<uint8_t> out;
+        size_t outSent = 0;
+        std::vector<uint8_t> in;
+        size_t inRead = 0;
+
+        void queue(const uint8_t kind, const ChunkDigest &c, const uint8_t *payload = nullptr) {
+            const size_t base = out.size();
+            out.resize(base + INTEGRITY_RECORD_SIZE + (payload ? c.len : 0));
+            uint8_t *p = out.data() + base;
+            *p++ = kind;
+            memcpy(p, &c.fileId, 4);
+            p += 4;
+            memcpy(p, &c.offset, 8);
+            p += 8;
+            memcpy(p, &c.len, 4);
+            p += 4;
+            Hash::write(p, c.digest);
+            p += DIGEST_SIZE;
+            if (payload) memcpy(p, payload, c.len);
+            if (stream) lsquic_stream_wantwrite(stream, 1);
+        }
+
+        void queueEnd() {
+            out.push_back(INTEGRITY_DIGESTS_END);
+            if (stream) lsquic_stream_wantwrite(stream, 1);
+        }
+
+        bool pending() const {
+            return outSent < out.size();
+        }
+
+        void flush() {
+            while (outSent < out.size()) {
+                const ssize_t nw = lsquic_stream_write(stream, out.data() + outSent, out.size() - outSent);
+                if (nw <= 0) break;
+                outSent += static_cast<size_t>(nw);
+            }
+
+            if (outSent == out.size()) {
+                out.clear();
+                outSent = 0;
+                lsquic_stream_flush(stream);
+                lsquic_stream_wantwrite(stream, 0);
+            } else if (outSent >= out.size() / 2) {
+                out.erase(out.begin(), out.begin() + static_cast<std::ptrdiff_t>(outSent));
+                outSent = 0;
+            }
+        }
+
+        //returns false when the peer closed its side
+        bool drain() {
+            uint8_t tmp[64 * 1024];
+            while (true) {
+                const ssize_t nr = lsquic_stream_read(stream, tmp, sizeof(tmp));
+                if (nr > 0) {
+                    in.insert(in.end(), tmp, tmp + nr);
+                    continue;
+                }
+                return nr != 0;
+            }
+        }
+
+        //pops the next complete record off the input buffer; repair and fec block payloads are copied out
+        bool next(uint8_t &kind, ChunkDigest &c, std::vector<uint8_t> &payload) {
+            const size_t avail = in.size() - inRead;
+            if (avail == 0) return false;
+            const uint8_t *p = in.data() + inRead;
+            kind = *p++;
+            if (kind == INTEGRITY_DIGESTS_END) {
+                consume(1);
+                return true;
+            }
+            if (avail < INTEGRITY_RECORD_SIZE) return false;
+            memcpy(&c.fileId, p, 4);
+            p += 4;
+            memcpy(&c.offset, p, 8);
+            p += 8;
+            memcpy(&c.len, p, 4);
+            p += 4;
+            c.digest = Hash::read(p);
+            p += DIGEST_SIZE;
+
+            size_t need = INTEGRITY_RECORD_SIZE;
+            if (kind == INTEGRITY_CHUNK_REPAIR || kind == INTEGRITY_FEC_BLOCK) {
+                need += c.len;
+                if (avail < need) return false;
+                payload.assign(p, p + c.len);
+            }
+            consume(need);
+            return true;
+        }
+
+    private:
+        void consume(const size_t n) {
+            inRead += n;
+            if (inRead == in.size()) {
+                in.clear();
+                inRead = 0;
+            } else if (inRead >= in.size() / 2) {
+                in.erase(in.begin(), in.begin() + static_cast<std::ptrdiff_t>(inRead));
+                inRead = 0;
+            }
+        }
+    };
+
+    class Integrity {
+    public:
+        //reads a range back through an open handle and hashes it; meant to run on a worker thread. direct handles
+        //read the whole blocks around the range and hash only the part asked for
+        static std::optional<Digest128> digestFileRange(llfio::file_handle &fh, const uint64_t offset,
+                                                        const uint32_t len) {
+            const bool direct = fh.requires_aligned_io();
+            const uint64_t start = direct ? offset - offset % IO_ALIGNMENT : offset;
+            const size_t skip = offset - start;
+            const size_t want = direct ? (skip + len + IO_ALIGNMENT - 1) / IO_ALIGNMENT * IO_ALIGNMENT : len;
+            thread_local AlignedBuffer buf;
+            if (buf.size() < want) buf.resize(want);
+
+            size_t got = 0;
+            while (got < skip + len) {
+                llfio::byte_io_handle::buffer_type reqBuf({
+                    reinterpret_cast<llfio::byte *>(buf.data() + got),
+                    want - got
+                });
+                llfio::file_handle::io_request<llfio::file_handle::buffers_type> req(
+                    llfio::file_handle::buffers_type{&reqBuf, 1},
+                    start + got
+                );
+                auto result = fh.read(req);
+                if (!result || result.bytes_transferred() == 0) return std::nullopt;
+                got += result.bytes_transferred();
+            }
+            return Hash::digest(buf.data() + skip, len);
+        }
+
+        //pins the file's cached handle for the read instead of opening the file again
+        static std::optional<Digest128> digestFileRange(FileHandleCache &cache, const uint32_t fileId,
+                                                        const bool write, const uint64_t offset,
+                                                        const uint32_t len) {
+            auto *fh = cache.acquire(fileId, write);
+            if (!fh) return std::nullopt;
+            auto digest = digestFileRange(*fh, offset, len);
+            cache.release(fileId);
+            return digest;
+        }
+    };
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "Hash.hpp"
+
+namespace common {
+    //per-chunk digests in global chunk order (file id, then offset). the leaf list itself is what resumed data
+    //is checked against; it travels inside the manifest, so it is exactly as trustworthy as the manifest stream
+    struct MerkleTree {
+        std::vector<Digest128> leaves;
+
+        //[u32 leafCount][leaves...]
+        void encode(std::vector<uint8_t> &out) const {
+            const size_t base = out.size();
+            const uint32_t count = static_cast<uint32_t>(leaves.size());
+            out.resize(base + 4 + leaves.size() * DIGEST_SIZE);
+            uint8_t *p = out.data() + base;
+            memcpy(p, &count, 4);
+            p += 4;
+            for (const auto &leaf: leaves) {
+                Hash::write(p, leaf);
+                p += DIGEST_SIZE;
+            }
+        }
+
+        //returns false when the section is truncated
+        bool decode(const uint8_t *p, const size_t len) {
+            if (len < 4) return false;
+            uint32_t count;
+            memcpy(&count, p, 4);
+            p += 4;
+            if (len != 4 + static_cast<size_t>(count) * DIGEST_SIZE) return false;
+            leaves.resize(count);
+            for (uint32_t i = 0; i < count; ++i) {
+                leaves[i] = Hash::read(p);
+                p += DIGEST_SIZE;
+            }
+            return true;
+        }
+    };
+}
@@ -1,5 +1,6 @@
 #pragma once
 #include <string>
+#include <vector>
 #include <nlohmann/json.hpp>
 #include "Types.hpp"
 namespace common {
@@ -39,9 +40,22 @@ namespace common {
         CandidatesResult candidatesResult;
         std::string joinCode;
         std::string receiverId;
+        //hex hashes of manifests the receiver still has from an unfinished earlier run
+        std::vector<std::string> cachedManifests;
     };
 
-    NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(JoinTransferSessionPayload, type, candidatesResult, joinCode, receiverId);
+    NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE_WITH_DEFAULT(JoinTransferSessionPayload, type, candidatesResult, joinCode,
+                                                    receiverId, cachedManifests);
+
+    //fresh ICE credentials and candidates after a route failed mid-transfer; relayed to the other side as is
+    struct RestartIcePayload {
+        std::string type = "restart_ice_payload";
+        CandidatesResult candidatesResult;
+        std::string receiverId;
+        int generation = 0;
+    };
+
+    NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(RestartIcePayload, type, candidatesResult, receiverId, generation);
 
 
     struct TurnCredentialsPayload {
@@ -0,0 +1,57 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace common {
+    //maps send positions to stable file ids; the identity unless the manifest carries an ORDER section.
+    //resume state and the manifest ACK are expressed in positions so ids never change meaning
+    struct SendOrder {
+        std::vector<uint32_t> ids;
+        std::vector<uint32_t> positions;
+
+        uint32_t idAt(const size_t position) const {
+            return ids.empty() ? static_cast<uint32_t>(position) : ids[position];
+        }
+
+        uint32_t positionOf(const uint32_t id) const {
+            return positions.empty() ? id : positions[id];
+        }
+
+        bool isIdentity() const {
+            return ids.empty();
+        }
+
+        //returns false unless order is a permutation of [0, order.size())
+        bool assign(std::vector<uint32_t> order) {
+            std::vector<uint32_t> inverse(order.size(), UINT32_MAX);
+            for (uint32_t pos = 0; pos < order.size(); ++pos) {
+                const uint32_t id = order[pos];
+                if (id >= order.size() || inverse[id] != UINT32_MAX) return false;
+                inverse[id] = pos;
+            }
+            ids = std::move(order);
+            positions = std::move(inverse);
+            return true;
+        }
+
+        //[u32 count][count x u32 id]
+        void encode(std::vector<uint8_t> &out) const {
+            const size_t base = out.size();
+            const uint32_t count = static_cast<uint32_t>(ids.size());
+            out.resize(base + 4 + ids.size() * 4);
+            memcpy(out.data() + base, &count, 4);
+            if (!ids.empty()) memcpy(out.data() + base + 4, ids.data(), ids.size() * 4);
+        }
+
+        bool decode(const uint8_t *p, const size_t len, const uint32_t fileCount) {
+            if (len < 4) return false;
+            uint32_t count;
+            memcpy(&count, p, 4);
+            if (count != fileCount || len != 4 + static_cast<size_t>(count) * 4) return false;
+            std::vector<uint32_t> order(count);
+            if (count > 0) memcpy(order.data(), p + 4, static_cast<size_t>(count) * 4);
+            return assign(std::move(order));
+        }
+    };
+}
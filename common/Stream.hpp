@@ -6,11 +6,34 @@
 #include <gio/gio.h>
 #include <spdlog/spdlog.h>
 
+#include "Congestion.hpp"
+#include "Contexts.hpp"
 #include "Utils.hpp"
+#include "ThreadManager.hpp"
 
 #include <chrono>
+#include <memory>
+#include <mutex>
+#include <vector>
 #include <boost/asio/steady_timer.hpp>
 
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#if defined(__linux__)
+#include <sys/timerfd.h>
+#include <unistd.h>
+#endif
+#if defined(__linux__) || defined(__APPLE__)
+#include <ifaddrs.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
 namespace common {
     static int spdlogLogBuf(void *ctx, const char *buf, size_t len) {
         std::string msg(buf, len);
@@ -38,30 +61,199 @@ namespace common {
     protected:
 
         inline static std::vector<ConnectionContext *> connectionContexts_;
+        //the data plane is the only writer; held there while the list changes, and by the progress reporter only
+        //while it samples the counters, never while it draws
+        inline static std::mutex contextsMutex_;
         inline static SSL_CTX *sslCtx_ = nullptr;
 
+        //an lsquic engine and the loop that exclusively drives it; connections never move between shards
+        struct EngineShard {
+            lsquic_engine_t *engine = nullptr;
+            GMainContext *context = nullptr;
+            //one persistent tick source per shard, re-armed after every pass through the engine
+            GSource *tickSource = nullptr;
+            int timerFd = -1;
+            //controller every connection of this engine runs; fixed when the engine is created
+            CongestionControl cc = CongestionControl::BBR;
+            //runs for each live connection of the shard on every stats tick, after its path sample is refreshed
+            void (*onStatsTick)(ConnectionContext *) = nullptr;
+        };
+
+        struct TickSource {
+            GSource source;
+            EngineShard *shard;
+        };
+
+        //engine has nothing scheduled: look again after this long anyway
+        inline static constexpr int IDLE_TICK_US = 100000;
+
+        //IPv6 + UDP; assumed for every path since the engine-wide probe ceiling is set before any path exists
+        inline static constexpr unsigned PLPMTU_HEADER_OVERHEAD = 48;
+        inline static constexpr unsigned MAX_PLPMTU = 65527;
+        //TURN wraps every packet again and the relay's own path is unknown; start from the QUIC minimum there
+        inline static constexpr unsigned short RELAYED_BASE_PLPMTU = 1200;
+
+        inline static std::vector<std::unique_ptr<EngineShard> > engineShards_;
+
+        static EngineShard *addEngineShard(lsquic_engine_t *shardEngine, GMainContext *context) {
+            engineShards_.push_back(std::make_unique<EngineShard>(EngineShard{shardEngine, context}));
+            if (engineShards_.size() == 1) engine = shardEngine;
+            return engineShards_.back().get();
+        }
 
-        static gboolean engineTick(gpointer data) {
-            if (!engine) {
-                return G_SOURCE_REMOVE;
-            }
+        static EngineShard *shardOf(const ConnectionContext *ctx) {
+            return engineShards_[ctx->shard < engineShards_.size() ? ctx->shard : 0].get();
+        }
 
-            process();
+        //dispatch of the shard's tick source
+        static gboolean engineTick(GSource *source, GSourceFunc, gpointer) {
+            auto *shard = reinterpret_cast<TickSource *>(source)->shard;
+#if defined(__linux__)
+            if (shard->timerFd >= 0) {
+                uint64_t expirations;
+                (void) !read(shard->timerFd, &expirations, sizeof(expirations));
+            }
+#endif
+            g_source_set_ready_time(source, -1);
+            if (!shard->engine) return G_SOURCE_REMOVE;
+            process(shard);
+            return G_SOURCE_CONTINUE;
+        }
 
-            int diff;
+        //the pacer asks for release times in microseconds; a timerfd wakes poll() exactly then, while plain
+        //g_timeout sources would round every wait up to a whole millisecond
+        inline static GSourceFuncs tickSourceFuncs_ = {nullptr, nullptr, engineTick, nullptr, nullptr, nullptr};
+
+        static void startTicking(EngineShard *shard) {
+            shard->tickSource = g_source_new(&tickSourceFuncs_, sizeof(TickSource));
+            reinterpret_cast<TickSource *>(shard->tickSource)->shard = shard;
+            g_source_set_priority(shard->tickSource, G_PRIORITY_DEFAULT);
+            g_source_set_name(shard->tickSource, "thruflux-engine-tick");
+#if defined(__linux__)
+            shard->timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+            if (shard->timerFd >= 0) g_source_add_unix_fd(shard->tickSource, shard->timerFd, G_IO_IN);
+#endif
+            g_source_set_ready_time(shard->tickSource, 0);
+            g_source_attach(shard->tickSource, shard->context);
+        }
 
-            if (lsquic_engine_earliest_adv_tick(engine, &diff)) {
-                if (diff <= 0) {
-                    g_idle_add_full(G_PRIORITY_DEFAULT, engineTick, nullptr, nullptr);
-                } else {
-                    guint interval = (guint) ((diff + 999) / 1000);
-                    g_timeout_add_full(G_PRIORITY_DEFAULT, interval, engineTick, nullptr, nullptr);
+        //arms the shard's tick for the engine's next deadline, replacing whatever was armed before
+        static void scheduleTick(EngineShard *shard) {
+            if (!shard->tickSource || !shard->engine) return;
+            int diff = 0;
+            if (!lsquic_engine_earliest_adv_tick(shard->engine, &diff)) diff = IDLE_TICK_US;
+            if (diff <= 0) {
+                g_source_set_ready_time(shard->tickSource, 0);
+                return;
+            }
+#if defined(__linux__)
+            if (shard->timerFd >= 0) {
+                itimerspec spec{};
+                spec.it_value.tv_sec = diff / 1000000;
+                spec.it_value.tv_nsec = static_cast<long>(diff % 1000000) * 1000;
+                if (timerfd_settime(shard->timerFd, 0, &spec, nullptr) == 0) {
+                    g_source_set_ready_time(shard->tickSource, -1);
+                    return;
                 }
-            } else {
-                g_timeout_add_full(G_PRIORITY_DEFAULT, 100, engineTick, nullptr, nullptr);
             }
+#endif
+            g_source_set_ready_time(shard->tickSource, g_get_monotonic_time() + diff);
+        }
+
+        inline static constexpr guint STATS_INTERVAL_MS = 1000;
+
+        //refreshes the path sample from lsquic; must run on the shard that owns the connection
+        static void samplePath(ConnectionContext *ctx, lsquic_conn_t *connection) {
+            lsquic_conn_info info{};
+            if (connection && lsquic_conn_get_info(connection, &info) == 0) {
+                ctx->stats.observe(PathSample{
+                    .cwnd = info.lci_cwnd,
+                    .bytesInFlight = info.lci_bytes_in_flight,
+                    .pacingRate = info.lci_pacing_rate,
+                    .bwEstimate = info.lci_bw_estimate,
+                    .rttUs = info.lci_rtt,
+                    .rttVarUs = info.lci_rttvar,
+                    .minRttUs = info.lci_min_rtt,
+                    .pktsSent = info.lci_pkts_sent,
+                    .pktsLost = info.lci_pkts_lost,
+                    .pktsRetx = info.lci_pkts_retx,
+                });
+            }
+        }
 
-            return G_SOURCE_REMOVE;
+        static nlohmann::json collectStats(ConnectionContext *ctx, const char *event,
+                                           lsquic_conn_t *connection = nullptr) {
+            if (!connection) connection = ctx->connection;
+            samplePath(ctx, connection);
+            auto line = ctx->stats.toJson();
+            line["event"] = event;
+            line["elapsed_ms"] = ctx->started
+                                     ? std::chrono::duration_cast<std::chrono::milliseconds>(
+                                         std::chrono::steady_clock::now() - ctx->startTime).count()
+                                     : 0;
+            line["bytes"] = ctx->bytesMoved.load();
+            line["throughput"] = ctx->ewmaThroughput.load();
+            line["relayed"] = ctx->connectionType == ConnectionContext::RELAYED;
+            //BoringSSL settles on AES-GCM with AES instructions on hand and ChaCha20 without, so record which it was
+            if (const char *cipher = connection ? lsquic_conn_crypto_cipher(connection) : nullptr) {
+                line["cipher"] = cipher;
+            }
+            line["workers"] = workerStatsJson();
+            return line;
+        }
+
+        //per stage queue metrics of the shared worker pool; stages that never saw a job are left out
+        static nlohmann::json workerStatsJson() {
+            auto out = nlohmann::json::object();
+            const auto stages = ThreadManager::workerStats();
+            for (size_t i = 0; i < stages.size(); ++i) {
+                const auto &s = stages[i];
+                if (s.completed == 0 && s.queued == 0 && s.running == 0) continue;
+                out[WORK_STAGE_NAMES[i]] = {
+                    {"queued", s.queued},
+                    {"running", s.running},
+                    {"completed", s.completed},
+                    {"max_queued", s.maxQueued},
+                    {"avg_wait_ms", s.avgWaitMs},
+                };
+            }
+            return out;
+        }
+
+        //one JSON line per live connection of the shard, every STATS_INTERVAL_MS; without a sink the tick only
+        //runs to feed the shard's onStatsTick
+        static void startStats(EngineShard *shard) {
+            if (!StatsSink::enabled() && !shard->onStatsTick) return;
+            ThreadManager::addTimeout(STATS_INTERVAL_MS, [](gpointer data) -> gboolean {
+                auto *owner = static_cast<EngineShard *>(data);
+                if (!owner->engine) return G_SOURCE_REMOVE;
+                std::lock_guard lock(contextsMutex_);
+                for (auto *ctx: connectionContexts_) {
+                    if (!ctx || !ctx->connection || shardOf(ctx) != owner) continue;
+                    if (StatsSink::enabled()) {
+                        StatsSink::write(collectStats(ctx, "sample"));
+                    } else {
+                        samplePath(ctx, ctx->connection);
+                    }
+                    if (owner->onStatsTick) owner->onStatsTick(ctx);
+                }
+                return G_SOURCE_CONTINUE;
+            }, shard, G_PRIORITY_LOW, shard->context);
+        }
+
+        //end of transfer: the last sample goes to the stream, and a readable digest to the log.
+        //takes the closing connection explicitly since ctx->connection may already be cleared
+        static void reportStats(ConnectionContext *ctx, lsquic_conn_t *connection) {
+            if (!StatsSink::enabled()) return;
+            const auto line = collectStats(ctx, "summary", connection);
+            StatsSink::write(line);
+            const auto &stats = ctx->stats;
+            spdlog::info("Stats {}: avg rtt {:.1f} ms, min rtt {:.1f} ms, cwnd {}, loss {:.2f}%, "
+                         "buffer stalls {} ms, credit stalls {} ms, disk read p99 {} us, disk write p99 {} us",
+                         stats.peer, line["avg_rtt_us"].get<uint64_t>() / 1000.0, stats.path.minRttUs / 1000.0,
+                         Utils::sizeToReadableFormat(static_cast<double>(stats.path.cwnd)), stats.lossPercent(),
+                         line["buffer_stall_ms"].get<uint64_t>(), line["credit_stall_ms"].get<uint64_t>(),
+                         stats.diskRead.percentileUs(0.99), stats.diskWrite.percentileUs(0.99));
         }
 
 
@@ -93,6 +285,7 @@ namespace common {
         }
 
     public:
+        //the first shard's engine; the receiver only ever has this one
         inline static lsquic_engine_t *engine;
         static int sendPackets(void *packetsOutCtx, const lsquic_out_spec *specs, unsigned nSpecs) {
             if (nSpecs == 0) {
@@ -142,19 +335,28 @@ namespace common {
                 }
 
 
+                GError *sendError = nullptr;
                 const int nSent = ctx->agent ? nice_agent_send_messages_nonblocking(
                     ctx->agent,
                     ctx->streamId,
-                    1,
+                    ctx->componentId,
                     niceMessages,
                     batchSize,
                     nullptr,
-                    nullptr
+                    &sendError
                 ) : -1;
 
 
 
                 if (nSent < 0) {
+                    //an MTU probe larger than the interface allows; on EMSGSIZE lsquic drops it as a failed probe
+                    const bool tooLarge = sendError &&
+                                          g_error_matches(sendError, G_IO_ERROR, G_IO_ERROR_MESSAGE_TOO_LARGE);
+                    g_clear_error(&sendError);
+                    if (tooLarge && totalSent == 0) {
+                        errno = EMSGSIZE;
+                        return -1;
+                    }
                     break;
                 }
 
@@ -206,13 +408,89 @@ namespace common {
             }
         }
 
+        //DPLPMTUD probes must leave with DF set, or a probe bigger than the path would be fragmented and count
+        //as a fit. PROBE also ignores the kernel's cached path MTU so lsquic does its own search
+        static void setDontFragment(NiceAgent *agent, guint streamId, int componentId) {
+            GSocket *gsock = nice_agent_get_selected_socket(agent, streamId, componentId);
+            if (!gsock) return;
+            GError *error = nullptr;
+            gboolean ok = TRUE;
+            const bool v6 = g_socket_get_family(gsock) == G_SOCKET_FAMILY_IPV6;
+#if defined(__linux__)
+            ok = v6
+                     ? g_socket_set_option(gsock, IPPROTO_IPV6, IPV6_MTU_DISCOVER, IPV6_PMTUDISC_PROBE, &error)
+                     : g_socket_set_option(gsock, IPPROTO_IP, IP_MTU_DISCOVER, IP_PMTUDISC_PROBE, &error);
+#elif defined(__APPLE__)
+            ok = v6
+                     ? g_socket_set_option(gsock, IPPROTO_IPV6, IPV6_DONTFRAG, 1, &error)
+                     : g_socket_set_option(gsock, IPPROTO_IP, IP_DONTFRAG, 1, &error);
+#elif defined(_WIN32)
+            ok = v6
+                     ? g_socket_set_option(gsock, IPPROTO_IPV6, IPV6_DONTFRAG, 1, &error)
+                     : g_socket_set_option(gsock, IPPROTO_IP, IP_DONTFRAGMENT, 1, &error);
+#else
+            (void) v6;
+#endif
+            if (!ok) {
+                spdlog::warn("Socket {} Failed to set don't fragment; path MTU probes may overestimate: {}",
+                             componentId, error->message);
+                g_clear_error(&error);
+            }
+            g_object_unref(gsock);
+        }
+
+        //largest UDP payload any non-loopback interface can carry, assuming IPv6 headers; 0 if unknown
+        static unsigned short largestInterfacePlpmtu() {
+            unsigned mtu = 0;
+#if defined(__linux__) || defined(__APPLE__)
+            ifaddrs *addrs = nullptr;
+            if (getifaddrs(&addrs) != 0) return 0;
+            const int fd = socket(AF_INET, SOCK_DGRAM, 0);
+            for (const ifaddrs *a = addrs; a && fd >= 0; a = a->ifa_next) {
+                if (!a->ifa_name || (a->ifa_flags & IFF_LOOPBACK) || !(a->ifa_flags & IFF_UP)) continue;
+                ifreq req{};
+                std::strncpy(req.ifr_name, a->ifa_name, IFNAMSIZ - 1);
+                if (ioctl(fd, SIOCGIFMTU, &req) == 0) mtu = std::max(mtu, static_cast<unsigned>(req.ifr_mtu));
+            }
+            if (fd >= 0) close(fd);
+            freeifaddrs(addrs);
+#endif
+            if (mtu <= PLPMTU_HEADER_OVERHEAD) return 0;
+            return static_cast<unsigned short>(std::min<unsigned>(mtu - PLPMTU_HEADER_OVERHEAD, MAX_PLPMTU));
+        }
+
+        //base 0 keeps lsquic's default; max 0 probes up to what the local interfaces allow
+        static void configurePathMtu(lsquic_engine_settings &settings, const bool pmtud, const int base,
+                                     const int max) {
+            settings.es_dplpmtud = pmtud ? 1 : 0;
+            if (base > 0) settings.es_base_plpmtu = static_cast<unsigned short>(base);
+            if (!pmtud) return;
+            unsigned short ceiling = max > 0 ? static_cast<unsigned short>(max) : largestInterfacePlpmtu();
+            if (ceiling == 0) return;
+            if (base > ceiling) ceiling = static_cast<unsigned short>(base);
+            settings.es_max_plpmtu = ceiling;
+            spdlog::debug("Path MTU discovery up to {} byte packets", ceiling);
+        }
+
         static void dispose() {
-            if (engine) {
-                lsquic_engine_destroy(engine);
-                engine = nullptr;
+            for (const auto &shard: engineShards_) {
+                if (shard->tickSource) {
+                    g_source_destroy(shard->tickSource);
+                    g_source_unref(shard->tickSource);
+                    shard->tickSource = nullptr;
+                }
+#if defined(__linux__)
+                if (shard->timerFd >= 0) close(shard->timerFd);
+                shard->timerFd = -1;
+#endif
+                if (shard->engine) lsquic_engine_destroy(shard->engine);
+                shard->engine = nullptr;
             }
+            if (engineShards_.empty() && engine) lsquic_engine_destroy(engine);
+            engine = nullptr;
 
 
+            std::lock_guard lock(contextsMutex_);
             for (const auto &context: connectionContexts_) {
                 delete context;
             }
@@ -229,9 +507,15 @@ namespace common {
         }
 
 
-        static void process() {
-            lsquic_engine_process_conns(engine);
-            lsquic_engine_send_unsent_packets(engine);
+        static void process(lsquic_engine_t *shardEngine = engine) {
+            lsquic_engine_process_conns(shardEngine);
+            lsquic_engine_send_unsent_packets(shardEngine);
+        }
+
+        //processes and re-arms the tick, so packets that move a deadline earlier are honoured right away
+        static void process(EngineShard *shard) {
+            process(shard->engine);
+            scheduleTick(shard);
         }
     };
 }
@@ -0,0 +1,30 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace common {
+    //multipath: a striped data stream is a run of units, each [u32 position][u64 offset][u64 end] followed by
+    //the data bytes of [offset, end) with holes left out. a unit never crosses a chunk boundary
+    inline constexpr size_t STRIPE_HEADER_SIZE = 4 + 8 + 8;
+
+    struct StripeUnit {
+        uint32_t position = 0;
+        uint64_t offset = 0;
+        uint64_t end = 0;
+
+        void encode(uint8_t *p) const {
+            memcpy(p, &position, 4);
+            memcpy(p + 4, &offset, 8);
+            memcpy(p + 12, &end, 8);
+        }
+
+        static StripeUnit decode(const uint8_t *p) {
+            StripeUnit unit;
+            memcpy(&unit.position, p, 4);
+            memcpy(&unit.offset, p + 4, 8);
+            memcpy(&unit.end, p + 12, 8);
+            return unit;
+        }
+    };
+}
@@ -0,0 +1,209 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <glib.h>
+
+#if defined(__linux__)
+#include <sys/eventfd.h>
+#include <unistd.h>
+#endif
+
+namespace common {
+    //tasks run per dispatch before the loop gets a chance to poll sockets again
+    inline static constexpr size_t TASK_BATCH = 256;
+    //callables up to this size are stored inside their node; bigger ones cost one extra allocation
+    inline static constexpr size_t TASK_INLINE_BYTES = 64;
+    //drained nodes kept for reuse so a steady stream of posts doesn't touch the allocator
+    inline static constexpr size_t TASK_NODE_POOL = 1024;
+
+    //multi producer, single consumer queue of callables drained by a GSource on one GMainContext.
+    //producers never block: nodes are linked with one exchange (Vyukov's intrusive MPSC queue), node reuse only
+    //ever try_locks the pool, and the loop is only woken on the transition from drained to non-empty (eventfd on Linux)
+    class TaskQueue {
+        struct Node {
+            std::atomic<Node *> next{nullptr};
+            //runs the stored callable and destroys it
+            void (*run)(Node *) = nullptr;
+            Node *nextFree = nullptr;
+            alignas(std::max_align_t) unsigned char storage[TASK_INLINE_BYTES];
+        };
+
+        struct QueueSource {
+            GSource source;
+            TaskQueue *queue;
+        };
+
+        std::atomic<Node *> head_;
+        Node *tail_;
+        Node stub_;
+        //true from the first push after a drain started until the next drain; producers only wake on false -> true
+        std::atomic<bool> signalled_{false};
+        GMainContext *context_ = nullptr;
+        GSource *source_ = nullptr;
+        int eventFd_ = -1;
+        std::mutex poolMutex_;
+        Node *pool_ = nullptr;
+        size_t pooled_ = 0;
+
+        Node *allocate() {
+            if (poolMutex_.try_lock()) {
+                Node *node = pool_;
+                if (node) {
+                    pool_ = node->nextFree;
+                    --pooled_;
+                }
+                poolMutex_.unlock();
+                if (node) return node;
+            }
+            return new Node();
+        }
+
+        void recycle(Node *node) {
+            node->run = nullptr;
+            if (poolMutex_.try_lock()) {
+                if (pooled_ < TASK_NODE_POOL) {
+                    node->nextFree = pool_;
+                    pool_ = node;
+                    ++pooled_;
+                    node = nullptr;
+                }
+                poolMutex_.unlock();
+            }
+            delete node;
+        }
+
+        void link(Node *node) {
+            node->next.store(nullptr, std::memory_order_relaxed);
+            Node *prev = head_.exchange(node, std::memory_order_acq_rel);
+            prev->next.store(node, std::memory_order_release);
+        }
+
+        //nullptr when empty or when a producer is halfway through link(); it signals once it finishes
+        Node *pop() {
+            Node *tail = tail_;
+            Node *next = tail->next.load(std::memory_order_acquire);
+            if (tail == &stub_) {
+                if (!next) return nullptr;
+                tail_ = next;
+                tail = next;
+                next = next->next.load(std::memory_order_acquire);
+            }
+            if (next) {
+                tail_ = next;
+                return tail;
+            }
+            if (tail != head_.load(std::memory_order_acquire)) return nullptr;
+            link(&stub_);
+            next = tail->next.load(std::memory_order_acquire);
+            if (next) {
+                tail_ = next;
+                return tail;
+            }
+            return nullptr;
+        }
+
+        void wake() {
+#if defined(__linux__)
+            if (eventFd_ >= 0) {
+                const uint64_t one = 1;
+                (void) !write(eventFd_, &one, sizeof(one));
+                return;
+            }
+#endif
+            g_main_context_wakeup(context_);
+        }
+
+        void drain() {
+#if defined(__linux__)
+            if (eventFd_ >= 0) {
+                uint64_t count;
+                (void) !read(eventFd_, &count, sizeof(count));
+            }
+#endif
+            //cleared before draining so anything pushed from here on signals again
+            signalled_.store(false, std::memory_order_seq_cst);
+            for (size_t ran = 0; ran < TASK_BATCH; ++ran) {
+                Node *node = pop();
+                if (!node) return;
+                node->run(node);
+                recycle(node);
+            }
+            //batch full: come straight back on the next iteration without another wakeup
+            signalled_.store(true, std::memory_order_relaxed);
+        }
+
+        inline static GSourceFuncs sourceFuncs_ = {
+            [](GSource *source, gint *timeout) -> gboolean {
+                *timeout = -1;
+                return reinterpret_cast<QueueSource *>(source)->queue->signalled_.load(std::memory_order_acquire);
+            },
+            [](GSource *source) -> gboolean {
+                return reinterpret_cast<QueueSource *>(source)->queue->signalled_.load(std::memory_order_acquire);
+            },
+            [](GSource *source, GSourceFunc, gpointer) -> gboolean {
+                reinterpret_cast<QueueSource *>(source)->queue->drain();
+                return G_SOURCE_CONTINUE;
+            },
+            nullptr, nullptr, nullptr
+        };
+
+    public:
+        TaskQueue() : head_(&stub_), tail_(&stub_) {
+        }
+
+        TaskQueue(const TaskQueue &) = delete;
+
+        ~TaskQueue() {
+            while (pool_) {
+                Node *node = pool_;
+                pool_ = node->nextFree;
+                delete node;
+            }
+        }
+
+        TaskQueue &operator=(const TaskQueue &) = delete;
+
+        //attaches the draining source; tasks posted before this simply wait in the queue
+        void attach(GMainContext *context, const gint priority = G_PRIORITY_DEFAULT) {
+            context_ = context;
+            source_ = g_source_new(&sourceFuncs_, sizeof(QueueSource));
+            reinterpret_cast<QueueSource *>(source_)->queue = this;
+            g_source_set_priority(source_, priority);
+            g_source_set_name(source_, "thruflux-tasks");
+#if defined(__linux__)
+            eventFd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            if (eventFd_ >= 0) g_source_add_unix_fd(source_, eventFd_, G_IO_IN);
+#endif
+            g_source_attach(source_, context);
+            if (signalled_.load()) wake();
+        }
+
+        template<typename F>
+        void push(F &&fn) {
+            using Fn = std::decay_t<F>;
+            Node *node = allocate();
+            if constexpr (sizeof(Fn) <= TASK_INLINE_BYTES && alignof(Fn) <= alignof(std::max_align_t)) {
+                ::new(static_cast<void *>(node->storage)) Fn(std::forward<F>(fn));
+                node->run = [](Node *n) {
+                    Fn *f = std::launder(reinterpret_cast<Fn *>(n->storage));
+                    (*f)();
+                    f->~Fn();
+                };
+            } else {
+                ::new(static_cast<void *>(node->storage)) Fn *(new Fn(std::forward<F>(fn)));
+                node->run = [](Node *n) {
+                    Fn *f = *std::launder(reinterpret_cast<Fn **>(n->storage));
+                    (*f)();
+                    delete f;
+                };
+            }
+            link(node);
+            if (!signalled_.exchange(true, std::memory_order_seq_cst) && context_) wake();
+        }
+    };
+}
@@ -1,21 +1,84 @@
 #pragma once
-#include <boost/asio/thread_pool.hpp>
 #include <gio/gnetworking.h>
 #include <glib/gmain.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include <spdlog/spdlog.h>
+
+#include "TaskQueue.hpp"
+#include "WorkerPool.hpp"
 
 namespace common {
+    //the GLib loop that owns lsquic and libnice runs on its own thread and context (the data plane).
+    //the thread that calls runMainLoop becomes the control plane: it only renders progress from atomic counters
     class ThreadManager {
+        //additional data plane loops, e.g. one per sender engine shard; index 0 is always the main data plane
+        struct EventLoop {
+            GMainContext *context = nullptr;
+            GMainLoop *loop = nullptr;
+            std::thread thread;
+            TaskQueue tasks;
+        };
+
         inline static GMainContext *context_;
+        inline static TaskQueue tasks_;
+        inline static std::once_flag contextOnce_;
         inline static GMainLoop *mainLoop_;
+        inline static std::thread dataPlane_;
+        inline static std::vector<std::unique_ptr<EventLoop> > extraLoops_;
         inline static std::atomic<bool> terminating_{false};
+        inline static std::mutex controlMutex_;
+        inline static std::condition_variable controlWake_;
+        inline static std::function<void()> progressReporter_;
+        inline static constexpr auto PROGRESS_INTERVAL = std::chrono::seconds(1);
+        inline static std::unique_ptr<WorkerPool> workerPool_;
+        inline static std::once_flag workerPoolOnce_;
+        inline static size_t workerThreads_ = 0;
+        inline static bool pinWorkers_ = false;
+
+        static WorkerPool &workerPool() {
+            std::call_once(workerPoolOnce_, [] {
+                const size_t n = workerThreads_ > 0
+                                     ? workerThreads_
+                                     : std::max(2u, std::thread::hardware_concurrency());
+                workerPool_ = std::make_unique<WorkerPool>(n, pinWorkers_);
+            });
+            return *workerPool_;
+        }
 
     public:
-        //run some task on the main thread
-        static void postTask(std::function<void()> task) {
-            auto *taskPtr = new std::function(std::move(task));
+        //run some task on the data plane thread. the callable goes into the queue as is, so small lambdas are
+        //posted without an allocation of their own
+        template<typename F>
+        static void postTask(F &&task) {
+            postTask(getContext(), std::forward<F>(task));
+        }
+
+        template<typename F>
+        static void postTask(GMainContext *context, F &&task) {
+            if (context == getContext()) {
+                tasks_.push(std::forward<F>(task));
+                return;
+            }
+            for (const auto &loop: extraLoops_) {
+                if (loop->context == context) {
+                    loop->tasks.push(std::forward<F>(task));
+                    return;
+                }
+            }
+
+            //a context we don't own a queue for
+            auto *taskPtr = new std::function<void()>(std::forward<F>(task));
 
             g_main_context_invoke_full(
-                context_,
+                context,
                 G_PRIORITY_DEFAULT,
                 [](gpointer data) -> gboolean {
                     auto *t = static_cast<std::function<void()> *>(data);
@@ -29,28 +92,167 @@ namespace common {
             );
         }
 
+        //takes effect only before the first postWork; 0 threads means one per core
+        static void configureWorkers(const size_t threads, const bool pin) {
+            workerThreads_ = threads;
+            pinWorkers_ = pin;
+        }
+
+        //run some cpu heavy task off the main thread; use postTask to hand results back
+        static void postWork(std::function<void()> work, const WorkStage stage = WorkStage::GENERAL) {
+            workerPool().submit(std::move(work), stage);
+        }
+
+        //runs work on the pool, then hands its result to then on the data plane
+        template<typename Work, typename Then>
+        static void submit(const WorkStage stage, Work work, Then then) {
+            postWork([work = std::move(work), then = std::move(then)]() mutable {
+                if constexpr (std::is_void_v<std::invoke_result_t<Work &> >) {
+                    work();
+                    postTask([then = std::move(then)]() mutable { then(); });
+                } else {
+                    auto result = work();
+                    postTask([then = std::move(then), result = std::move(result)]() mutable {
+                        then(std::move(result));
+                    });
+                }
+            }, stage);
+        }
+
+        static std::array<WorkStageStats, static_cast<size_t>(WorkStage::COUNT)> workerStats() {
+            if (!workerPool_) return {};
+            return workerPool_->stats();
+        }
+
         static GMainContext *getContext() {
+            std::call_once(contextOnce_, [] {
+                context_ = g_main_context_new();
+                tasks_.attach(context_);
+            });
             return context_;
         }
 
+        //creates count - 1 extra loops; their threads start with runMainLoop so sources can be attached first
+        static void addDataPlaneLoops(const size_t count) {
+            while (extraLoops_.size() + 1 < count) {
+                auto loop = std::make_unique<EventLoop>();
+                loop->context = g_main_context_new();
+                loop->loop = g_main_loop_new(loop->context, FALSE);
+                loop->tasks.attach(loop->context);
+                extraLoops_.push_back(std::move(loop));
+            }
+        }
+
+        static size_t dataPlaneLoopCount() {
+            return 1 + extraLoops_.size();
+        }
+
+        static GMainContext *getContext(const size_t loop) {
+            return loop == 0 || loop > extraLoops_.size() ? getContext() : extraLoops_[loop - 1]->context;
+        }
+
+        //g_timeout_add / g_idle_add would land on the global default context, which nobody iterates
+        static guint addTimeout(const guint intervalMs, GSourceFunc func, gpointer data,
+                                const gint priority = G_PRIORITY_DEFAULT, GMainContext *context = nullptr) {
+            GSource *source = g_timeout_source_new(intervalMs);
+            g_source_set_priority(source, priority);
+            g_source_set_callback(source, func, data, nullptr);
+            const guint id = g_source_attach(source, context ? context : getContext());
+            g_source_unref(source);
+            return id;
+        }
+
+        static guint addIdle(GSourceFunc func, gpointer data, const gint priority = G_PRIORITY_DEFAULT,
+                             GMainContext *context = nullptr) {
+            GSource *source = g_idle_source_new();
+            g_source_set_priority(source, priority);
+            g_source_set_callback(source, func, data, nullptr);
+            const guint id = g_source_attach(source, context ? context : getContext());
+            g_source_unref(source);
+            return id;
+        }
+
+        //called once a second on the control plane thread; must only read atomics and thread safe state
+        static void setProgressReporter(std::function<void()> reporter) {
+            std::lock_guard lock(controlMutex_);
+            progressReporter_ = std::move(reporter);
+        }
+
         static GMainLoop *getMainLoop() {
             return mainLoop_;
         }
 
         static void terminate() {
-            if (!terminating_.load()) {
-                terminating_.store(true);
-                g_main_loop_quit(mainLoop_);
+            if (!terminating_.exchange(true)) {
+                if (mainLoop_) g_main_loop_quit(mainLoop_);
+                for (const auto &loop: extraLoops_) g_main_loop_quit(loop->loop);
+                controlWake_.notify_all();
             }
         }
 
+        static bool isTerminating() {
+            return terminating_.load();
+        }
+
         static void runMainLoop() {
-            context_ = g_main_context_default();
-            mainLoop_ = g_main_loop_new(context_, FALSE);
-            g_main_loop_run(mainLoop_);
-            g_main_loop_quit(mainLoop_);
+            mainLoop_ = g_main_loop_new(getContext(), FALSE);
+            dataPlane_ = std::thread([] {
+                g_main_context_push_thread_default(context_);
+                //a terminate() that raced the loop start would otherwise be lost
+                if (!terminating_.load()) g_main_loop_run(mainLoop_);
+                g_main_context_pop_thread_default(context_);
+                terminate();
+            });
+            for (const auto &loop: extraLoops_) {
+                loop->thread = std::thread([l = loop.get()] {
+                    g_main_context_push_thread_default(l->context);
+                    if (!terminating_.load()) g_main_loop_run(l->loop);
+                    g_main_context_pop_thread_default(l->context);
+                });
+            }
+
+            {
+                std::unique_lock lock(controlMutex_);
+                while (!terminating_.load()) {
+                    controlWake_.wait_for(lock, PROGRESS_INTERVAL, [] { return terminating_.load(); });
+                    if (terminating_.load()) break;
+                    if (progressReporter_) progressReporter_();
+                }
+            }
+
+            //quit from inside the loop so it cannot be missed between iterations
+            g_main_context_invoke(context_, [](gpointer) -> gboolean {
+                g_main_loop_quit(mainLoop_);
+                return G_SOURCE_REMOVE;
+            }, nullptr);
+            dataPlane_.join();
+            for (const auto &loop: extraLoops_) {
+                g_main_context_invoke(loop->context, [](gpointer data) -> gboolean {
+                    g_main_loop_quit(static_cast<GMainLoop *>(data));
+                    return G_SOURCE_REMOVE;
+                }, loop->loop);
+                loop->thread.join();
+            }
+            //a last report once nothing publishes any more, so bars that closed since the previous one are drawn
+            {
+                std::lock_guard lock(controlMutex_);
+                if (progressReporter_) progressReporter_();
+            }
             g_main_loop_unref(mainLoop_);
-            g_main_context_unref(context_);
+            mainLoop_ = nullptr;
+        }
+
+        static void joinWorkers() {
+            if (workerPool_) {
+                const auto stats = workerPool_->stats();
+                for (size_t i = 0; i < stats.size(); ++i) {
+                    if (stats[i].completed == 0 && stats[i].queued == 0) continue;
+                    spdlog::debug("worker stage {}: {} done, {} queued, peak depth {}, avg wait {:.2f} ms",
+                                  WORK_STAGE_NAMES[i], stats[i].completed, stats[i].queued, stats[i].maxQueued,
+                                  stats[i].avgWaitMs);
+                }
+                workerPool_->stop();
+            }
         }
     };
 }
@@ -0,0 +1,216 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <nlohmann/json.hpp>
+#include <spdlog/spdlog.h>
+
+namespace common {
+    //log2 buckets of microseconds: bucket i counts samples below 2^i us, the last one everything slower
+    class LatencyHistogram {
+        inline static constexpr size_t BUCKETS = 24;
+        std::array<std::atomic<uint64_t>, BUCKETS> buckets_{};
+        std::atomic<uint64_t> count_{0};
+        std::atomic<uint64_t> totalUs_{0};
+        std::atomic<uint64_t> maxUs_{0};
+
+    public:
+        void record(const std::chrono::nanoseconds elapsed) {
+            const uint64_t us = static_cast<uint64_t>(std::max<int64_t>(elapsed.count(), 0)) / 1000;
+            size_t bucket = 0;
+            while (bucket + 1 < BUCKETS && us >= (uint64_t{1} << bucket)) ++bucket;
+            buckets_[bucket].fetch_add(1, std::memory_order_relaxed);
+            count_.fetch_add(1, std::memory_order_relaxed);
+            totalUs_.fetch_add(us, std::memory_order_relaxed);
+            uint64_t seen = maxUs_.load(std::memory_order_relaxed);
+            while (us > seen && !maxUs_.compare_exchange_weak(seen, us, std::memory_order_relaxed)) {
+            }
+        }
+
+        uint64_t count() const {
+            return count_.load(std::memory_order_relaxed);
+        }
+
+        uint64_t totalUs() const {
+            return totalUs_.load(std::memory_order_relaxed);
+        }
+
+        //upper bound of the bucket holding the q-th sample, so it never understates a tail
+        uint64_t percentileUs(const double q) const {
+            const uint64_t total = count();
+            if (total == 0) return 0;
+            const auto rank = static_cast<uint64_t>(q * static_cast<double>(total - 1)) + 1;
+            uint64_t seen = 0;
+            for (size_t i = 0; i < BUCKETS; ++i) {
+                seen += buckets_[i].load(std::memory_order_relaxed);
+                if (seen >= rank) return std::min(uint64_t{1} << i, maxUs_.load(std::memory_order_relaxed));
+            }
+            return maxUs_.load(std::memory_order_relaxed);
+        }
+
+        nlohmann::json toJson() const {
+            const uint64_t n = count();
+            return {
+                {"count", n},
+                {"mean_us", n == 0 ? 0 : totalUs_.load(std::memory_order_relaxed) / n},
+                {"p50_us", percentileUs(0.50)},
+                {"p90_us", percentileUs(0.90)},
+                {"p99_us", percentileUs(0.99)},
+                {"max_us", maxUs_.load(std::memory_order_relaxed)}
+            };
+        }
+    };
+
+    class ScopedLatency {
+        LatencyHistogram &histogram_;
+        const std::chrono::steady_clock::time_point start_ = std::chrono::steady_clock::now();
+
+    public:
+        explicit ScopedLatency(LatencyHistogram &histogram) : histogram_(histogram) {
+        }
+
+        ScopedLatency(const ScopedLatency &) = delete;
+
+        ScopedLatency &operator=(const ScopedLatency &) = delete;
+
+        ~ScopedLatency() {
+            histogram_.record(std::chrono::steady_clock::now() - start_);
+        }
+    };
+
+    //lsquic's view of the path as of the last sample; only touched on the shard that owns the connection
+    struct PathSample {
+        uint64_t cwnd = 0;
+        uint64_t bytesInFlight = 0;
+        uint64_t pacingRate = 0;
+        uint64_t bwEstimate = 0;
+        uint32_t rttUs = 0;
+        uint32_t rttVarUs = 0;
+        uint32_t minRttUs = 0;
+        uint64_t pktsSent = 0;
+        uint64_t pktsLost = 0;
+        uint64_t pktsRetx = 0;
+    };
+
+    //what slowed a connection down: the path (sampled from lsquic), flow control, or the disk
+    struct ConnectionStats {
+        std::string peer;
+        //on_write could send but the buffer was empty, so it waited on a synchronous disk read
+        std::atomic<uint64_t> bufferStallNs{0};
+        //lsquic_stream_write took nothing (stream/connection credit or send buffer full) until writable again
+        std::atomic<uint64_t> creditStallNs{0};
+        std::chrono::steady_clock::time_point creditBlockedSince{};
+        LatencyHistogram diskRead;
+        LatencyHistogram diskWrite;
+        PathSample path;
+        uint64_t rttSumUs = 0;
+        uint64_t rttSamples = 0;
+        //receive window the measured bandwidth-delay product calls for; receiver only
+        uint64_t windowTarget = 0;
+
+        void bufferStalled(const std::chrono::nanoseconds waited) {
+            bufferStallNs.fetch_add(static_cast<uint64_t>(waited.count()), std::memory_order_relaxed);
+        }
+
+        void creditBlocked() {
+            if (creditBlockedSince.time_since_epoch().count() == 0) {
+                creditBlockedSince = std::chrono::steady_clock::now();
+            }
+        }
+
+        void creditResumed() {
+            if (creditBlockedSince.time_since_epoch().count() == 0) return;
+            const auto waited = std::chrono::steady_clock::now() - creditBlockedSince;
+            creditStallNs.fetch_add(
+                static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(waited).count()),
+                std::memory_order_relaxed);
+            creditBlockedSince = {};
+        }
+
+        void observe(const PathSample &sample) {
+            path = sample;
+            if (sample.rttUs > 0) {
+                rttSumUs += sample.rttUs;
+                ++rttSamples;
+            }
+        }
+
+        double lossPercent() const {
+            return path.pktsSent == 0
+                       ? 0.0
+                       : 100.0 * static_cast<double>(path.pktsLost) / static_cast<double>(path.pktsSent);
+        }
+
+        nlohmann::json toJson() const {
+            return {
+                {"peer", peer},
+                {"cwnd", path.cwnd},
+                {"bytes_in_flight", path.bytesInFlight},
+                {"pacing_rate", path.pacingRate},
+                {"bw_estimate", path.bwEstimate},
+                {"rtt_us", path.rttUs},
+                {"rttvar_us", path.rttVarUs},
+                {"min_rtt_us", path.minRttUs},
+                {"avg_rtt_us", rttSamples == 0 ? 0 : rttSumUs / rttSamples},
+                {"pkts_sent", path.pktsSent},
+                {"pkts_lost", path.pktsLost},
+                {"pkts_retx", path.pktsRetx},
+                {"loss_pct", lossPercent()},
+                {"window_target", windowTarget},
+                {"buffer_stall_ms", bufferStallNs.load(std::memory_order_relaxed) / 1000000},
+                {"credit_stall_ms", creditStallNs.load(std::memory_order_relaxed) / 1000000},
+                {"disk_read", diskRead.toJson()},
+                {"disk_write", diskWrite.toJson()}
+            };
+        }
+    };
+
+    //where stats lines go: one JSON object per line, written from any shard
+    class StatsSink {
+        inline static std::mutex mutex_;
+        inline static FILE *out_ = nullptr;
+        inline static bool ownsFile_ = false;
+
+    public:
+        //empty path leaves stats off; "-" writes to stderr so the progress bars on stdout stay intact
+        static bool open(const std::string &path) {
+            if (path.empty()) return true;
+            std::lock_guard lock(mutex_);
+            if (path == "-") {
+                out_ = stderr;
+                return true;
+            }
+            out_ = std::fopen(path.c_str(), "a");
+            if (!out_) {
+                spdlog::error("Could not open stats output {}", path);
+                return false;
+            }
+            ownsFile_ = true;
+            return true;
+        }
+
+        static bool enabled() {
+            return out_ != nullptr;
+        }
+
+        static void write(const nlohmann::json &line) {
+            std::lock_guard lock(mutex_);
+            if (!out_) return;
+            const std::string text = line.dump() + "\n";
+            std::fwrite(text.data(), 1, text.size(), out_);
+            std::fflush(out_);
+        }
+
+        static void close() {
+            std::lock_guard lock(mutex_);
+            if (out_ && ownsFile_) std::fclose(out_);
+            out_ = nullptr;
+            ownsFile_ = false;
+        }
+    };
+}
@@ -6,6 +6,8 @@
 
 #include <indicators/progress_bar.hpp>
 #include <chrono>
+#include <cstdlib>
+#include <filesystem>
 #include <mutex>
 #include <glib.h>
 #include <openssl/base64.h>
@@ -91,15 +93,6 @@ namespace common {
                               nullptr);
         }
 
-        static uint64_t fnv1a64(const uint8_t *data, const size_t len) {
-            uint64_t hash = 1469598103934665603ull;
-            for (size_t i = 0; i < len; ++i) {
-                hash ^= data[i];
-                hash *= 1099511628211ull;
-            }
-            return hash;
-        }
-
         static size_t ceilDiv(uint64_t a, uint64_t b) { return (a + b - 1) / b; }
 
         static bool getBit(const std::vector<uint8_t> &bm, uint64_t idx) {
@@ -199,6 +192,23 @@ namespace common {
         }
 
 
+        //where thruflux keeps per-user state across runs; empty if the environment names no home
+        static std::filesystem::path stateDirectory() {
+#ifdef _WIN32
+            if (const char *local = std::getenv("LOCALAPPDATA"); local && *local) {
+                return std::filesystem::path(local) / "thruflux";
+            }
+#else
+            if (const char *state = std::getenv("XDG_STATE_HOME"); state && *state) {
+                return std::filesystem::path(state) / "thruflux";
+            }
+            if (const char *home = std::getenv("HOME"); home && *home) {
+                return std::filesystem::path(home) / ".local" / "state" / "thruflux";
+            }
+#endif
+            return {};
+        }
+
         static std::string generateNanoId(size_t length = 21) {
             static constexpr char alphabet[] = "_-0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ";
             static std::mt19937 rng{std::random_device{}()};
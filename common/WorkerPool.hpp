@@ -0,0 +1,209 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#elif defined(_WIN32)
+#include <windows.h>
+#endif
+
+namespace common {
+    //what a job is for; only used to keep queue metrics apart
+    enum class WorkStage : uint8_t { GENERAL, MANIFEST, HASH, VERIFY, IO, COUNT };
+
+    inline constexpr const char *WORK_STAGE_NAMES[] = {"general", "manifest", "hash", "verify", "io"};
+
+    struct WorkStageStats {
+        uint64_t queued = 0;
+        uint64_t running = 0;
+        uint64_t completed = 0;
+        uint64_t maxQueued = 0;
+        double avgWaitMs = 0.0;
+    };
+
+    //fixed set of workers, each with its own deque. a worker pops its own newest job first (cache warm)
+    //and steals the oldest job of a sibling when it runs dry; outside submitters spread jobs round robin
+    class WorkerPool {
+        struct Job {
+            std::function<void()> fn;
+            WorkStage stage = WorkStage::GENERAL;
+            std::chrono::steady_clock::time_point enqueued;
+        };
+
+        struct alignas(64) Worker {
+            std::mutex mutex;
+            std::deque<Job> jobs;
+            std::thread thread;
+        };
+
+        struct alignas(64) StageCounters {
+            std::atomic<uint64_t> queued{0};
+            std::atomic<uint64_t> running{0};
+            std::atomic<uint64_t> completed{0};
+            std::atomic<uint64_t> maxQueued{0};
+            std::atomic<uint64_t> waitNs{0};
+        };
+
+        std::vector<std::unique_ptr<Worker> > workers_;
+        std::array<StageCounters, static_cast<size_t>(WorkStage::COUNT)> stages_;
+        std::atomic<size_t> pending_{0};
+        std::atomic<size_t> nextWorker_{0};
+        std::atomic<bool> stopping_{false};
+        std::mutex sleepMutex_;
+        std::condition_variable wake_;
+
+        inline static thread_local WorkerPool *currentPool_ = nullptr;
+        inline static thread_local size_t currentIndex_ = 0;
+
+    public:
+        explicit WorkerPool(size_t threads, const bool pin = false) {
+            threads = std::max<size_t>(threads, 2);
+            for (size_t i = 0; i < threads; ++i) workers_.push_back(std::make_unique<Worker>());
+            const unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+            for (size_t i = 0; i < threads; ++i) {
+                workers_[i]->thread = std::thread([this, i] { run(i); });
+                if (pin) pinToCore(workers_[i]->thread, i % cores);
+            }
+        }
+
+        WorkerPool(const WorkerPool &) = delete;
+
+        WorkerPool &operator=(const WorkerPool &) = delete;
+
+        ~WorkerPool() {
+            stop();
+        }
+
+        size_t size() const {
+            return workers_.size();
+        }
+
+        void submit(std::function<void()> fn, const WorkStage stage = WorkStage::GENERAL) {
+            const size_t target = currentPool_ == this
+                                      ? currentIndex_
+                                      : nextWorker_.fetch_add(1, std::memory_order_relaxed) % workers_.size();
+            auto &counters = stages_[static_cast<size_t>(stage)];
+            const uint64_t depth = counters.queued.fetch_add(1, std::memory_order_relaxed) + 1;
+            uint64_t seen = counters.maxQueued.load(std::memory_order_relaxed);
+            while (depth > seen && !counters.maxQueued.compare_exchange_weak(seen, depth, std::memory_order_relaxed)) {
+            }
+            //counted before the job is visible, so a worker that takes it right away never drives pending_ below 0
+            pending_.fetch_add(1, std::memory_order_release);
+            {
+                std::lock_guard lock(workers_[target]->mutex);
+                workers_[target]->jobs.push_back({std::move(fn), stage, std::chrono::steady_clock::now()});
+            }
+            {
+                std::lock_guard lock(sleepMutex_);
+            }
+            wake_.notify_one();
+        }
+
+        //queued jobs are dropped; running ones finish first
+        void stop() {
+            if (stopping_.exchange(true)) return;
+            {
+                std::lock_guard lock(sleepMutex_);
+            }
+            wake_.notify_all();
+            for (const auto &w: workers_) {
+                if (w->thread.joinable()) w->thread.join();
+            }
+        }
+
+        std::array<WorkStageStats, static_cast<size_t>(WorkStage::COUNT)> stats() const {
+            std::array<WorkStageStats, static_cast<size_t>(WorkStage::COUNT)> out{};
+            for (size_t i = 0; i < out.size(); ++i) {
+                const auto &c = stages_[i];
+                out[i].queued = c.queued.load(std::memory_order_relaxed);
+                out[i].running = c.running.load(std::memory_order_relaxed);
+                out[i].completed = c.completed.load(std::memory_order_relaxed);
+                out[i].maxQueued = c.maxQueued.load(std::memory_order_relaxed);
+                const uint64_t started = out[i].completed + out[i].running;
+                out[i].avgWaitMs = started == 0
+                                       ? 0.0
+                                       : static_cast<double>(c.waitNs.load(std::memory_order_relaxed)) / 1e6 /
+                                         static_cast<double>(started);
+            }
+            return out;
+        }
+
+    private:
+        bool take(const size_t self, Job &out) {
+            {
+                Worker &own = *workers_[self];
+                std::lock_guard lock(own.mutex);
+                if (!own.jobs.empty()) {
+                    out = std::move(own.jobs.back());
+                    own.jobs.pop_back();
+                    return true;
+                }
+            }
+            for (size_t i = 1; i < workers_.size(); ++i) {
+                Worker &victim = *workers_[(self + i) % workers_.size()];
+                std::lock_guard lock(victim.mutex);
+                if (!victim.jobs.empty()) {
+                    out = std::move(victim.jobs.front());
+                    victim.jobs.pop_front();
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        void run(const size_t index) {
+            currentPool_ = this;
+            currentIndex_ = index;
+            while (!stopping_.load(std::memory_order_acquire)) {
+                Job job;
+                if (!take(index, job)) {
+                    std::unique_lock lock(sleepMutex_);
+                    wake_.wait(lock, [this] {
+                        return stopping_.load(std::memory_order_acquire) ||
+                               pending_.load(std::memory_order_acquire) > 0;
+                    });
+                    continue;
+                }
+                pending_.fetch_sub(1, std::memory_order_acq_rel);
+
+                auto &counters = stages_[static_cast<size_t>(job.stage)];
+                const auto waited = std::chrono::steady_clock::now() - job.enqueued;
+                counters.waitNs.fetch_add(
+                    static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(waited).count()),
+                    std::memory_order_relaxed);
+                counters.queued.fetch_sub(1, std::memory_order_relaxed);
+                counters.running.fetch_add(1, std::memory_order_relaxed);
+                job.fn();
+                counters.running.fetch_sub(1, std::memory_order_relaxed);
+                counters.completed.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+
+        static void pinToCore(std::thread &thread, const size_t core) {
+#if defined(__linux__)
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(core, &set);
+            (void) pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set);
+#elif defined(_WIN32)
+            (void) SetThreadAffinityMask(thread.native_handle(), DWORD_PTR{1} << core);
+#else
+            //macOS has no hard affinity; the scheduler keeps the thread where it is anyway
+            (void) thread;
+            (void) core;
+#endif
+        }
+    };
+}
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <algorithm>
 #include <CLI/App.hpp>
 #include <CLI/Validators.hpp>
 #include <spdlog/spdlog.h>
@@ -18,8 +19,31 @@ namespace receiver {
 
         inline static std::int64_t quicConnWindowBytes = 256LL * 1024 * 1024;
         inline static std::int64_t quicStreamWindowBytes = 32LL * 1024 * 1024;
+        inline static bool autoWindow = true;
+        inline static std::int64_t windowBudgetBytes = 1LL * 1024 * 1024 * 1024;
+        //either window flag given on the command line: auto tuning starts from it instead of its own default
+        inline static bool explicitWindows = false;
 
         inline static bool overwrite = false;
+        inline static bool directIo = false;
+        inline static int workerThreads = 0;
+        inline static bool pinWorkers = false;
+        //JSON lines of connection stats; empty = off, "-" = stderr
+        inline static std::string statsJson;
+        inline static std::string congestionControl = "bbr";
+        inline static bool pmtud = true;
+        inline static int basePlpmtu = 0;
+        inline static int maxPlpmtu = 0;
+        //ICE components offered to the sender; it uses as many as both sides offer
+        inline static int multipath = 1;
+        //parallel QUIC connections offered over the same route; each gets its own engine thread
+        inline static int connections = 1;
+        inline static bool cacheIdentity = true;
+
+        //ICE components gathered
+        static int components() {
+            return std::max(multipath, connections);
+        }
 
         inline static int udpBufferBytes = 8 * 1024 * 1024;
 
@@ -94,6 +118,15 @@ namespace receiver {
                     ->check(CLI::Range(256 * KiB, 2 * GiB))
                     ->capture_default_str();
 
+            app->add_flag("--auto-window,!--no-auto-window", autoWindow,
+                          "Let the QUIC receive windows grow with the measured bandwidth-delay product, up to --window-budget-bytes")
+                    ->capture_default_str();
+
+            app->add_option("--window-budget-bytes", windowBudgetBytes,
+                            "Receive memory the auto-tuned QUIC windows may grow to across all connections (bytes)")
+                    ->check(CLI::Range(16 * MiB, 64 * GiB))
+                    ->capture_default_str();
+
             app->add_flag("--overwrite", overwrite, "Overwrite existing files (disable resume)");
 
             app->add_option("--udp-buffer-bytes", udpBufferBytes,
@@ -101,14 +134,75 @@ namespace receiver {
                     ->check(CLI::Range(256 * 1024, 256 * 1024 * 1024))
                     ->capture_default_str();
 
+            app->add_flag("--direct-io", directIo,
+                          "Bypass the page cache for file data (O_DIRECT). Useful for transfers larger than RAM");
+
+            app->add_option("--worker-threads", workerThreads,
+                            "Threads for hashing, verification and file opens. 0 = one per core")
+                    ->check(CLI::Range(0, 256))
+                    ->capture_default_str();
+
+            app->add_flag("--pin-workers", pinWorkers, "Pin each worker thread to its own core");
+
+            app->add_option("--cc", congestionControl,
+                            "Congestion control for what the receiver sends: cubic, bbr, adaptive, or auto (same as adaptive here)")
+                    ->check(CLI::IsMember({"cubic", "bbr", "adaptive", "auto"}))
+                    ->capture_default_str();
+
+            app->add_flag("--pmtud,!--no-pmtud", pmtud,
+                          "Probe the path MTU (DPLPMTUD) so links with jumbo frames carry larger QUIC packets")
+                    ->capture_default_str();
+
+            app->add_option("--base-plpmtu", basePlpmtu,
+                            "QUIC packet size to start from before probing (bytes). 0 = lsquic default")
+                    ->check(CLI::Range(0, 65527))
+                    ->capture_default_str();
+
+            app->add_option("--max-plpmtu", maxPlpmtu,
+                            "Largest QUIC packet size to probe for (bytes), e.g. 8952 on a 9000 MTU link. 0 = from the local interfaces")
+                    ->check(CLI::Range(0, 65527))
+                    ->capture_default_str();
+
+            app->add_option("--multipath", multipath,
+                            "Offer up to N ICE paths (e.g. two NICs, or wired plus LTE) for the sender to stripe chunks across")
+                    ->check(CLI::Range(1, 8))
+                    ->capture_default_str();
+
+            app->add_option("--connections", connections,
+                            "Offer N parallel QUIC connections over the same route, each received on its own engine thread")
+                    ->check(CLI::Range(1, 16))
+                    ->capture_default_str();
+
+            app->add_flag("--cache-identity,!--no-cache-identity", cacheIdentity,
+                          "Keep the QUIC key and certificate in the per-user state directory instead of making new ones every run")
+                    ->capture_default_str();
+
+            app->add_option("--stats-json", statsJson,
+                            "Write RTT, cwnd, loss, flow-control stalls and disk latency once a second as JSON lines to this file (- for stderr), plus a summary per connection");
+
             app->set_version_flag("--version", "Thruflux v0.3.0");
 
-            app->parse_complete_callback([&]() {
+            app->parse_complete_callback([app]() {
+                explicitWindows = app->count("--quic-conn-window-bytes") > 0 ||
+                                  app->count("--quic-stream-window-bytes") > 0;
+
+                if ((basePlpmtu != 0 && basePlpmtu < 1200) || (maxPlpmtu != 0 && maxPlpmtu < 1200)) {
+                    throw CLI::ValidationError("--base-plpmtu/--max-plpmtu", "must be 0 or at least 1200");
+                }
+
+                if (basePlpmtu != 0 && maxPlpmtu != 0 && basePlpmtu > maxPlpmtu) {
+                    throw CLI::ValidationError("--base-plpmtu", "must be <= --max-plpmtu");
+                }
+
                 if (quicConnWindowBytes < quicStreamWindowBytes) {
                     throw CLI::ValidationError("--quic-conn-window-bytes",
                                                "must be >= --quic-stream-window-bytes");
                 }
 
+                if (multipath > 1 && connections > 1) {
+                    throw CLI::ValidationError("--connections", "cannot be combined with --multipath");
+                }
+
                 if (udpBufferBytes < 1024 * 1024) {
                     spdlog::warn("udp-buffer-bytes is < 1MiB; this may limit throughput");
                 }
@@ -1,6 +1,18 @@
 #pragma once
 #include "ReceiverConfig.hpp"
 #include "../common/Contexts.hpp"
+#include "../common/DiskIO.hpp"
+#include "../common/Fec.hpp"
+#include "../common/Integrity.hpp"
+#include "../common/Merkle.hpp"
+#include "../common/SendOrder.hpp"
+#include "../common/Stripe.hpp"
+#include "../common/ThreadManager.hpp"
+#include "StripeTracker.hpp"
+#include "WindowTuner.hpp"
+#include <deque>
+#include <map>
+#include <mutex>
 #ifdef _MSC_VER
 #include <intrin.h>
 #pragma intrinsic(__popcnt)
@@ -17,23 +29,90 @@ static int popcount32(unsigned int x) {
 namespace receiver {
     inline static constexpr size_t STAGE_LIMIT = 16 * 1024 * 1024;
     inline static constexpr size_t FLUSH_AT = 8 * 1024 * 1024;
+    //chunks hashed per worker task when re-validating a resumed prefix
+    inline static constexpr size_t PREFIX_VERIFY_BATCH = 16;
+    //how far ahead of the writer upcoming files get their extents reserved
+    inline static constexpr uint32_t PREALLOCATE_AHEAD_FILES = 32;
+    inline static constexpr uint64_t PREALLOCATE_AHEAD_BYTES = 1024ull * 1024 * 1024;
+    //written pages older than this are waited on and evicted so dirty memory stays bounded
+    inline static constexpr uint64_t WRITEBACK_WINDOW = 4 * FLUSH_AT;
+
+    struct ReceiverStreamContext;
 
     struct ReceiverConnectionContext : common::ConnectionContext {
         std::chrono::steady_clock::time_point lastResumeFlush{};
         bool resumeDirty = false;
         common::FileHandleCache cache;
         std::vector<uint8_t> manifestBuf;
-        bool manifestParsed = false;
+        size_t manifestRead = 0;
+        std::atomic<uint64_t> manifestReceived = 0;
+        enum class ManifestState { HEADER, RECORDS, SECTIONS } manifestState = ManifestState::HEADER;
+        uint32_t manifestCount = 0;
+        uint64_t totalChunks = 0;
+        std::filesystem::path lastCreatedDir;
+        uint32_t preallocatedUpTo = 0;
+        std::vector<common::ExtentMap> fileExtents;
+        common::SendOrder sendOrder;
+        //hashed as it arrives so the resume state path is ready the moment the manifest FIN lands
+        common::StreamingHash manifestHasher;
+        std::atomic<bool> manifestParsed = false;
+        //the raw manifest is kept next to the resume state, so a rejoin can be sent just its hash
+        std::ofstream manifestCacheOut;
+        std::string manifestCachePath;
+        bool manifestByReference = false;
+        std::vector<uint8_t> manifestReference;
         uint64_t totalExpectedBytes = 0;
         int totalExpectedFilesCount = 0;
         std::vector<uint64_t> fileSizes;
         bool pendingManifestAck = false;
         bool pendingCompleteAck = false;
+        //drawn by the progress reporter alone; the data plane only publishes the counters it reads
         std::unique_ptr<indicators::ProgressBar> progressBar;
-        uint32_t resumeFileId = 0;
+        //set on the data plane once the connection is gone, so the reporter draws the bar's final state
+        std::atomic<bool> closed = false;
+        //reporter only
+        bool manifestBarDone = false;
+        bool finalDrawn = false;
+        //position in send order of the first file not fully written; see common::SendOrder
+        uint32_t resumePosition = 0;
         uint64_t resumeOffset = 0;
         std::string resumeStatePath;
         int manifestAckSent = 0;
+        common::IntegrityChannel integrity;
+        //datagram (fec) path: blocks are reassembled here and fed to the data stream's context in order
+        common::FecReassembler fec;
+        lsquic_stream_t *dataStream = nullptr;
+        ReceiverStreamContext *dataCtx = nullptr;
+        WindowTuner window;
+        std::deque<common::ChunkDigest> pendingDigests;
+        std::map<std::pair<uint32_t, uint64_t>, int> chunkRetries;
+        size_t verificationsInFlight = 0;
+        //verification continuations check this, as FileHandleCache::prefetch does, so a context torn down with
+        //hashes in flight is left alone
+        std::shared_ptr<bool> alive = std::make_shared<bool>(true);
+        size_t repairsOutstanding = 0;
+        bool digestsComplete = false;
+        bool dataComplete = false;
+        common::MerkleTree merkle;
+        std::vector<uint64_t> fileChunkBase;
+        size_t prefixBatchesInFlight = 0;
+        uint32_t firstBadPosition = UINT32_MAX;
+        uint64_t firstBadOffset = 0;
+        size_t badChunks = 0;
+        //multipath: lanes are the session's extra connections and only carry stripe streams; the rest of the
+        //session state lives on the first connection, which they point at. lanes may run on other engine shards:
+        //what they touch directly is guarded by stripeMutex, everything else is posted to the session's shard
+        bool lane = false;
+        ReceiverConnectionContext *session = nullptr;
+        std::mutex stripeMutex;
+        std::atomic<bool> striped = false;
+        StripeTracker stripes;
+        std::vector<bool> preparedFiles;
+        uint32_t stripeStartPosition = 0;
+        uint64_t stripeStartOffset = 0;
+        std::atomic<size_t> stripeStreams = 0;
+        std::atomic<bool> advancePosted = false;
+        bool missingRequested = false;
 
         indicators::ProgressBar manifestProgressBar{
             indicators::option::BarWidth{0},
@@ -45,102 +124,534 @@ namespace receiver {
             indicators::option::ForegroundColor{indicators::Color::white}
         };
 
-        std::chrono::steady_clock::time_point lastManifestProgressPrint{};
-
         void createProgressBar(std::string prefix) {
             progressBar = common::Utils::createProgressBarUniquePtr(prefix);
         };
 
 
-        void parseManifest() {
-            uint8_t *p = manifestBuf.data();
-            uint32_t count;
-            memcpy(&count, p, 4);
-            cache.reset(count);
-            p += 4;
-            fileSizes.resize(count);
-
-            for (int i = 0; i < count; i++) {
-                uint32_t id;
-                memcpy(&id, p, 4);
-                p += 4;
-                uint64_t sz;
-                memcpy(&sz, p, 8);
-                fileSizes[id] = sz;
-                totalExpectedBytes += sz;
-                totalExpectedFilesCount++;
-                p += 8;
-                uint16_t l;
-                memcpy(&l, p, 2);
-                p += 2;
-                std::string relativePath(reinterpret_cast<char *>(p), l);
-                p += l;
-
-                std::filesystem::path full = std::filesystem::path(ReceiverConfig::out) / relativePath;
-                std::filesystem::create_directories(full.parent_path());
-                cache.registerPath(id, full.string());
-            }
-
-
-            const auto manifestHash = common::Utils::fnv1a64(manifestBuf.data(), manifestBuf.size());
-            auto statePath = std::filesystem::path(ReceiverConfig::out) /
-                             (".thruflux_resume_" + std::to_string(manifestHash) + ".state");
+        //consumes manifest records as they arrive; only the unparsed tail is kept in manifestBuf
+        bool feedManifest(const uint8_t *data, const size_t len) {
+            manifestReceived += len;
+            manifestBuf.insert(manifestBuf.end(), data, data + len);
+
+            while (true) {
+                const uint8_t *p = manifestBuf.data() + manifestRead;
+                const size_t avail = manifestBuf.size() - manifestRead;
+
+                if (manifestState == ManifestState::HEADER) {
+                    if (avail < 4) break;
+                    memcpy(&manifestCount, p, 4);
+                    cache.reset(manifestCount);
+                    cache.directIo = ReceiverConfig::directIo;
+                    fileSizes.assign(manifestCount, 0);
+                    fileExtents.assign(manifestCount, {});
+                    manifestRead += 4;
+                    manifestState = manifestCount > 0 ? ManifestState::RECORDS : ManifestState::SECTIONS;
+                    if (manifestState == ManifestState::SECTIONS) sealFileLayout();
+                } else if (manifestState == ManifestState::RECORDS) {
+                    if (avail < 14) break;
+                    uint32_t id;
+                    memcpy(&id, p, 4);
+                    uint64_t sz;
+                    memcpy(&sz, p + 4, 8);
+                    uint16_t l;
+                    memcpy(&l, p + 12, 2);
+                    if (avail < 14 + static_cast<size_t>(l)) break;
+                    if (id >= manifestCount) {
+                        spdlog::error("Manifest record has out of range file id {}", id);
+                        return false;
+                    }
+                    const std::string relativePath(reinterpret_cast<const char *>(p + 14), l);
+                    manifestRead += 14 + l;
+
+                    fileSizes[id] = sz;
+                    totalExpectedBytes += sz;
+                    totalExpectedFilesCount++;
+
+                    std::filesystem::path full = std::filesystem::path(ReceiverConfig::out) / relativePath;
+                    //siblings usually arrive back to back, so skip re-creating the same directory
+                    if (full.parent_path() != lastCreatedDir) {
+                        std::filesystem::create_directories(full.parent_path());
+                        lastCreatedDir = full.parent_path();
+                    }
+                    cache.registerPath(id, full.string());
+
+                    if (static_cast<uint32_t>(totalExpectedFilesCount) == manifestCount) {
+                        manifestState = ManifestState::SECTIONS;
+                        sealFileLayout();
+                    }
+                } else {
+                    if (avail < common::MANIFEST_SECTION_HEADER_SIZE) break;
+                    const uint8_t tag = *p;
+                    uint64_t sectionLen;
+                    memcpy(&sectionLen, p + 1, 8);
+                    if (avail - common::MANIFEST_SECTION_HEADER_SIZE < sectionLen) break;
+                    const uint8_t *payload = p + common::MANIFEST_SECTION_HEADER_SIZE;
+                    if (tag == common::MANIFEST_SECTION_MERKLE) {
+                        if (!merkle.decode(payload, sectionLen) || merkle.leaves.size() != totalChunks) {
+                            spdlog::warn("Manifest merkle section is corrupt; resumed data will not be verified");
+                            merkle = {};
+                        }
+                    } else if (tag == common::MANIFEST_SECTION_EXTENTS) {
+                        if (!common::Extents::decode(payload, sectionLen, fileExtents)) {
+                            spdlog::error("Manifest extents section is corrupt");
+                            return false;
+                        }
+                    } else if (tag == common::MANIFEST_SECTION_ORDER) {
+                        if (!sendOrder.decode(payload, sectionLen, manifestCount)) {
+                            spdlog::error("Manifest send order section is corrupt");
+                            return false;
+                        }
+                    }
+                    manifestRead += common::MANIFEST_SECTION_HEADER_SIZE + sectionLen;
+                }
+            }
+
+            if (manifestRead == manifestBuf.size()) {
+                manifestBuf.clear();
+                manifestRead = 0;
+            } else if (manifestRead >= manifestBuf.size() / 2) {
+                manifestBuf.erase(manifestBuf.begin(), manifestBuf.begin() + static_cast<std::ptrdiff_t>(manifestRead));
+                manifestRead = 0;
+            }
+            return true;
+        }
+
+        void sealFileLayout() {
+            fileChunkBase.resize(manifestCount);
+            totalChunks = 0;
+            for (uint32_t id = 0; id < manifestCount; ++id) {
+                fileChunkBase[id] = totalChunks;
+                totalChunks += common::Utils::ceilDiv(fileSizes[id], common::CHUNK_SIZE);
+            }
+        }
+
+        static std::filesystem::path resumeFile(const std::string &manifestHex, const char *extension) {
+            return std::filesystem::path(ReceiverConfig::out) / (".thruflux_resume_" + manifestHex + extension);
+        }
+
+        //hashes of the manifests kept by unfinished earlier runs, offered to the sender when joining
+        static std::vector<std::string> cachedManifests() {
+            std::vector<std::string> hashes;
+            if (ReceiverConfig::overwrite) return hashes;
+            std::error_code ec;
+            for (const auto &entry: std::filesystem::directory_iterator(ReceiverConfig::out, ec)) {
+                const auto name = entry.path().filename().string();
+                constexpr std::string_view prefix = ".thruflux_resume_";
+                constexpr std::string_view extension = ".manifest";
+                if (name.size() != prefix.size() + 32 + extension.size() || !name.starts_with(prefix) ||
+                    !name.ends_with(extension)) {
+                    continue;
+                }
+                auto hex = name.substr(prefix.size(), 32);
+                if (std::filesystem::exists(resumeFile(hex, ".state"), ec)) hashes.push_back(std::move(hex));
+            }
+            return hashes;
+        }
+
+        void startManifestCache() {
+            std::error_code ec;
+            std::filesystem::create_directories(ReceiverConfig::out, ec);
+            manifestCacheOut.open(std::filesystem::path(ReceiverConfig::out) / ".thruflux_manifest.tmp",
+                                  std::ios::binary | std::ios::trunc);
+        }
+
+        void cacheManifest(const uint8_t *data, const size_t len) {
+            if (manifestCacheOut.is_open()) manifestCacheOut.write(reinterpret_cast<const char *>(data), len);
+        }
+
+        //the sender only named the manifest; replay it from the copy an earlier run kept
+        bool loadCachedManifest() {
+            if (manifestReference.size() != common::DIGEST_SIZE) {
+                spdlog::error("Manifest reference is malformed");
+                return false;
+            }
+            const auto hash = common::Hash::read(manifestReference.data());
+            const auto path = resumeFile(common::Hash::toHex(hash), ".manifest");
+            std::ifstream in(path, std::ios::binary);
+            bool ok = static_cast<bool>(in);
+            std::vector<uint8_t> buf(64 * 1024);
+            while (ok) {
+                in.read(reinterpret_cast<char *>(buf.data()), static_cast<std::streamsize>(buf.size()));
+                const auto nr = static_cast<size_t>(in.gcount());
+                if (nr == 0) break;
+                manifestHasher.update(buf.data(), nr);
+                ok = feedManifest(buf.data(), nr);
+            }
+            if (!ok || manifestHasher.digest() != hash) {
+                spdlog::error("The manifest kept from an earlier run is missing or damaged; join again to fetch it");
+                std::error_code ec;
+                std::filesystem::remove(path, ec);
+                return false;
+            }
+            spdlog::info("Reusing the manifest kept from an earlier run");
+            return true;
+        }
+
+        //called once the manifest FIN arrived
+        bool finishManifest() {
+            if (manifestState != ManifestState::SECTIONS || manifestRead != manifestBuf.size()) {
+                spdlog::error("Manifest stream ended before the manifest was complete");
+                return false;
+            }
+            manifestBuf = {};
+            manifestRead = 0;
+
+            const auto manifestHex = common::Hash::toHex(manifestHasher.digest());
+            auto statePath = resumeFile(manifestHex, ".state");
             resumeStatePath = statePath.string();
+            manifestCachePath = resumeFile(manifestHex, ".manifest").string();
+            if (manifestCacheOut.is_open()) {
+                manifestCacheOut.close();
+                const auto tmp = std::filesystem::path(ReceiverConfig::out) / ".thruflux_manifest.tmp";
+                std::error_code ec;
+                if (manifestCacheOut) std::filesystem::rename(tmp, manifestCachePath, ec);
+                if (!manifestCacheOut || ec) std::filesystem::remove(tmp, ec);
+            }
 
             if (ReceiverConfig::overwrite) {
                 std::error_code ec;
                 std::filesystem::remove(statePath, ec);
-                resumeFileId = 0;
+                resumePosition = 0;
                 resumeOffset = 0;
             } else {
                 if (std::filesystem::exists(statePath)) {
-                    resumeFileId = 0;
+                    resumePosition = 0;
                     resumeOffset = 0;
                     {
                         std::ifstream in(statePath, std::ios::binary);
                         if (in) {
-                            uint32_t fid = 0;
+                            uint32_t pos = 0;
                             uint64_t off = 0;
-                            in.read(reinterpret_cast<char *>(&fid), sizeof(fid));
+                            in.read(reinterpret_cast<char *>(&pos), sizeof(pos));
                             in.read(reinterpret_cast<char *>(&off), sizeof(off));
 
-                            if (in.good() && in.gcount() == sizeof(off) && fid < fileSizes.size()) {
-                                resumeFileId = fid;
-                                resumeOffset = std::min(off, fileSizes[fid]);
+                            if (in.good() && in.gcount() == sizeof(off) && pos < fileSizes.size()) {
+                                resumePosition = pos;
+                                resumeOffset = std::min(off, fileSizes[sendOrder.idAt(pos)]);
                             }
                         }
                     }
 
-                    while (resumeFileId < fileSizes.size() && resumeOffset >= fileSizes[resumeFileId]) {
+                    while (resumePosition < fileSizes.size() &&
+                           resumeOffset >= fileSizes[sendOrder.idAt(resumePosition)]) {
                         resumeOffset = 0;
-                        resumeFileId++;
+                        resumePosition++;
                     }
 
-                    if (resumeFileId >= fileSizes.size()) {
-                        resumeFileId = fileSizes.size();
+                    if (resumePosition >= fileSizes.size()) {
+                        resumePosition = fileSizes.size();
                         resumeOffset = 0;
                     }
+                }
+            }
 
-                    uint64_t resumedBytes = 0;
-                    for (uint32_t id = 0; id < resumeFileId && id < fileSizes.size(); ++id) {
-                        resumedBytes += fileSizes[id];
-                    }
-                    resumedBytes += resumeOffset;
+            spdlog::info("Manifest unsealed: {} file(s) , Total size: {}", manifestCount,
+                         common::Utils::sizeToReadableFormat(totalExpectedBytes));
+            return true;
+        }
+
+        void applyResume() {
+            if (resumePosition == 0 && resumeOffset == 0) return;
+
+            uint64_t resumedBytes = 0;
+            for (uint32_t pos = 0; pos < resumePosition && pos < fileSizes.size(); ++pos) {
+                resumedBytes += fileSizes[sendOrder.idAt(pos)];
+            }
+            resumedBytes += resumeOffset;
+
+            bytesMoved = resumedBytes;
+            skippedBytes = resumedBytes;
+            filesMoved = resumePosition;
 
-                    bytesMoved = resumedBytes;
-                    lastBytesMoved = resumedBytes;
-                    skippedBytes = resumedBytes;
-                    filesMoved = resumeFileId;
+            const auto resumePercent = bytesMoved / static_cast<double>(totalExpectedBytes) * 100;
 
-                    const auto resumePercent = bytesMoved / static_cast<double>(totalExpectedBytes) * 100;
+            spdlog::info("Automatically resuming from around {}%. Pass --overwrite flag to disable.",
+                         resumePercent);
+        }
+
+        void ackManifest() {
+            applyResume();
+            pendingManifestAck = true;
+            if (manifestStream) lsquic_stream_wantwrite(manifestStream, 1);
+        }
+
+        //with chunk digests in the manifest, the resumed prefix is re-hashed locally instead of trusted blindly
+        void validateResume() {
+            if (merkle.leaves.empty() || (resumePosition == 0 && resumeOffset == 0)) {
+                ackManifest();
+                return;
+            }
 
-                    spdlog::info("Automatically resuming from around {}%. Pass --overwrite flag to disable.",
-                                 resumePercent);
+            //a partially written chunk cannot be checked against its leaf, so it is simply received again
+            resumeOffset -= resumeOffset % common::CHUNK_SIZE;
+
+            struct Job {
+                uint32_t position;
+                uint32_t fileId;
+                uint64_t offset;
+                uint32_t len;
+                uint64_t leaf;
+            };
+            std::vector<Job> batch;
+            batch.reserve(PREFIX_VERIFY_BATCH);
+
+            const auto submit = [this, &batch]() {
+                if (batch.empty()) return;
+                ++prefixBatchesInFlight;
+                common::ThreadManager::submit(common::WorkStage::VERIFY,
+                    [this, jobs = batch]() {
+                        std::vector<bool> ok(jobs.size());
+                        for (size_t i = 0; i < jobs.size(); ++i) {
+                            const auto actual = common::Integrity::digestFileRange(cache, jobs[i].fileId, true,
+                                                                                   jobs[i].offset, jobs[i].len);
+                            ok[i] = actual.has_value() && actual.value() == merkle.leaves[jobs[i].leaf];
+                        }
+                        return ok;
+                    },
+                    [this, jobs = batch, token = std::weak_ptr<bool>(alive)](std::vector<bool> ok) {
+                        if (token.expired()) return;
+                        for (size_t i = 0; i < jobs.size(); ++i) {
+                            if (ok[i]) continue;
+                            ++badChunks;
+                            if (jobs[i].position < firstBadPosition ||
+                                (jobs[i].position == firstBadPosition && jobs[i].offset < firstBadOffset)) {
+                                firstBadPosition = jobs[i].position;
+                                firstBadOffset = jobs[i].offset;
+                            }
+                        }
+                        onPrefixBatchVerified();
+                    });
+                batch = {};
+                batch.reserve(PREFIX_VERIFY_BATCH);
+            };
+
+            const uint32_t lastPosition = std::min<uint32_t>(resumePosition, fileSizes.size() - 1);
+            for (uint32_t pos = 0; pos <= lastPosition; ++pos) {
+                const uint32_t id = sendOrder.idAt(pos);
+                const uint64_t limit = pos < resumePosition ? fileSizes[id] : resumeOffset;
+                uint64_t leaf = fileChunkBase[id];
+                for (uint64_t off = 0; off < limit; off += common::CHUNK_SIZE, ++leaf) {
+                    batch.push_back({
+                        pos, id, off, static_cast<uint32_t>(std::min<uint64_t>(common::CHUNK_SIZE, fileSizes[id] - off)),
+                        leaf
+                    });
+                    if (batch.size() == PREFIX_VERIFY_BATCH) submit();
                 }
             }
+            submit();
 
-            spdlog::info("Manifest unsealed: {} file(s) , Total size: {}", count,
-                         common::Utils::sizeToReadableFormat(totalExpectedBytes));
+            if (prefixBatchesInFlight == 0) {
+                ackManifest();
+                return;
+            }
+            spdlog::info("Verifying previously received data against the manifest chunk digests...");
+        }
+
+        void onPrefixBatchVerified() {
+            if (--prefixBatchesInFlight > 0 || !connection) return;
+
+            if (badChunks > 0) {
+                spdlog::warn("{} previously received chunk(s) failed verification; resuming from {} at offset {}",
+                             badChunks, cache.paths[sendOrder.idAt(firstBadPosition)], firstBadOffset);
+                resumePosition = firstBadPosition;
+                resumeOffset = firstBadOffset;
+                resumeDirty = true;
+            }
+            ackManifest();
+        }
+
+        //reserves extents for the file being opened, and on the worker pool for the next few after it
+        void preallocate(const uint32_t position, llfio::file_handle &fh) {
+            const uint32_t fileId = sendOrder.idAt(position);
+            if (position >= preallocatedUpTo) {
+                //sparse files get their holes recreated on open instead
+                if (fileExtents[fileId].empty() && !common::DiskIO::preallocate(fh, fileSizes[fileId])) {
+                    spdlog::warn("Failed to preallocate {}: {}", cache.paths[fileId], strerror(errno));
+                }
+                preallocatedUpTo = position + 1;
+            }
+
+            //upcoming files are created, opened and reserved on the worker pool; the handles land in the cache
+            uint64_t scheduledBytes = 0;
+            while (preallocatedUpTo < fileSizes.size() &&
+                   preallocatedUpTo <= position + PREALLOCATE_AHEAD_FILES &&
+                   scheduledBytes < PREALLOCATE_AHEAD_BYTES) {
+                const uint32_t id = sendOrder.idAt(preallocatedUpTo);
+                const bool dense = fileSizes[id] > 0 && fileExtents[id].empty();
+                std::function<void(llfio::file_handle &)> prepare;
+                if (dense) {
+                    prepare = [size = fileSizes[id]](llfio::file_handle &fh) {
+                        if (!common::DiskIO::preallocate(fh, size)) {
+                            spdlog::warn("Failed to preallocate ahead: {}", strerror(errno));
+                        }
+                    };
+                }
+                //over the descriptor budget: the rest get reserved synchronously when reached
+                if (!cache.prefetch(id, true, std::move(prepare))) break;
+                ++preallocatedUpTo;
+                if (dense) scheduledBytes += fileSizes[id];
+            }
+        }
+
+        bool isWritten(const common::ChunkDigest &c) const {
+            if (c.fileId >= fileSizes.size()) return false;
+            const uint32_t pos = sendOrder.positionOf(c.fileId);
+            return pos < resumePosition || (pos == resumePosition && c.offset + c.len <= resumeOffset);
+        }
+
+        //hands every digest whose range already hit the disk to the worker pool
+        void dispatchVerifications() {
+            while (!pendingDigests.empty() && isWritten(pendingDigests.front())) {
+                verify(pendingDigests.front());
+                pendingDigests.pop_front();
+            }
+        }
+
+        void verify(const common::ChunkDigest &c) {
+            if (c.fileId >= cache.paths.size()) return;
+            ++verificationsInFlight;
+            //the cache outlives the pool: workers are joined before any context is disposed
+            common::ThreadManager::submit(common::WorkStage::VERIFY, [this, c]() {
+                const auto actual = common::Integrity::digestFileRange(cache, c.fileId, true, c.offset, c.len);
+                return actual.has_value() && actual.value() == c.digest;
+            }, [this, c, token = std::weak_ptr<bool>(alive)](const bool ok) {
+                if (token.expired()) return;
+                onVerified(c, ok);
+            });
+        }
+
+        void onVerified(const common::ChunkDigest &c, const bool ok) {
+            --verificationsInFlight;
+            if (!connection) return;
+
+            const auto key = std::make_pair(c.fileId, c.offset);
+            if (ok) {
+                chunkRetries.erase(key);
+                maybeFinish();
+                return;
+            }
+
+            const int attempts = ++chunkRetries[key];
+            if (attempts > common::INTEGRITY_MAX_RETRIES) {
+                spdlog::error("Chunk of {} at offset {} failed verification {} times, giving up",
+                              cache.paths[c.fileId], c.offset, attempts - 1);
+                lsquic_conn_close(connection);
+                return;
+            }
+
+            spdlog::warn("Chunk of {} at offset {} failed verification, requesting it again",
+                         cache.paths[c.fileId], c.offset);
+            ++repairsOutstanding;
+            integrity.queue(common::INTEGRITY_CHUNK_RETRY, c);
+        }
+
+        void onRepair(const common::ChunkDigest &c, const std::vector<uint8_t> &payload) {
+            if (repairsOutstanding > 0) --repairsOutstanding;
+            if (c.fileId >= cache.paths.size()) return;
+
+            bool written = cache.acquire(c.fileId, true) != nullptr;
+            if (written) {
+                auto *fh = cache.buffered(c.fileId, true);
+                written = fh && common::DiskIO::writeBuffered(*fh, c.offset, payload.data(), payload.size());
+                cache.release(c.fileId);
+            }
+            if (!written) {
+                spdlog::error("Failed to write repaired chunk of {} at offset {}", cache.paths[c.fileId], c.offset);
+                return;
+            }
+
+            verify(c);
+            //a chunk lost with a path may be what the prefix was waiting on
+            if (striped) {
+                onStripeWritten(sendOrder.positionOf(c.fileId), c.offset, c.offset + payload.size());
+                advanceStripes();
+            }
+        }
+
+        ReceiverConnectionContext *owner() {
+            return lane ? session : this;
+        }
+
+        //multipath: the first stripe stream fixes where striping starts; everything before it is already whole.
+        //safe from any shard; the prefix is moved by advanceStripes on the session's own
+        void beginStripes() {
+            std::lock_guard lock(stripeMutex);
+            if (striped) return;
+            stripes.begin(fileSizes, fileExtents, sendOrder);
+            preparedFiles.assign(fileSizes.size(), false);
+            stripeStartPosition = resumePosition;
+            stripeStartOffset = resumeOffset;
+            striped = true;
+        }
+
+        //sizes and reserves a file, or recreates its holes, the first time any lane writes into it
+        void prepareStriped(const uint32_t position, llfio::file_handle &fh) {
+            std::lock_guard lock(stripeMutex);
+            if (position >= preparedFiles.size() || preparedFiles[position]) return;
+            preparedFiles[position] = true;
+            preallocate(position, fh);
+            const uint32_t fileId = sendOrder.idAt(position);
+            const uint64_t from = position == stripeStartPosition ? stripeStartOffset : 0;
+            if (!fileExtents[fileId].empty() &&
+                !common::DiskIO::recreateHoles(fh, fileExtents[fileId], fileSizes[fileId], from)) {
+                spdlog::warn("Failed to recreate holes of {}", cache.paths[fileId]);
+            }
+        }
+
+        //safe from any shard; advanceStripes takes it into the prefix
+        void onStripeWritten(const uint32_t position, const uint64_t from, const uint64_t to) {
+            std::lock_guard lock(stripeMutex);
+            stripes.add(position, from, to);
+        }
+
+        //session's shard only
+        void advanceStripes() {
+            const uint32_t position = resumePosition;
+            const uint64_t offset = resumeOffset;
+            {
+                std::lock_guard lock(stripeMutex);
+                //holes count as moved once the prefix passes them, like the ordered stream counts them when skipped
+                bytesMoved += stripes.advance(resumePosition, resumeOffset);
+            }
+            if (resumePosition != position || resumeOffset != offset) {
+                filesMoved = static_cast<int>(resumePosition);
+                resumeDirty = true;
+                dispatchVerifications();
+            }
+            if (!dataComplete && resumePosition >= fileSizes.size()) {
+                dataComplete = true;
+                maybeFinish();
+            }
+        }
+
+        //multipath: every stripe stream ended but the prefix is not through; what a lost path carried is asked
+        //for again on the integrity stream
+        void requestMissingStripes() {
+            if (!striped || dataComplete || missingRequested || !connection) return;
+            missingRequested = true;
+            std::vector<common::ChunkDigest> chunks;
+            {
+                std::lock_guard lock(stripeMutex);
+                chunks = stripes.missing(resumePosition, resumeOffset);
+            }
+            if (chunks.empty()) return;
+            spdlog::warn("{} chunk(s) were lost with a path, requesting them again", chunks.size());
+            for (const auto &c: chunks) {
+                ++repairsOutstanding;
+                integrity.queue(common::INTEGRITY_CHUNK_RETRY, c);
+            }
+        }
+
+        //the transfer is only complete once every chunk digest has been checked against the disk
+        void maybeFinish() {
+            if (complete || !connection || !manifestStream) return;
+            if (!dataComplete || !digestsComplete) return;
+            if (!pendingDigests.empty() || verificationsInFlight > 0 || repairsOutstanding > 0) return;
+
+            complete = true;
+            pendingCompleteAck = true;
+            lsquic_stream_wantwrite(manifestStream, 1);
         }
 
         void maybeSaveResumeState(bool force = false) {
@@ -158,7 +669,7 @@ namespace receiver {
             std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
             if (!out) return;
 
-            out.write(reinterpret_cast<const char *>(&resumeFileId), sizeof(resumeFileId));
+            out.write(reinterpret_cast<const char *>(&resumePosition), sizeof(resumePosition));
             out.write(reinterpret_cast<const char *>(&resumeOffset), sizeof(resumeOffset));
 
             out.flush();
@@ -177,31 +688,43 @@ namespace receiver {
     };
 
     struct ReceiverStreamContext {
-        enum StreamType { UNKNOWN, MANIFEST, DATA } type = UNKNOWN;
+        enum StreamType { UNKNOWN, MANIFEST, DATA, INTEGRITY, STRIPE } type = UNKNOWN;
+        enum class PumpResult { WAITING, DONE, FAILED };
 
-        std::vector<uint8_t> stage;
+        common::AlignedBuffer stage;
         size_t stageLen = 0;
 
+        uint32_t curPosition = 0;
         uint32_t curFileId = 0;
         uint64_t curSize = 0;
         uint32_t pinnedFileId = UINT32_MAX;
         llfio::file_handle *pinnedHandle = nullptr;
+        const common::ExtentMap *curExtents = nullptr;
         uint8_t writeBuffer[256 * 1024];
         uint64_t flushOff = 0;
         uint64_t recvOff = 0;
+        uint64_t writebackOff = 0;
+        //stripe streams: the unit being written, or its header while one is being read
+        bool inUnit = false;
+        uint64_t unitEnd = 0;
+        uint8_t unitHeader[common::STRIPE_HEADER_SIZE];
+        size_t headerGot = 0;
 
         ReceiverStreamContext() {
             stage.resize(STAGE_LIMIT);
         }
 
-        bool openFile(ReceiverConnectionContext *connCtx, uint32_t fileId, uint64_t startOff = 0) {
-            if (fileId >= connCtx->fileSizes.size()) return false;
+        bool openFile(ReceiverConnectionContext *connCtx, uint32_t position, uint64_t startOff = 0) {
+            if (position >= connCtx->fileSizes.size()) return false;
 
+            const uint32_t fileId = connCtx->sendOrder.idAt(position);
+            curPosition = position;
             curFileId = fileId;
             curSize = connCtx->fileSizes[fileId];
 
             flushOff = startOff;
             recvOff = startOff;
+            writebackOff = startOff;
             stageLen = 0;
 
             if (pinnedFileId != fileId) {
@@ -209,41 +732,227 @@ namespace receiver {
                 pinnedFileId = fileId;
                 pinnedHandle = connCtx->cache.acquire(fileId, true);
                 if (!pinnedHandle) return false;
+                connCtx->preallocate(position, *pinnedHandle);
+            }
+
+            curExtents = &connCtx->fileExtents[fileId];
+            if (!curExtents->empty() &&
+                !common::DiskIO::recreateHoles(*pinnedHandle, *curExtents, curSize, startOff)) {
+                spdlog::warn("Failed to recreate holes of {}", connCtx->cache.paths[fileId]);
+            }
+            return true;
+        }
+
+        //positions a stripe stream on the unit whose header was just read
+        bool openUnit(ReceiverConnectionContext *session, const common::StripeUnit &unit) {
+            if (unit.position >= session->fileSizes.size()) return false;
+            const uint32_t fileId = session->sendOrder.idAt(unit.position);
+            if (unit.offset > unit.end || unit.end > session->fileSizes[fileId]) return false;
+
+            curPosition = unit.position;
+            curFileId = fileId;
+            curSize = session->fileSizes[fileId];
+            curExtents = &session->fileExtents[fileId];
+            unitEnd = unit.end;
+            flushOff = unit.offset;
+            recvOff = unit.offset;
+            stageLen = 0;
+
+            if (pinnedFileId != fileId) {
+                if (pinnedFileId != UINT32_MAX) session->cache.release(pinnedFileId);
+                pinnedFileId = fileId;
+                pinnedHandle = session->cache.acquire(fileId, true);
+                if (!pinnedHandle) {
+                    pinnedFileId = UINT32_MAX;
+                    return false;
+                }
+                writebackOff = unit.offset;
+                session->prepareStriped(unit.position, *pinnedHandle);
+            }
+            return true;
+        }
+
+        //moves the cursors past a hole; the bytes count as moved since they never travel the wire
+        bool skipHole(ReceiverConnectionContext *connCtx, const uint64_t dataStart) {
+            if (!flushStage(connCtx)) return false;
+            if (type == STRIPE) {
+                flushOff = dataStart;
+                recvOff = dataStart;
+                return true;
             }
+            connCtx->bytesMoved += dataStart - flushOff;
+            flushOff = dataStart;
+            recvOff = dataStart;
+            connCtx->resumePosition = curPosition;
+            connCtx->resumeOffset = flushOff;
+            connCtx->resumeDirty = true;
             return true;
         }
 
         bool flushStage(ReceiverConnectionContext *connCtx) {
             if (stageLen == 0) return true;
             if (!pinnedHandle) return false;
+            common::ScopedLatency timed(connCtx->stats.diskWrite);
 
 
-            llfio::byte_io_handle::const_buffer_type reqBuf({
-                reinterpret_cast<const llfio::byte *>(stage.data()),
-                stageLen
-            });
+            //direct writes take the block aligned head; the unaligned tail goes through the page cache
+            size_t directLen = stageLen;
+            if (connCtx->cache.directIo) {
+                directLen = common::DiskIO::isAligned(flushOff) ? stageLen - stageLen % common::IO_ALIGNMENT : 0;
+            }
+
+            if (directLen > 0) {
+                llfio::byte_io_handle::const_buffer_type reqBuf({
+                    reinterpret_cast<const llfio::byte *>(stage.data()),
+                    directLen
+                });
 
-            llfio::file_handle::io_request<llfio::file_handle::const_buffers_type> req(
-                llfio::file_handle::const_buffers_type{&reqBuf, 1},
-                flushOff
-            );
+                llfio::file_handle::io_request<llfio::file_handle::const_buffers_type> req(
+                    llfio::file_handle::const_buffers_type{&reqBuf, 1},
+                    flushOff
+                );
 
-            auto result = pinnedHandle->write(req);
-            if (!result) return false;
+                auto result = pinnedHandle->write(req);
+                if (!result || result.bytes_transferred() != directLen) return false;
+            }
+            if (directLen < stageLen) {
+                auto *buffered = connCtx->cache.buffered(pinnedFileId, true);
+                if (!buffered || !common::DiskIO::writeBuffered(*buffered, flushOff + directLen,
+                                                                stage.data() + directLen, stageLen - directLen)) {
+                    return false;
+                }
+            }
 
-            const size_t nw = result.bytes_transferred();
-            if (nw != stageLen) return false;
+            const size_t nw = stageLen;
+
+            if (!connCtx->cache.directIo) {
+                //rolling writeback: start flushing this stage now, wait for and drop the one a window behind
+                common::DiskIO::startWriteback(*pinnedHandle, flushOff, nw);
+                if (flushOff + nw >= writebackOff + 2 * WRITEBACK_WINDOW) {
+                    const uint64_t upTo = flushOff + nw - WRITEBACK_WINDOW;
+                    common::DiskIO::dropWritten(*pinnedHandle, writebackOff, upTo - writebackOff);
+                    writebackOff = upTo;
+                }
+            }
 
             connCtx->bytesMoved += nw;
 
             flushOff += nw;
             stageLen = 0;
 
-            connCtx->resumeFileId = curFileId;
+            if (type == STRIPE) {
+                connCtx->onStripeWritten(curPosition, flushOff - nw, flushOff);
+                return true;
+            }
+            connCtx->resumePosition = curPosition;
             connCtx->resumeOffset = flushOff;
             connCtx->resumeDirty = true;
+            connCtx->dispatchVerifications();
 
             return true;
         }
+
+        //moves ordered file data from source into place until source runs dry. source(dst, max) behaves like
+        //lsquic_stream_read, so the data stream and the fec reassembler share holes, resume and verification
+        template<typename Source>
+        PumpResult pump(ReceiverConnectionContext *connCtx, Source &&source) {
+            while (true) {
+                if (!pinnedHandle) return PumpResult::FAILED;
+
+                while (flushOff >= curSize) {
+                    if (!flushStage(connCtx)) return PumpResult::FAILED;
+
+                    connCtx->filesMoved++;
+                    curPosition++;
+
+                    if (connCtx->filesMoved >= connCtx->totalExpectedFilesCount) return PumpResult::DONE;
+                    if (!openFile(connCtx, curPosition, 0)) return PumpResult::FAILED;
+                }
+
+                const size_t stageRoom = stage.size() - stageLen;
+                if (stageRoom == 0) {
+                    if (!flushStage(connCtx)) return PumpResult::FAILED;
+                    continue;
+                }
+
+                uint64_t dataEnd = curSize;
+                if (!curExtents->empty() && recvOff < curSize) {
+                    const auto [start, end] = common::Extents::dataAt(*curExtents, recvOff, curSize);
+                    if (start > recvOff) {
+                        if (!skipHole(connCtx, start)) return PumpResult::FAILED;
+                        continue;
+                    }
+                    dataEnd = end;
+                }
+
+                const uint64_t remaining = (recvOff < dataEnd) ? (dataEnd - recvOff) : 0;
+                if (remaining == 0) {
+                    if (!flushStage(connCtx)) return PumpResult::FAILED;
+                    continue;
+                }
+
+                const size_t maxRead = std::min<uint64_t>(stageRoom, remaining);
+                const ssize_t nr = source(stage.data() + stageLen, maxRead);
+                if (nr <= 0) return PumpResult::WAITING;
+
+                stageLen += nr;
+                recvOff += nr;
+
+                if (stageLen >= FLUSH_AT || recvOff >= curSize) {
+                    if (!flushStage(connCtx)) return PumpResult::FAILED;
+                }
+            }
+        }
+
+        //multipath: writes the units of a stripe stream wherever they belong. DONE once the lane's stream ended
+        template<typename Source>
+        PumpResult pumpStripes(ReceiverConnectionContext *session, Source &&source) {
+            while (true) {
+                if (!inUnit) {
+                    const ssize_t nr = source(unitHeader + headerGot, common::STRIPE_HEADER_SIZE - headerGot);
+                    if (nr == 0) return PumpResult::DONE;
+                    if (nr < 0) return PumpResult::WAITING;
+                    headerGot += nr;
+                    if (headerGot < common::STRIPE_HEADER_SIZE) continue;
+                    headerGot = 0;
+                    if (!openUnit(session, common::StripeUnit::decode(unitHeader))) return PumpResult::FAILED;
+                    inUnit = true;
+                }
+
+                if (recvOff >= unitEnd) {
+                    if (!flushStage(session)) return PumpResult::FAILED;
+                    inUnit = false;
+                    continue;
+                }
+
+                const size_t stageRoom = stage.size() - stageLen;
+                if (stageRoom == 0) {
+                    if (!flushStage(session)) return PumpResult::FAILED;
+                    continue;
+                }
+
+                uint64_t dataEnd = unitEnd;
+                if (!curExtents->empty()) {
+                    const auto [start, end] = common::Extents::dataAt(*curExtents, recvOff, curSize);
+                    if (start > recvOff) {
+                        if (!skipHole(session, std::min(start, unitEnd))) return PumpResult::FAILED;
+                        continue;
+                    }
+                    dataEnd = std::min(end, unitEnd);
+                }
+
+                const size_t maxRead = std::min<uint64_t>(stageRoom, dataEnd - recvOff);
+                const ssize_t nr = source(stage.data() + stageLen, maxRead);
+                if (nr == 0) return PumpResult::DONE;
+                if (nr < 0) return PumpResult::WAITING;
+
+                stageLen += nr;
+                recvOff += nr;
+
+                if (stageLen >= FLUSH_AT || recvOff >= unitEnd) {
+                    if (!flushStage(session)) return PumpResult::FAILED;
+                }
+            }
+        }
     };
 }
@@ -12,6 +12,10 @@ namespace receiver {
     inline int run (const int argc, char **argv) {
         spdlog::set_pattern("%v");
         common::Utils::disableLibniceLogging();
+        common::ThreadManager::configureWorkers(ReceiverConfig::workerThreads, ReceiverConfig::pinWorkers);
+        //file handle caches size themselves from the raised limit
+        common::FileHandleCache::raiseFdLimit();
+        if (!common::StatsSink::open(ReceiverConfig::statsJson)) return 1;
 
         common::IceHandler::initialize();
 
@@ -75,10 +79,14 @@ namespace receiver {
 
         socketClient.stop();
 
+        common::ThreadManager::joinWorkers();
+
         common::IceHandler::destroy();
 
         receiver::ReceiverStream::dispose();
 
+        common::StatsSink::close();
+
         ix::uninitNetSystem();
         return 0;
     }
@@ -17,10 +17,23 @@ namespace receiver {
     public:
         static void onConnect(ix::WebSocket &socket) {
             spdlog::info("Signaling Server Connected: {}", ReceiverConfig::serverUrl);
+            common::IceHandler::onRestart([&socket](const std::string &, common::CandidatesResult result,
+                                                    const int generation) {
+                socket.send(nlohmann::json(common::RestartIcePayload{
+                    .candidatesResult = std::move(result),
+                    .receiverId = "to_be_provided_by_server",
+                    .generation = generation
+                }).dump());
+            });
         }
 
         static void onClose(ix::WebSocket &socket, std::string_view reason) {
             spdlog::info("Signaling Server Disconnected: {} Reason: {}", ReceiverConfig::serverUrl, reason);
+            //once on a P2P route the transfer no longer needs the server; the QUIC connection decides when it ends
+            if (ReceiverStream::transferring()) {
+                spdlog::warn("Transfer continues, but a lost route can no longer be renegotiated");
+                return;
+            }
             common::ThreadManager::terminate();
         }
 
@@ -42,7 +55,7 @@ namespace receiver {
                             }
 
 
-                            common::IceHandler::gatherLocalCandidates(false, "",1,
+                            common::IceHandler::gatherLocalCandidates(false, "", ReceiverConfig::components(),
                                                                       [&socket](common::CandidatesResult result) {
 
                                                                           if (result.serializedCandidates.empty()) {
@@ -56,9 +69,17 @@ namespace receiver {
                                                                               common::JoinTransferSessionPayload{
                                                                                   .candidatesResult = std::move(result),
                                                                                   .joinCode = ReceiverConfig::joinCode,
+                                                                                  .cachedManifests =
+                                                                                  ReceiverConnectionContext::cachedManifests(),
                                                                               }).dump());
                                                                       });
                         });
+                } else if (type == "restart_ice_payload") {
+                    const auto restartIcePayload = j.get<common::RestartIcePayload>();
+                    common::ThreadManager::postTask([restartIcePayload = std::move(restartIcePayload)]() {
+                        common::IceHandler::applyRestart(false, "", restartIcePayload.candidatesResult,
+                                                         restartIcePayload.generation);
+                    });
                 } else if (type == "accept_transfer_session_payload") {
                     const auto acceptedTransferSessionPayload = j.get<common::AcceptTransferSessionPayload>();
                     spdlog::info("Access verified. Starting P2P negotiation...");
@@ -72,7 +93,7 @@ namespace receiver {
                                     spdlog::info(
                                         "P2P Route Established.");
                                     ReceiverStream::receiveTransfer(
-                                        agent, streamId);
+                                        agent, streamId, n);
                                     socket.send(nlohmann::json(common::AcknowledgeTransferSessionPayload{
                                         .receiverId = "to_be_provided_by_server"
                                     }).dump());
@@ -2,9 +2,11 @@
 #include <lsquic.h>
 #include <openssl/base.h>
 #include <openssl/ssl.h>
+#include <openssl/evp.h>
 #include <spdlog/spdlog.h>
 #include <openssl/x509.h>
 #include <openssl/pem.h>
+#include <openssl/rand.h>
 
 #include "ReceiverConfig.hpp"
 #include "ReceiverContexts.hpp"
@@ -14,81 +16,220 @@
 
 namespace receiver {
     class ReceiverStream : public common::Stream {
+        inline static WindowTuner::Windows windows_{};
+        inline static std::atomic<bool> transferring_ = false;
+
+        //the session's connection; contexts live until dispose, so the pointer outlives the lock
+        static ReceiverConnectionContext *sessionContext() {
+            std::lock_guard lock(contextsMutex_);
+            if (connectionContexts_.empty()) return nullptr;
+            return static_cast<ReceiverConnectionContext *>(connectionContexts_[0]);
+        }
+
+        //the bars, and the rate fields behind them, belong to the control plane's reporter; the data plane only
+        //publishes counters and the closed flag, so terminal output never runs inside the packet loop
         static void watchProgress() {
-            g_timeout_add_full(G_PRIORITY_HIGH, 1000, [](gpointer data)-> gboolean {
-                if (connectionContexts_.empty()) {
-                    return G_SOURCE_CONTINUE;
-                }
-                auto *receiverConnectionContext = static_cast<ReceiverConnectionContext *>(
-                    connectionContexts_[0]);
-                if (!receiverConnectionContext || !receiverConnectionContext->started) {
-                    return G_SOURCE_CONTINUE;
-                }
-                if (receiverConnectionContext->complete) {
-                    return G_SOURCE_REMOVE;
-                }
-                const auto now = std::chrono::steady_clock::now();
-                if (receiverConnectionContext->lastTime.time_since_epoch().count() == 0) {
-                    receiverConnectionContext->lastTime = now;
-                    receiverConnectionContext->progressBar->set_option(
-                        indicators::option::PostfixText{"starting..."});
-                    receiverConnectionContext->progressBar->set_progress(0);
-                    return G_SOURCE_CONTINUE;
+            common::ThreadManager::setProgressReporter([] { reportProgress(); });
+
+            //resume state belongs to the data plane, so it is checkpointed there rather than by the reporter
+            common::ThreadManager::addTimeout(1000, [](gpointer) -> gboolean {
+                auto *receiverConnectionContext = sessionContext();
+                if (!receiverConnectionContext || !receiverConnectionContext->started) return G_SOURCE_CONTINUE;
+                if (receiverConnectionContext->complete) return G_SOURCE_REMOVE;
+                receiverConnectionContext->maybeSaveResumeState();
+                observeWindow(receiverConnectionContext);
+                if (!receiverConnectionContext->dataComplete && nackFec(receiverConnectionContext)) {
+                    process(engineShards_[0].get());
                 }
+                return G_SOURCE_CONTINUE;
+            }, nullptr, G_PRIORITY_LOW);
+        }
 
-                std::chrono::duration<double> elapsed = now - receiverConnectionContext->startTime;
-                std::chrono::duration<double> delta = now - receiverConnectionContext->lastTime;
-
-                const double elapsedSeconds = elapsed.count();
-                const double deltaSeconds = delta.count();
-
-                const double safeDelta = (deltaSeconds > 1e-6) ? deltaSeconds : 1e-6;
-                const double safeElapsed = (elapsedSeconds > 1e-6) ? elapsedSeconds : 1e-6;
-
-                const double instantThroughput =
-                        (receiverConnectionContext->bytesMoved - receiverConnectionContext->lastBytesMoved) /
-                        safeDelta;
-                const double averageThroughput = receiverConnectionContext->bytesMoved / safeElapsed;
-                const double ewmaThroughput = receiverConnectionContext->ewmaThroughput == 0
-                                                  ? instantThroughput
-                                                  : 0.2 * instantThroughput + 0.8 * receiverConnectionContext->
-                                                    ewmaThroughput;
-                receiverConnectionContext->ewmaThroughput = ewmaThroughput;
-
-                const double totalBytes = receiverConnectionContext->totalExpectedBytes;
-
-                const double percent = (totalBytes <= 0.0)
-                                           ? 0.0
-                                           : (receiverConnectionContext->bytesMoved / totalBytes) * 100.0;
-                int p = static_cast<int>(std::lround(percent));
-                if (p < 0) p = 0;
-                if (p > 100) p = 100;
-
-                std::string postfix;
-                postfix.reserve(256);
-                postfix += common::Utils::sizeToReadableFormat(ewmaThroughput);
-                postfix += "/s received ";
-                postfix += common::Utils::sizeToReadableFormat(receiverConnectionContext->bytesMoved);
-                postfix += " resumed ";
-                postfix += common::Utils::sizeToReadableFormat(receiverConnectionContext->skippedBytes);
-
-                postfix += " files ";
-
-                postfix += std::to_string(receiverConnectionContext->filesMoved);
-                postfix += "/";
-                postfix += std::to_string(receiverConnectionContext->totalExpectedFilesCount);
-                postfix += " ";
-                postfix += receiverConnectionContext->connectionType == common::ConnectionContext::RELAYED
-                               ? "relayed"
-                               : "direct";
-                receiverConnectionContext->progressBar->set_option(indicators::option::PostfixText{postfix});
-                receiverConnectionContext->progressBar->set_progress(p);;
+        static void reportProgress() {
+            auto *receiverConnectionContext = sessionContext();
+            if (!receiverConnectionContext || receiverConnectionContext->finalDrawn) return;
+            reportManifestProgress(receiverConnectionContext);
+            if (receiverConnectionContext->closed) {
+                reportFinalProgress(receiverConnectionContext);
+                return;
+            }
+            if (!receiverConnectionContext->started || receiverConnectionContext->complete) return;
+            const auto now = std::chrono::steady_clock::now();
+            if (receiverConnectionContext->lastTime.time_since_epoch().count() == 0) {
                 receiverConnectionContext->lastTime = now;
                 receiverConnectionContext->lastBytesMoved = receiverConnectionContext->bytesMoved;
+                receiverConnectionContext->progressBar->set_option(
+                    indicators::option::PostfixText{"starting..."});
+                receiverConnectionContext->progressBar->set_progress(0);
+                return;
+            }
 
-                receiverConnectionContext->maybeSaveResumeState();
-                return G_SOURCE_CONTINUE;
-            }, nullptr, nullptr);
+            std::chrono::duration<double> elapsed = now - receiverConnectionContext->startTime;
+            std::chrono::duration<double> delta = now - receiverConnectionContext->lastTime;
+
+            const double elapsedSeconds = elapsed.count();
+            const double deltaSeconds = delta.count();
+
+            const double safeDelta = (deltaSeconds > 1e-6) ? deltaSeconds : 1e-6;
+            const double safeElapsed = (elapsedSeconds > 1e-6) ? elapsedSeconds : 1e-6;
+
+            const double instantThroughput =
+                    (receiverConnectionContext->bytesMoved - receiverConnectionContext->lastBytesMoved) /
+                    safeDelta;
+            const double averageThroughput = receiverConnectionContext->bytesMoved / safeElapsed;
+            const double ewmaThroughput = receiverConnectionContext->ewmaThroughput == 0
+                                              ? instantThroughput
+                                              : 0.2 * instantThroughput + 0.8 * receiverConnectionContext->
+                                                ewmaThroughput;
+            receiverConnectionContext->ewmaThroughput = ewmaThroughput;
+
+            const double totalBytes = receiverConnectionContext->totalExpectedBytes;
+
+            const double percent = (totalBytes <= 0.0)
+                                       ? 0.0
+                                       : (receiverConnectionContext->bytesMoved / totalBytes) * 100.0;
+            int p = static_cast<int>(std::lround(percent));
+            if (p < 0) p = 0;
+            if (p > 100) p = 100;
+
+            std::string postfix;
+            postfix.reserve(256);
+            postfix += common::Utils::sizeToReadableFormat(ewmaThroughput);
+            postfix += "/s received ";
+            postfix += common::Utils::sizeToReadableFormat(receiverConnectionContext->bytesMoved);
+            postfix += " resumed ";
+            postfix += common::Utils::sizeToReadableFormat(receiverConnectionContext->skippedBytes);
+
+            postfix += " files ";
+
+            postfix += std::to_string(receiverConnectionContext->filesMoved.load());
+            postfix += "/";
+            postfix += std::to_string(receiverConnectionContext->totalExpectedFilesCount);
+            postfix += " ";
+            postfix += receiverConnectionContext->connectionType == common::ConnectionContext::RELAYED
+                           ? "relayed"
+                           : "direct";
+            receiverConnectionContext->progressBar->set_option(indicators::option::PostfixText{postfix});
+            receiverConnectionContext->progressBar->set_progress(p);
+            receiverConnectionContext->lastTime = now;
+            receiverConnectionContext->lastBytesMoved = receiverConnectionContext->bytesMoved;
+        }
+
+        //the catalogue bar, until the manifest is parsed
+        static void reportManifestProgress(ReceiverConnectionContext *ctx) {
+            if (ctx->manifestBarDone || (ctx->manifestReceived == 0 && !ctx->manifestParsed)) return;
+            std::string postfix;
+            postfix.reserve(64);
+            postfix += common::Utils::sizeToReadableFormat(static_cast<double>(ctx->manifestReceived));
+            postfix += " received";
+            ctx->manifestProgressBar.set_option(indicators::option::PostfixText(postfix));
+            if (ctx->manifestParsed) {
+                ctx->manifestProgressBar.mark_as_completed();
+                ctx->manifestBarDone = true;
+            } else {
+                ctx->manifestProgressBar.print_progress();
+            }
+        }
+
+        //the connection is gone: the bar ends as done or failed, once
+        static void reportFinalProgress(ReceiverConnectionContext *ctx) {
+            ctx->finalDrawn = true;
+            const auto &progressBar = ctx->progressBar;
+            std::string postfix;
+            postfix.reserve(256);
+            postfix += " received ";
+            postfix += common::Utils::sizeToReadableFormat(ctx->bytesMoved);
+            postfix += " resumed ";
+            postfix += common::Utils::sizeToReadableFormat(ctx->skippedBytes);
+            postfix += " files ";
+            postfix += std::to_string(ctx->filesMoved.load());
+            postfix += "/";
+            postfix += std::to_string(ctx->totalExpectedFilesCount);
+            postfix += " ";
+            postfix += ctx->connectionType == common::ConnectionContext::RELAYED ? "relayed" : "direct";
+            if (ctx->complete) {
+                postfix += " [DONE]";
+                progressBar->set_option(indicators::option::ForegroundColor{indicators::Color::green});
+                progressBar->set_option(indicators::option::PostfixText{postfix});
+                progressBar->set_progress(100);
+            } else {
+                postfix += " [FAILED]";
+                progressBar->set_option(indicators::option::PostfixText(postfix));
+                progressBar->set_option(indicators::option::ForegroundColor{indicators::Color::red});
+                progressBar->mark_as_completed();
+            }
+        }
+
+        static void markStarted(ReceiverConnectionContext *connCtx) {
+            connCtx->startTime = std::chrono::steady_clock::now();
+            connCtx->started = true;
+        }
+
+        //runs task on the session's shard; receiver contexts live until exit, so nothing to check first
+        static void onSession(ReceiverConnectionContext *session, std::function<void()> task) {
+            auto *owner = shardOf(session);
+            common::ThreadManager::postTask(owner->context, [owner, task = std::move(task)]() {
+                task();
+                process(owner);
+            });
+        }
+
+        //a stripe stream wrote something; the session moves its prefix over it on its own shard
+        static void afterStripes(ReceiverConnectionContext *connCtx, ReceiverConnectionContext *session) {
+            if (!connCtx->lane) {
+                session->advanceStripes();
+                return;
+            }
+            //one pending pass covers every write that lands before it runs
+            if (session->advancePosted.exchange(true)) return;
+            onSession(session, [session]() {
+                session->advancePosted = false;
+                session->advanceStripes();
+            });
+        }
+
+        static void observeWindow(ReceiverConnectionContext *ctx) {
+            if (!ReceiverConfig::autoWindow || !ctx->connection) return;
+            lsquic_conn_info info{};
+            if (lsquic_conn_get_info(ctx->connection, &info) != 0) return;
+            ctx->window.observe(ctx->bytesMoved, info.lci_rtt, ctx->stats.diskWrite.totalUs());
+            ctx->stats.windowTarget = ctx->window.target();
+        }
+
+        static void afterPump(ReceiverConnectionContext *connCtx, lsquic_stream_t *stream,
+                              const ReceiverStreamContext::PumpResult result) {
+            if (result == ReceiverStreamContext::PumpResult::FAILED) {
+                lsquic_stream_close(stream);
+            } else if (result == ReceiverStreamContext::PumpResult::DONE) {
+                connCtx->dataComplete = true;
+                lsquic_stream_wantread(stream, 0);
+                connCtx->maybeFinish();
+            }
+        }
+
+        //fec: asks the sender to resend blocks the datagrams could not deliver; true if any were asked for
+        static bool nackFec(ReceiverConnectionContext *ctx) {
+            const auto nacks = ctx->fec.takeNacks();
+            for (const auto seq: nacks) {
+                ctx->integrity.queue(common::INTEGRITY_FEC_NACK, common::ChunkDigest{.offset = seq});
+            }
+            return !nacks.empty();
+        }
+
+        //fec: feeds every block ready in order to the data stream's context, then acks what it delivered
+        static void deliverFec(ReceiverConnectionContext *connCtx) {
+            auto *ctx = connCtx->dataCtx;
+            if (!ctx || connCtx->dataComplete) return;
+            const uint64_t before = connCtx->fec.delivered();
+            const auto result = ctx->pump(connCtx, [connCtx](uint8_t *dst, const size_t max) {
+                return static_cast<ssize_t>(connCtx->fec.read(dst, max));
+            });
+            if (connCtx->fec.delivered() != before) {
+                connCtx->integrity.queue(common::INTEGRITY_FEC_ACK,
+                                         common::ChunkDigest{.offset = connCtx->fec.delivered()});
+            }
+            nackFec(connCtx);
+            afterPump(connCtx, connCtx->dataStream, result);
         }
 
         static int alpnSelectCallback(SSL *ssl, const unsigned char **out, unsigned char *outlen,
@@ -100,20 +241,56 @@ namespace receiver {
         }
 
 
-        static void loadInMemoryCertificate(SSL_CTX *ctx) {
-            EVP_PKEY_CTX *pkt = EVP_PKEY_CTX_new_id(EVP_PKEY_RSA, nullptr);
+        //an ECDSA P-256 identity: generated in well under a millisecond where RSA-2048 could take a visible
+        //fraction of a second, and cheaper to sign with in every handshake. kept per user unless asked not to
+        static void loadCertificate(SSL_CTX *ctx) {
+            const auto dir = ReceiverConfig::cacheIdentity ? common::Utils::stateDirectory() : std::filesystem::path{};
+            EVP_PKEY *pkey = nullptr;
+            X509 *x509 = nullptr;
+            if (!dir.empty()) readIdentity(dir, pkey, x509);
+            if (!pkey || !x509) {
+                EVP_PKEY_free(pkey);
+                X509_free(x509);
+                pkey = nullptr;
+                x509 = nullptr;
+                generateIdentity(pkey, x509);
+                if (!dir.empty()) writeIdentity(dir, pkey, x509);
+            }
+
+            if (SSL_CTX_use_certificate(ctx, x509) <= 0) throw std::runtime_error("Cert use failed");
+            if (SSL_CTX_use_PrivateKey(ctx, pkey) <= 0) throw std::runtime_error("Key use failed");
+
+            X509_free(x509);
+            EVP_PKEY_free(pkey);
+        }
+
+        static void generateIdentity(EVP_PKEY *&pkey, X509 *&x509) {
+            bssl::UniquePtr<EVP_PKEY_CTX> pkt(EVP_PKEY_CTX_new_id(EVP_PKEY_EC, nullptr));
             if (!pkt) throw std::runtime_error("Failed to create keygen ctx");
 
-            if (EVP_PKEY_keygen_init(pkt) <= 0) throw std::runtime_error("Keygen init failed");
+            if (EVP_PKEY_keygen_init(pkt.get()) <= 0) throw std::runtime_error("Keygen init failed");
 
-            if (EVP_PKEY_CTX_set_rsa_keygen_bits(pkt, 2048) <= 0) throw std::runtime_error("RSA bit set failed");
+            if (EVP_PKEY_CTX_set_ec_paramgen_curve_nid(pkt.get(), NID_X9_62_prime256v1) <= 0) {
+                throw std::runtime_error("EC curve set failed");
+            }
 
-            EVP_PKEY *pkey = nullptr;
-            if (EVP_PKEY_keygen(pkt, &pkey) <= 0) throw std::runtime_error("Key generation failed");
+            if (EVP_PKEY_keygen(pkt.get(), &pkey) <= 0) throw std::runtime_error("Key generation failed");
+
+            //a fresh random serial per identity, so a regenerated certificate never repeats issuer and serial.
+            //63 bits keeps the DER integer positive
+            uint64_t serial = 0;
+            if (!RAND_bytes(reinterpret_cast<uint8_t *>(&serial), sizeof(serial))) {
+                throw std::runtime_error("Serial generation failed");
+            }
+            serial &= INT64_MAX;
+            if (serial == 0) serial = 1;
 
-            X509 *x509 = X509_new();
+            x509 = X509_new();
+            if (!x509) throw std::runtime_error("Failed to create certificate");
             X509_set_version(x509, 2);
-            ASN1_INTEGER_set(X509_get_serialNumber(x509), 1);
+            if (!ASN1_INTEGER_set_uint64(X509_get_serialNumber(x509), serial)) {
+                throw std::runtime_error("Serial set failed");
+            }
             X509_gmtime_adj(X509_get_notBefore(x509), 0);
             X509_gmtime_adj(X509_get_notAfter(x509), 31536000L); // 1 year
 
@@ -123,13 +300,53 @@ namespace receiver {
             X509_set_issuer_name(x509, name);
 
             if (!X509_sign(x509, pkey, EVP_sha256())) throw std::runtime_error("Signing failed");
+        }
 
-            if (SSL_CTX_use_certificate(ctx, x509) <= 0) throw std::runtime_error("Cert use failed");
-            if (SSL_CTX_use_PrivateKey(ctx, pkey) <= 0) throw std::runtime_error("Key use failed");
+        //a cached identity is used while it matches its key and has more than a day left
+        static void readIdentity(const std::filesystem::path &dir, EVP_PKEY *&pkey, X509 *&x509) {
+            if (BIO *bio = BIO_new_file((dir / "identity.key").string().c_str(), "rb")) {
+                pkey = PEM_read_bio_PrivateKey(bio, nullptr, nullptr, nullptr);
+                BIO_free(bio);
+            }
+            if (BIO *bio = BIO_new_file((dir / "identity.crt").string().c_str(), "rb")) {
+                x509 = PEM_read_bio_X509(bio, nullptr, nullptr, nullptr);
+                BIO_free(bio);
+            }
+            if (!pkey || !x509) return;
+            time_t soon = time(nullptr) + 24 * 60 * 60;
+            if (X509_check_private_key(x509, pkey) != 1 || X509_cmp_time(X509_get_notAfter(x509), &soon) <= 0) {
+                EVP_PKEY_free(pkey);
+                X509_free(x509);
+                pkey = nullptr;
+                x509 = nullptr;
+            }
+        }
 
-            EVP_PKEY_CTX_free(pkt);
-            X509_free(x509);
-            EVP_PKEY_free(pkey);
+        //best effort: a failed write only means the next run generates again
+        static void writeIdentity(const std::filesystem::path &dir, EVP_PKEY *pkey, X509 *x509) {
+            std::error_code ec;
+            std::filesystem::create_directories(dir, ec);
+            const auto write = [&dir](const char *file, const auto &pem) {
+                const auto path = dir / file;
+                const auto tmp = dir / (std::string(file) + ".tmp");
+                BIO *bio = BIO_new_file(tmp.string().c_str(), "wb");
+                if (!bio) return false;
+                std::error_code ec;
+                //the key is readable by its owner only, before anything is written into it
+                std::filesystem::permissions(tmp, std::filesystem::perms::owner_read |
+                                                  std::filesystem::perms::owner_write, ec);
+                const bool ok = pem(bio) == 1;
+                BIO_free(bio);
+                if (ok) std::filesystem::rename(tmp, path, ec);
+                if (!ok || ec) std::filesystem::remove(tmp, ec);
+                return ok && !ec;
+            };
+            const bool ok = write("identity.key", [pkey](BIO *bio) {
+                return PEM_write_bio_PrivateKey(bio, pkey, nullptr, nullptr, 0, nullptr, nullptr);
+            }) && write("identity.crt", [x509](BIO *bio) {
+                return PEM_write_bio_X509(bio, x509);
+            });
+            if (!ok) spdlog::debug("Could not cache the QUIC identity in {}", dir.string());
         }
 
 
@@ -142,52 +359,25 @@ namespace receiver {
             .on_conn_closed = [](lsquic_conn_t *c) {
                 auto *ctx = reinterpret_cast<ReceiverConnectionContext *>(lsquic_conn_get_ctx(c));
                 lsquic_conn_set_ctx(c, nullptr);
+                //a lost path is not the end of the session; what it carried gets asked for again
+                if (ctx && ctx->lane) {
+                    reportStats(ctx, c);
+                    ctx->connection = nullptr;
+                    return;
+                }
                 if (ctx) {
+                    reportStats(ctx, c);
                     if (ctx->complete) {
-                        const auto &progressBar = ctx->progressBar;
-                        progressBar->set_option(
-                            indicators::option::ForegroundColor{indicators::Color::green});
-
-                        std::string postfix;
-                        postfix.reserve(256);
-                        postfix += " received ";
-                        postfix += common::Utils::sizeToReadableFormat(ctx->bytesMoved);
-                        postfix += " resumed ";
-                        postfix += common::Utils::sizeToReadableFormat(ctx->skippedBytes);
-                        postfix += " files ";
-                        postfix += std::to_string(ctx->filesMoved);
-                        postfix += "/";
-                        postfix += std::to_string(ctx->totalExpectedFilesCount);
-                        postfix += " ";
-                        postfix += ctx->connectionType == common::ConnectionContext::RELAYED ? "relayed" : "direct";
-                        postfix += " [DONE]";
-                        progressBar->set_option(indicators::option::PostfixText{postfix});
-                        progressBar->set_progress(100);
                         //delete resume state
                         std::error_code ec;
                         std::filesystem::remove(ctx->resumeStatePath, ec);
+                        std::filesystem::remove(ctx->manifestCachePath, ec);
                     } else {
-                        const auto &progressBar = ctx->progressBar;
-                        std::string postfix;
-                        postfix.reserve(256);
-                        postfix += " received ";
-                        postfix += common::Utils::sizeToReadableFormat(ctx->bytesMoved);
-                        postfix += " resumed ";
-                        postfix += common::Utils::sizeToReadableFormat(ctx->skippedBytes);
-                        postfix += " files ";
-                        postfix += std::to_string(ctx->filesMoved);
-                        postfix += "/";
-                        postfix += std::to_string(ctx->totalExpectedFilesCount);
-                        postfix += " ";
-                        postfix += ctx->connectionType == common::ConnectionContext::RELAYED ? "relayed" : "direct";
-                        postfix += " [FAILED]";
-                        progressBar->set_option(indicators::option::PostfixText(postfix));
-                        progressBar->set_option(
-                            indicators::option::ForegroundColor{indicators::Color::red});
-                        progressBar->mark_as_completed();
                         ctx->maybeSaveResumeState(true);
                     }
                     ctx->connection = nullptr;
+                    //the reporter draws the final bar, at the latest in its last pass after the data plane stops
+                    ctx->closed = true;
                 }
                 //no need to delete connection context pointer for receiver; to be handled by dispose() function anyways
                 common::ThreadManager::terminate();
@@ -204,58 +394,125 @@ namespace receiver {
                 if (ctx->type == ReceiverStreamContext::UNKNOWN) {
                     uint8_t tag;
                     if (lsquic_stream_read(stream, &tag, 1) == 1) {
-                        ctx->type = (tag == 0x00)
+                        ctx->type = (tag == common::STREAM_TAG_MANIFEST || tag == common::STREAM_TAG_MANIFEST_REF)
                                         ? ReceiverStreamContext::MANIFEST
-                                        : ReceiverStreamContext::DATA;
+                                        : (tag == common::STREAM_TAG_INTEGRITY)
+                                              ? ReceiverStreamContext::INTEGRITY
+                                              : (tag == common::STREAM_TAG_STRIPE)
+                                                    ? ReceiverStreamContext::STRIPE
+                                                    : ReceiverStreamContext::DATA;
+                        if (connCtx->lane && ctx->type != ReceiverStreamContext::STRIPE) {
+                            lsquic_stream_close(stream);
+                            return;
+                        }
+                        if (ctx->type == ReceiverStreamContext::MANIFEST) {
+                            connCtx->manifestByReference = tag == common::STREAM_TAG_MANIFEST_REF;
+                            if (!connCtx->manifestByReference) connCtx->startManifestCache();
+                        }
+                        if (ctx->type == ReceiverStreamContext::INTEGRITY) {
+                            connCtx->integrity.stream = stream;
+                            if (connCtx->integrity.pending()) lsquic_stream_wantwrite(stream, 1);
+                        }
                         if (ctx->type == ReceiverStreamContext::DATA && !connCtx->started) {
-                            if (!ctx->openFile(connCtx, connCtx->resumeFileId, connCtx->resumeOffset)) {
+                            if (!ctx->openFile(connCtx, connCtx->resumePosition, connCtx->resumeOffset)) {
                                 lsquic_stream_close(stream);
                                 return;
                             }
 
-                            connCtx->startTime = std::chrono::steady_clock::now();
-                            connCtx->progressBar->set_option(
-                                indicators::option::PostfixText{"starting..."});
-                            connCtx->progressBar->set_progress(0);
-                            connCtx->started = true;
+                            markStarted(connCtx);
+                            connCtx->dataStream = stream;
+                            connCtx->dataCtx = ctx;
+                            //datagrams may have raced ahead of the stream's tag byte
+                            deliverFec(connCtx);
+                        }
+                        if (ctx->type == ReceiverStreamContext::STRIPE) {
+                            auto *session = connCtx->owner();
+                            if (!session->manifestParsed) {
+                                ctx->type = ReceiverStreamContext::UNKNOWN;
+                                lsquic_stream_close(stream);
+                                return;
+                            }
+                            ++session->stripeStreams;
+                            session->beginStripes();
+                            if (!connCtx->lane) {
+                                if (!session->started) markStarted(session);
+                                session->advanceStripes();
+                            } else {
+                                onSession(session, [session]() {
+                                    if (!session->started) markStarted(session);
+                                    session->advanceStripes();
+                                });
+                            }
                         }
                     } else {
                         return;
                     }
                 }
 
+                if (ctx->type == ReceiverStreamContext::STRIPE) {
+                    auto *session = connCtx->owner();
+                    const auto result = ctx->pumpStripes(session, [stream](uint8_t *dst, const size_t max) {
+                        return lsquic_stream_read(stream, dst, max);
+                    });
+                    afterStripes(connCtx, session);
+                    //the stream's end is accounted for in on_close, where a failed one ends up too
+                    if (result != ReceiverStreamContext::PumpResult::WAITING) lsquic_stream_close(stream);
+                    return;
+                }
+
+                if (ctx->type == ReceiverStreamContext::INTEGRITY) {
+                    if (!connCtx->integrity.drain()) {
+                        lsquic_stream_wantread(stream, 0);
+                    }
+                    uint8_t kind;
+                    common::ChunkDigest c;
+                    std::vector<uint8_t> payload;
+                    while (connCtx->integrity.next(kind, c, payload)) {
+                        if (kind == common::INTEGRITY_CHUNK_DIGEST) {
+                            connCtx->pendingDigests.push_back(c);
+                        } else if (kind == common::INTEGRITY_CHUNK_REPAIR) {
+                            connCtx->onRepair(c, payload);
+                        } else if (kind == common::INTEGRITY_DIGESTS_END) {
+                            connCtx->digestsComplete = true;
+                        } else if (kind == common::INTEGRITY_FEC_BLOCK) {
+                            if (connCtx->fec.addBlock(c.offset, std::move(payload))) deliverFec(connCtx);
+                        }
+                    }
+                    connCtx->dispatchVerifications();
+                    connCtx->maybeFinish();
+                    return;
+                }
+
                 if (ctx->type == ReceiverStreamContext::MANIFEST) {
-                    uint8_t tmp[4096];
+                    uint8_t tmp[64 * 1024];
                     while (!connCtx->manifestParsed) {
                         const auto nr = lsquic_stream_read(stream, tmp, sizeof(tmp));
                         if (nr > 0) {
-                            connCtx->manifestBuf.insert(connCtx->manifestBuf.end(), tmp, tmp + nr);
-                            std::string postfix;
-                            postfix.reserve(64);
-                            postfix += common::Utils::sizeToReadableFormat(
-                                static_cast<double>(connCtx->manifestBuf.size()));
-                            postfix += " received";
-                            connCtx->manifestProgressBar.set_option(indicators::option::PostfixText(postfix));
-                            const auto now = std::chrono::steady_clock::now();
-                            if (now - connCtx->lastManifestProgressPrint >= std::chrono::milliseconds(250)) {
-                                connCtx->manifestProgressBar.print_progress();
-                                connCtx->lastManifestProgressPrint = now;
+                            if (connCtx->manifestByReference) {
+                                connCtx->manifestReference.insert(connCtx->manifestReference.end(), tmp, tmp + nr);
+                                continue;
+                            }
+                            connCtx->manifestHasher.update(tmp, nr);
+                            connCtx->cacheManifest(tmp, nr);
+                            if (!connCtx->feedManifest(tmp, nr)) {
+                                lsquic_conn_close(connCtx->connection);
+                                return;
                             }
                         } else if (nr == 0) {
-                            std::string postfix;
-                            postfix.reserve(64);
-                            postfix += common::Utils::sizeToReadableFormat((double) connCtx->manifestBuf.size());
-                            postfix += " received";
-                            connCtx->manifestProgressBar.set_option(indicators::option::PostfixText(postfix));
-                            connCtx->manifestProgressBar.mark_as_completed();
-
-                            connCtx->parseManifest();
+                            if (connCtx->manifestByReference && !connCtx->loadCachedManifest()) {
+                                lsquic_conn_close(connCtx->connection);
+                                return;
+                            }
+                            if (!connCtx->finishManifest()) {
+                                lsquic_conn_close(connCtx->connection);
+                                return;
+                            }
                             connCtx->manifestParsed = true;
-                            connCtx->pendingManifestAck = true;
-                            //must write ACK
-                            lsquic_stream_wantwrite(stream, 1);
+                            connCtx->manifestStream = stream;
                             //no reading
                             lsquic_stream_wantread(stream, 0);
+                            //ACK goes out once the resumed prefix (if any) checks out
+                            connCtx->validateResume();
                             break;
                         } else {
                             if (errno == EAGAIN || errno == EWOULDBLOCK) {
@@ -268,78 +525,26 @@ namespace receiver {
                     return;
                 }
 
-                while (true) {
-                    if (!ctx->pinnedHandle) {
-                        lsquic_stream_close(stream);
-                        return;
-                    }
-
-                    while (ctx->flushOff >= ctx->curSize) {
-                        if (!ctx->flushStage(connCtx)) {
-                            lsquic_stream_close(stream);
-                            return;
-                        }
-
-                        connCtx->filesMoved++;
-                        ctx->curFileId++;
-
-                        if (connCtx->filesMoved >= connCtx->totalExpectedFilesCount) {
-                            connCtx->complete = true;
-                            connCtx->pendingCompleteAck = true;
-                            lsquic_stream_wantwrite(connCtx->manifestStream, 1);
-                            lsquic_stream_wantread(stream, 0);
-                            return;
-                        }
-
-                        if (!ctx->openFile(connCtx, ctx->curFileId, 0)) {
-                            lsquic_stream_close(stream);
-                            return;
-                        }
-                    }
-
-                    const size_t stageRoom = ctx->stage.size() - ctx->stageLen;
-                    if (stageRoom == 0) {
-                        if (!ctx->flushStage(connCtx)) {
-                            lsquic_stream_close(stream);
-                            return;
-                        }
-                        continue;
-                    }
-
-                    const uint64_t remaining = (ctx->recvOff < ctx->curSize) ? (ctx->curSize - ctx->recvOff) : 0;
-                    if (remaining == 0) {
-                        if (!ctx->flushStage(connCtx)) {
-                            lsquic_stream_close(stream);
-                            return;
-                        }
-                        continue;
-                    }
-
-                    const size_t maxRead = std::min<uint64_t>(stageRoom, remaining);
-                    const ssize_t nr = lsquic_stream_read(stream, ctx->stage.data() + ctx->stageLen, maxRead);
-                    if (nr <= 0) break;
-
-                    ctx->stageLen += nr;
-                    ctx->recvOff += nr;
-
-                    if (ctx->stageLen >= FLUSH_AT || ctx->recvOff >= ctx->curSize) {
-                        if (!ctx->flushStage(connCtx)) {
-                            lsquic_stream_close(stream);
-                            return;
-                        }
-                    }
-                }
+                if (connCtx->dataComplete) return;
+                afterPump(connCtx, stream, ctx->pump(connCtx, [stream](uint8_t *dst, const size_t max) {
+                    return lsquic_stream_read(stream, dst, max);
+                }));
             },
             .on_write = [](lsquic_stream_t *stream, lsquic_stream_ctx_t *h) {
                 auto *connCtx = reinterpret_cast<ReceiverConnectionContext *>(lsquic_conn_get_ctx(
                     lsquic_stream_conn(stream)));
                 auto *ctx = reinterpret_cast<ReceiverStreamContext *>(h);
 
+                if (ctx->type == ReceiverStreamContext::INTEGRITY) {
+                    connCtx->integrity.flush();
+                    return;
+                }
+
                 if (ctx->type == ReceiverStreamContext::MANIFEST) {
                     if (connCtx->pendingManifestAck) {
                         uint8_t ackbuf[1 + 4 + 8];
                         ackbuf[0] = common::RECEIVER_MANIFEST_RECEIVED_ACK;
-                        memcpy(ackbuf + 1, &connCtx->resumeFileId, 4);
+                        memcpy(ackbuf + 1, &connCtx->resumePosition, 4);
                         memcpy(ackbuf + 5, &connCtx->resumeOffset, 8);
 
                         const size_t total = sizeof(ackbuf);
@@ -350,7 +555,6 @@ namespace receiver {
                         if (connCtx->manifestAckSent >= total) {
                             lsquic_stream_flush(stream);
                             connCtx->pendingManifestAck = false;
-                            connCtx->manifestStream = stream;
                             lsquic_stream_wantwrite(stream, 0);
                         }
                     } else if (connCtx->pendingCompleteAck) {
@@ -366,9 +570,19 @@ namespace receiver {
             },
             .on_close = [](lsquic_stream_t *stream, lsquic_stream_ctx_t *h) {
                 auto *ctx = reinterpret_cast<ReceiverStreamContext *>(h);
-                auto *connCtx = reinterpret_cast<ReceiverConnectionContext *>(lsquic_conn_get_ctx(
+                auto *path = reinterpret_cast<ReceiverConnectionContext *>(lsquic_conn_get_ctx(
                     lsquic_stream_conn(stream)));
+                //a lane's stream writes into, and pins files of, the session it belongs to
+                auto *connCtx = path ? path->owner() : nullptr;
+                const bool onLane = path && path->lane;
 
+                if (connCtx && !onLane && ctx->type == ReceiverStreamContext::INTEGRITY) {
+                    connCtx->integrity.stream = nullptr;
+                }
+                if (connCtx && !onLane && connCtx->dataCtx == ctx) {
+                    connCtx->dataCtx = nullptr;
+                    connCtx->dataStream = nullptr;
+                }
                 if (connCtx && !connCtx->complete) {
                     (void) ctx->flushStage(connCtx);
                 }
@@ -377,11 +591,27 @@ namespace receiver {
                     ctx->pinnedFileId = UINT32_MAX;
                     ctx->pinnedHandle = nullptr;
                 }
+                if (connCtx && ctx->type == ReceiverStreamContext::STRIPE) {
+                    afterStripes(path, connCtx);
+                    if (connCtx->stripeStreams > 0 && --connCtx->stripeStreams == 0) {
+                        if (onLane) {
+                            onSession(connCtx, [connCtx]() { connCtx->requestMissingStripes(); });
+                        } else {
+                            connCtx->requestMissingStripes();
+                        }
+                    }
+                }
                 delete ctx;
             },
+            .on_datagram = [](lsquic_conn_t *c, const void *buf, size_t len) {
+                auto *connCtx = reinterpret_cast<ReceiverConnectionContext *>(lsquic_conn_get_ctx(c));
+                if (!connCtx || connCtx->dataComplete) return;
+                if (connCtx->fec.addSymbol(static_cast<const uint8_t *>(buf), len)) deliverFec(connCtx);
+            },
             .on_hsk_done = [](lsquic_conn_t *c, enum lsquic_hsk_status status) {
                 if (status == LSQ_HSK_OK || status == LSQ_HSK_RESUMED_OK) {
-                    spdlog::info("QUIC Handshake Successful");
+                    const char *cipher = lsquic_conn_crypto_cipher(c);
+                    spdlog::info("QUIC Handshake Successful ({})", cipher ? cipher : "unknown cipher");
                 }
             }
         };
@@ -391,28 +621,37 @@ namespace receiver {
             // common::init_lsquic_logging();
             sslCtx_ = createSslCtx();
             SSL_CTX_set_alpn_select_cb(sslCtx_, alpnSelectCallback, nullptr);
-            loadInMemoryCertificate(sslCtx_);
+            loadCertificate(sslCtx_);
             lsquic_global_init(LSQUIC_GLOBAL_SERVER);
             lsquic_engine_settings settings;
             lsquic_engine_init_settings(&settings, LSENG_SERVER);
             settings.es_versions = (1 << LSQVER_I001);
-            settings.es_cc_algo = 2;
-            settings.es_init_max_data = ReceiverConfig::quicConnWindowBytes;
+            //the receiver only sends acks and control frames; there is nothing worth learning a controller for
+            settings.es_cc_algo = static_cast<int>(common::parseCongestionControl(ReceiverConfig::congestionControl)
+                .value_or(common::CongestionControl::ADAPTIVE));
+            windows_ = WindowTuner::plan(ReceiverConfig::autoWindow, ReceiverConfig::explicitWindows,
+                                         ReceiverConfig::quicConnWindowBytes, ReceiverConfig::quicStreamWindowBytes,
+                                         ReceiverConfig::windowBudgetBytes);
+            settings.es_init_max_data = windows_.initConn;
             settings.es_init_max_streams_uni = 0;
-            settings.es_init_max_streams_bidi = 2;
+            settings.es_init_max_streams_bidi = 3;
             settings.es_idle_conn_to = 30000000;
-            settings.es_init_max_stream_data_uni = ReceiverConfig::quicStreamWindowBytes;
-            settings.es_init_max_stream_data_bidi_local = ReceiverConfig::quicStreamWindowBytes;
-            settings.es_init_max_stream_data_bidi_remote = ReceiverConfig::quicStreamWindowBytes;
+            settings.es_init_max_stream_data_uni = windows_.initStream;
+            settings.es_init_max_stream_data_bidi_local = windows_.initStream;
+            settings.es_init_max_stream_data_bidi_remote = windows_.initStream;
             settings.es_handshake_to = 16777215;
-            settings.es_allow_migration = 0;
+            //a sender that moved to a new address is validated and followed, see followRoutes
+            settings.es_allow_migration = 1;
             settings.es_pace_packets = 1;
             settings.es_delayed_acks = 0;
             settings.es_max_batch_size = 64;
             settings.es_scid_len = 8;
-            settings.es_max_cfcw = ReceiverConfig::quicConnWindowBytes * 2;
-            settings.es_max_sfcw = ReceiverConfig::quicStreamWindowBytes * 2;
+            settings.es_max_cfcw = windows_.maxConn;
+            settings.es_max_sfcw = windows_.maxStream;
             settings.es_progress_check = 10000;
+            //senders opt into fec; accepting datagrams costs nothing when they don't
+            settings.es_datagrams = 1;
+            configurePathMtu(settings, ReceiverConfig::pmtud, ReceiverConfig::basePlpmtu, ReceiverConfig::maxPlpmtu);
 
 
             char err_buf[256];
@@ -425,15 +664,30 @@ namespace receiver {
             api.ea_stream_if = &streamCallbacks;
             api.ea_packets_out = sendPackets;
             api.ea_get_ssl_ctx = getSslCtx;
-            engine = lsquic_engine_new(LSENG_SERVER, &api);
+            //a session with several paths takes each on its own engine and loop, so one transfer is not held to a
+            //single core; shard 0 shares the main data plane with ICE
+            const size_t shards = std::clamp<size_t>(ReceiverConfig::components(), 1,
+                                                     std::max(1u, std::thread::hardware_concurrency()));
+            common::ThreadManager::addDataPlaneLoops(shards);
+            for (size_t i = 0; i < shards; ++i) {
+                lsquic_engine_t *shardEngine = lsquic_engine_new(LSENG_SERVER, &api);
+                if (!shardEngine) {
+                    spdlog::error("Failed to create QUIC engine shard {}", i);
+                    return;
+                }
+                addEngineShard(shardEngine, common::ThreadManager::getContext(i));
+            }
             watchProgress();
         }
 
 
-        static void receiveTransfer(NiceAgent *agent, const guint streamId) {
+        static bool transferring() {
+            return transferring_;
+        }
+
+        static void receiveTransfer(NiceAgent *agent, const guint streamId, const int components) {
             spdlog::info("Saving to {}", ReceiverConfig::out);
 
-            setAndVerifySocketBuffers(agent, streamId, 1, ReceiverConfig::udpBufferBytes);
             NiceCandidate *local = nullptr, *remote = nullptr;
             if (!nice_agent_get_selected_pair(agent, streamId, 1, &local, &remote)) {
                 spdlog::error("ICE not ready for QUIC connection");
@@ -441,40 +695,132 @@ namespace receiver {
             }
 
             auto *ctx = new ReceiverConnectionContext();
+            ctx->createProgressBar("Receiving ");
+            ctx->stats.peer = "sender";
+            ctx->window.setCeiling(windows_.maxConn);
+            attachPath(ctx, agent, streamId, 1, local, remote);
+            std::vector<ReceiverConnectionContext *> routes(components, nullptr);
+            routes[0] = ctx;
+            if (ctx->connectionType == common::ConnectionContext::RELAYED) {
+                ctx->progressBar->set_option(indicators::option::ForegroundColor{indicators::Color::yellow});
+            }
+
+            //every further path that came up is a lane the sender stripes file data over
+            int paths = 1;
+            for (int k = 2; k <= components; ++k) {
+                if (nice_agent_get_component_state(agent, streamId, k) != NICE_COMPONENT_STATE_READY ||
+                    !nice_agent_get_selected_pair(agent, streamId, k, &local, &remote)) {
+                    continue;
+                }
+                auto *lane = new ReceiverConnectionContext();
+                lane->lane = true;
+                lane->session = ctx;
+                lane->stats.peer = "sender path " + std::to_string(k);
+                lane->shard = static_cast<size_t>(k - 1) % engineShards_.size();
+                attachPath(lane, agent, streamId, static_cast<guint>(k), local, remote);
+                routes[k - 1] = lane;
+                ++paths;
+            }
+            if (paths > 1) spdlog::info("Receiving over {} paths", paths);
+            followRoutes(agent, std::move(routes));
+            transferring_ = true;
+
+            for (const auto &shard: engineShards_) {
+                startTicking(shard.get());
+                startStats(shard.get());
+            }
+        }
+
+    private:
+        static bool sameAddress(const sockaddr_storage &a, const sockaddr_storage &b) {
+            if (a.ss_family != b.ss_family) return false;
+            if (a.ss_family == AF_INET) {
+                const auto &x = reinterpret_cast<const sockaddr_in &>(a);
+                const auto &y = reinterpret_cast<const sockaddr_in &>(b);
+                return x.sin_port == y.sin_port && x.sin_addr.s_addr == y.sin_addr.s_addr;
+            }
+            if (a.ss_family == AF_INET6) {
+                const auto &x = reinterpret_cast<const sockaddr_in6 &>(a);
+                const auto &y = reinterpret_cast<const sockaddr_in6 &>(b);
+                return x.sin6_port == y.sin6_port && memcmp(&x.sin6_addr, &y.sin6_addr, sizeof(x.sin6_addr)) == 0;
+            }
+            return false;
+        }
+
+        //after an ICE restart or a NAT rebinding libnice may carry a path over a new pair. a new sender address is
+        //handed to lsquic as such, so the connection validates the path and migrates with fresh congestion state.
+        //the sender, as the client, keeps its labels: libnice routes underneath them either way
+        static void followRoutes(NiceAgent *agent, std::vector<ReceiverConnectionContext *> routes) {
+            using Routes = std::vector<ReceiverConnectionContext *>;
+            g_signal_connect_data(agent, "new-selected-pair-full",
+                                  G_CALLBACK(+[](NiceAgent *, guint, guint componentId, NiceCandidate *local,
+                                                 NiceCandidate *remote, gpointer data) {
+                                      const auto &paths = *static_cast<Routes *>(data);
+                                      if (componentId == 0 || componentId > paths.size() || !paths[componentId - 1]) {
+                                          return;
+                                      }
+                                      auto *ctx = paths[componentId - 1];
+                                      sockaddr_storage address{};
+                                      nice_address_copy_to_sockaddr(&remote->addr,
+                                                                    reinterpret_cast<sockaddr *>(&address));
+                                      const auto type = local->type == NICE_CANDIDATE_TYPE_RELAYED ||
+                                                        remote->type == NICE_CANDIDATE_TYPE_RELAYED
+                                                            ? common::ConnectionContext::RELAYED
+                                                            : common::ConnectionContext::DIRECT;
+                                      common::ThreadManager::postTask(shardOf(ctx)->context, [ctx, address, type]() {
+                                          if (sameAddress(ctx->remoteAddr, address)) return;
+                                          ctx->remoteAddr = address;
+                                          ctx->connectionType = type;
+                                          spdlog::info("Sender path {} moved to a new route", ctx->componentId);
+                                      });
+                                  }),
+                                  new Routes(std::move(routes)),
+                                  [](const gpointer data, GClosure *) {
+                                      delete static_cast<Routes *>(data);
+                                  },
+                                  static_cast<GConnectFlags>(0)
+            );
+        }
+
+        static void attachPath(ReceiverConnectionContext *ctx, NiceAgent *agent, const guint streamId,
+                               const guint componentId, const NiceCandidate *local, const NiceCandidate *remote) {
+            setAndVerifySocketBuffers(agent, streamId, componentId, ReceiverConfig::udpBufferBytes);
+            if (ReceiverConfig::pmtud) setDontFragment(agent, streamId, componentId);
+
             ctx->agent = agent;
             ctx->streamId = streamId;
-            ctx->createProgressBar("Receiving ");
+            ctx->componentId = componentId;
             ctx->connectionType = (local->type == NICE_CANDIDATE_TYPE_RELAYED || remote->type ==
                                    NICE_CANDIDATE_TYPE_RELAYED)
                                       ? common::ConnectionContext::RELAYED
                                       : common::ConnectionContext::DIRECT;
-            if (ctx->connectionType == common::ConnectionContext::RELAYED) {
-                ctx->progressBar->set_option(indicators::option::ForegroundColor{indicators::Color::yellow});
-            }
 
             nice_address_copy_to_sockaddr(&local->addr, reinterpret_cast<sockaddr *>(&ctx->localAddr));
             nice_address_copy_to_sockaddr(&remote->addr, reinterpret_cast<sockaddr *>(&ctx->remoteAddr));
 
 
-            connectionContexts_.push_back(ctx);
+            {
+                std::lock_guard lock(contextsMutex_);
+                connectionContexts_.push_back(ctx);
+            }
 
 
-            nice_agent_attach_recv(agent, streamId, 1, common::ThreadManager::getContext(),
+            //packets for each path are delivered straight to the loop of the shard that owns it
+            nice_agent_attach_recv(agent, streamId, componentId, shardOf(ctx)->context,
                                    [](NiceAgent *agent, guint stream_id, guint component_id,
                                       guint len, gchar *buf, gpointer user_data) {
                                        auto *c = static_cast<common::ConnectionContext *>(user_data);
+                                       auto *owner = shardOf(c);
 
-                                       lsquic_engine_packet_in(engine, (unsigned char *) buf, len,
+                                       lsquic_engine_packet_in(owner->engine, (unsigned char *) buf, len,
                                                                (sockaddr *) &c->localAddr,
                                                                (sockaddr *) &c->remoteAddr,
                                                                c, 0);
 
-                                       process();
+                                       process(owner);
                                    },
                                    ctx
             );
-
-            g_timeout_add(0, engineTick, nullptr);
         }
     };
 };
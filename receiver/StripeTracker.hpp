@@ -0,0 +1,127 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <map>
+#include <vector>
+
+#include "../common/Contexts.hpp"
+#include "../common/Extents.hpp"
+#include "../common/Integrity.hpp"
+#include "../common/SendOrder.hpp"
+
+namespace receiver {
+    //multipath: units land out of order across the lanes. tracks what was written past the contiguous prefix and
+    //moves the prefix (the resume point, and what digests are checked against) over it as the gaps fill
+    class StripeTracker {
+        //per position in send order, merged [start, end) ranges written beyond the prefix
+        std::map<uint32_t, std::map<uint64_t, uint64_t> > written_;
+
+        const std::vector<uint64_t> *sizes_ = nullptr;
+        const std::vector<common::ExtentMap> *extents_ = nullptr;
+        const common::SendOrder *order_ = nullptr;
+
+    public:
+        void begin(const std::vector<uint64_t> &sizes, const std::vector<common::ExtentMap> &extents,
+                   const common::SendOrder &order) {
+            sizes_ = &sizes;
+            extents_ = &extents;
+            order_ = &order;
+            written_.clear();
+        }
+
+        void add(const uint32_t position, const uint64_t start, const uint64_t end) {
+            if (end <= start) return;
+            auto &ranges = written_[position];
+            uint64_t from = start;
+            uint64_t to = end;
+            auto it = ranges.upper_bound(from);
+            if (it != ranges.begin() && std::prev(it)->second >= from) --it;
+            while (it != ranges.end() && it->first <= to) {
+                from = std::min(from, it->first);
+                to = std::max(to, it->second);
+                it = ranges.erase(it);
+            }
+            ranges.emplace(from, to);
+        }
+
+        //moves (position, offset) over written ranges, holes and empty files; returns the hole bytes passed
+        uint64_t advance(uint32_t &position, uint64_t &offset) {
+            uint64_t holes = 0;
+            while (position < sizes_->size()) {
+                const uint32_t id = order_->idAt(position);
+                const uint64_t size = (*sizes_)[id];
+                if (offset >= size) {
+                    written_.erase(position);
+                    ++position;
+                    offset = 0;
+                    continue;
+                }
+                const auto &extents = (*extents_)[id];
+                if (!extents.empty()) {
+                    const auto start = common::Extents::dataAt(extents, offset, size).first;
+                    if (start > offset) {
+                        holes += start - offset;
+                        offset = start;
+                        continue;
+                    }
+                }
+                const auto file = written_.find(position);
+                if (file == written_.end()) break;
+                auto &ranges = file->second;
+                auto it = ranges.upper_bound(offset);
+                if (it == ranges.begin()) break;
+                --it;
+                if (it->second <= offset) break;
+                offset = it->second;
+                ranges.erase(ranges.begin(), std::next(it));
+            }
+            return holes;
+        }
+
+        //every chunk from the prefix on that still has unwritten data, as retry requests
+        std::vector<common::ChunkDigest> missing(const uint32_t position, const uint64_t offset) const {
+            std::vector<common::ChunkDigest> chunks;
+            for (uint32_t pos = position; pos < sizes_->size(); ++pos) {
+                const uint32_t id = order_->idAt(pos);
+                const uint64_t size = (*sizes_)[id];
+                const auto &extents = (*extents_)[id];
+                const auto file = written_.find(pos);
+                uint64_t from = pos == position ? offset : 0;
+                while (from < size) {
+                    const uint64_t chunk = from - from % common::CHUNK_SIZE;
+                    const uint64_t chunkEnd = std::min(chunk + common::CHUNK_SIZE, size);
+                    if (hasGap(file == written_.end() ? nullptr : &file->second, extents, from, chunkEnd, size)) {
+                        chunks.push_back(common::ChunkDigest{
+                            .fileId = id,
+                            .offset = chunk,
+                            .len = static_cast<uint32_t>(chunkEnd - chunk)
+                        });
+                    }
+                    from = chunkEnd;
+                }
+            }
+            return chunks;
+        }
+
+    private:
+        //true if some data byte of [from, to) is neither a hole nor written
+        static bool hasGap(const std::map<uint64_t, uint64_t> *ranges, const common::ExtentMap &extents,
+                           uint64_t from, const uint64_t to, const uint64_t size) {
+            while (from < to) {
+                if (!extents.empty()) {
+                    const auto [start, end] = common::Extents::dataAt(extents, from, size);
+                    if (start >= to) return false;
+                    from = start;
+                }
+                if (!ranges) return true;
+                auto it = ranges->upper_bound(from);
+                if (it == ranges->begin()) return true;
+                --it;
+                if (it->second <= from) return true;
+                from = it->second;
+            }
+            return false;
+        }
+    };
+}
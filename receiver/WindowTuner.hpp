@@ -0,0 +1,98 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <spdlog/spdlog.h>
+
+#include "../common/Utils.hpp"
+
+namespace receiver {
+    //where auto-tuned receive windows start when the window flags were left at their defaults
+    inline static constexpr int64_t AUTO_INITIAL_CONN_WINDOW = 16LL * 1024 * 1024;
+    inline static constexpr int64_t AUTO_INITIAL_STREAM_WINDOW = 8LL * 1024 * 1024;
+
+    //sizes the QUIC receive windows. lsquic exposes no per-connection setter and QUIC cannot take credit back,
+    //so the windows only ever grow: lsquic's autotuner doubles a window whenever updates go out within two RTTs
+    //of each other, i.e. while we keep reading. the disk writer runs inside on_read, so a slow disk stops the
+    //growth by itself. what we own is where the windows start, the ceiling the budget allows, and watching the
+    //measured bandwidth-delay product against that ceiling
+    class WindowTuner {
+        //a window update takes an RTT to land, so twice the BDP keeps the sender from running dry meanwhile
+        inline static constexpr double BDP_HEADROOM = 2.0;
+        //a window-limited path delivers about one window per RTT
+        inline static constexpr double LIMITED_FRACTION = 0.9;
+        //share of wall time spent writing above which the disk, not the window, sets the pace
+        inline static constexpr double WRITER_BOUND_FRACTION = 0.8;
+        inline static constexpr double RATE_ALPHA = 0.3;
+
+        int64_t ceiling_ = 0;
+        double deliveryRate_ = 0.0;
+        uint64_t lastBytes_ = 0;
+        uint64_t lastWriteUs_ = 0;
+        bool writerBound_ = false;
+        std::chrono::steady_clock::time_point lastTime_{};
+        uint64_t target_ = 0;
+        bool warned_ = false;
+
+    public:
+        struct Windows {
+            int64_t initConn;
+            int64_t initStream;
+            int64_t maxConn;
+            int64_t maxStream;
+        };
+
+        //budget is global: every connection of this receiver gets an equal share of it
+        static Windows plan(const bool autoWindow, const bool explicitWindows, const int64_t conn,
+                            const int64_t stream, const int64_t budget, const size_t connections = 1) {
+            if (!autoWindow) return {conn, stream, conn * 2, stream * 2};
+            const int64_t share = budget / static_cast<int64_t>(std::max<size_t>(connections, 1));
+            const int64_t initConn = std::min(explicitWindows ? conn : AUTO_INITIAL_CONN_WINDOW, share);
+            const int64_t initStream = std::min(explicitWindows ? stream : AUTO_INITIAL_STREAM_WINDOW, initConn);
+            //nearly all of a connection's bytes ride on its one data stream, so it may use the whole share
+            return {initConn, initStream, share, share};
+        }
+
+        void setCeiling(const int64_t ceiling) {
+            ceiling_ = ceiling;
+        }
+
+        //called about once a second on the data plane with the bytes delivered so far, lsquic's smoothed RTT
+        //and the total time the disk writer has spent so far
+        void observe(const uint64_t bytesMoved, const uint32_t rttUs, const uint64_t writeUs) {
+            const auto now = std::chrono::steady_clock::now();
+            if (lastTime_.time_since_epoch().count() != 0 && bytesMoved >= lastBytes_) {
+                const double seconds = std::chrono::duration<double>(now - lastTime_).count();
+                if (seconds > 1e-3) {
+                    const double rate = static_cast<double>(bytesMoved - lastBytes_) / seconds;
+                    deliveryRate_ = deliveryRate_ == 0.0 ? rate : RATE_ALPHA * rate + (1 - RATE_ALPHA) * deliveryRate_;
+                    writerBound_ = static_cast<double>(writeUs - lastWriteUs_) / 1e6 >= WRITER_BOUND_FRACTION * seconds;
+                }
+            }
+            lastBytes_ = bytesMoved;
+            lastWriteUs_ = writeUs;
+            lastTime_ = now;
+            if (rttUs == 0 || deliveryRate_ == 0.0) return;
+
+            const double bdp = deliveryRate_ * rttUs / 1e6;
+            target_ = static_cast<uint64_t>(BDP_HEADROOM * bdp);
+            //a busy writer stops reading, which already holds the window back; that is not the budget's doing
+            if (!warned_ && !writerBound_ && ceiling_ > 0 && bdp >= LIMITED_FRACTION * static_cast<double>(ceiling_)) {
+                warned_ = true;
+                spdlog::warn("Receive window budget {} is what limits this path (bandwidth-delay product {}); "
+                             "raise --window-budget-bytes if memory allows",
+                             common::Utils::sizeToReadableFormat(static_cast<double>(ceiling_)),
+                             common::Utils::sizeToReadableFormat(bdp));
+            }
+        }
+
+        //window the path needs right now, 0 until there is a measurement
+        uint64_t target() const {
+            return target_;
+        }
+
+        bool writerBound() const {
+            return writerBound_;
+        }
+    };
+}
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <algorithm>
 #include <CLI/App.hpp>
 #include <CLI/Validators.hpp>
 #include <spdlog/spdlog.h>
@@ -22,6 +23,30 @@ namespace sender {
         inline static std::int64_t quicConnWindowBytes = 256LL * 1024 * 1024;
         inline static int udpBufferBytes = 8 * 1024 * 1024;
 
+        inline static bool merkle = false;
+        inline static bool directIo = false;
+        inline static std::string sendOrder = "name";
+        //0 picks one engine per core, capped by MAX_ENGINE_SHARDS
+        inline static int engineShards = 0;
+        inline static int workerThreads = 0;
+        inline static bool pinWorkers = false;
+        //JSON lines of connection stats; empty = off, "-" = stderr
+        inline static std::string statsJson;
+        inline static std::string congestionControl = "bbr";
+        inline static bool pmtud = true;
+        inline static int basePlpmtu = 0;
+        inline static int maxPlpmtu = 0;
+        inline static bool fec = false;
+        //ICE components per receiver; more than one stripes file data across every pair that connects
+        inline static int multipath = 1;
+        //QUIC connections per receiver over the same route, each on its own engine shard
+        inline static int connections = 1;
+
+        //ICE components gathered per receiver
+        static int components() {
+            return std::max(multipath, connections);
+        }
+
         static void initialize(CLI::App* app) {
 
             const auto isWsUrl = CLI::Validator(
@@ -99,15 +124,93 @@ namespace sender {
                     ->check(CLI::Range(256 * 1024, 256 * 1024 * 1024))
                     ->capture_default_str();
 
+            app->add_flag("--merkle", merkle,
+                          "Hash every chunk before sealing the manifest so resuming receivers can verify data they already have");
+
+            app->add_flag("--direct-io", directIo,
+                          "Bypass the page cache for file data (O_DIRECT). Useful for transfers larger than RAM");
+
+            app->add_option("--send-order", sendOrder,
+                            "Order files are streamed in: name, inode, or physical (on-disk offset, for HDD pools)")
+                    ->check(CLI::IsMember({"name", "inode", "physical"}))
+                    ->capture_default_str();
+
+            app->add_option("--engine-shards", engineShards,
+                            "QUIC engines run on separate threads, each owning a share of the receivers. 0 = one per core")
+                    ->check(CLI::Range(0, 64))
+                    ->capture_default_str();
+
+            app->add_option("--worker-threads", workerThreads,
+                            "Threads for hashing, verification and file opens. 0 = one per core")
+                    ->check(CLI::Range(0, 256))
+                    ->capture_default_str();
+
+            app->add_flag("--pin-workers", pinWorkers, "Pin each worker thread to its own core");
+
+            app->add_option("--cc", congestionControl,
+                            "Congestion control: cubic, bbr, adaptive (lsquic picks by RTT), or auto (learn the best per path from earlier receivers)")
+                    ->check(CLI::IsMember({"cubic", "bbr", "adaptive", "auto"}))
+                    ->capture_default_str();
+
+            app->add_flag("--pmtud,!--no-pmtud", pmtud,
+                          "Probe the path MTU (DPLPMTUD) so links with jumbo frames carry larger QUIC packets")
+                    ->capture_default_str();
+
+            app->add_option("--base-plpmtu", basePlpmtu,
+                            "QUIC packet size to start from before probing (bytes). 0 = lsquic default")
+                    ->check(CLI::Range(0, 65527))
+                    ->capture_default_str();
+
+            app->add_option("--max-plpmtu", maxPlpmtu,
+                            "Largest QUIC packet size to probe for (bytes), e.g. 8952 on a 9000 MTU link. 0 = from the local interfaces")
+                    ->check(CLI::Range(0, 65527))
+                    ->capture_default_str();
+
+            app->add_flag("--fec", fec,
+                          "Send file data as QUIC datagrams protected by Reed-Solomon forward error correction instead of one ordered stream. Helps on lossy, high-RTT paths");
+
+            app->add_option("--multipath", multipath,
+                            "Open up to N ICE paths per receiver (e.g. two NICs, or wired plus LTE) and stripe chunks across them by live throughput")
+                    ->check(CLI::Range(1, 8))
+                    ->capture_default_str();
+
+            app->add_option("--connections", connections,
+                            "Open N parallel QUIC connections per receiver over the same route, each on its own engine thread, so one transfer is not capped by one core's crypto")
+                    ->check(CLI::Range(1, 16))
+                    ->capture_default_str();
+
+            app->add_option("--stats-json", statsJson,
+                            "Write RTT, cwnd, loss, flow-control stalls and disk latency once a second as JSON lines to this file (- for stderr), plus a summary per connection");
+
             app->set_version_flag("--version", "Thruflux v0.3.0");
 
             app->parse_complete_callback([&]() {
 
+                if ((basePlpmtu != 0 && basePlpmtu < 1200) || (maxPlpmtu != 0 && maxPlpmtu < 1200)) {
+                    throw CLI::ValidationError("--base-plpmtu/--max-plpmtu", "must be 0 or at least 1200");
+                }
+
+                if (basePlpmtu != 0 && maxPlpmtu != 0 && basePlpmtu > maxPlpmtu) {
+                    throw CLI::ValidationError("--base-plpmtu", "must be <= --max-plpmtu");
+                }
+
                 if (quicConnWindowBytes < quicStreamWindowBytes) {
                     throw CLI::ValidationError("--quic-conn-window-bytes",
                                                "must be >= --quic-stream-window-bytes");
                 }
 
+                if (fec && multipath > 1) {
+                    throw CLI::ValidationError("--multipath", "cannot be combined with --fec");
+                }
+
+                if (fec && connections > 1) {
+                    throw CLI::ValidationError("--connections", "cannot be combined with --fec");
+                }
+
+                if (multipath > 1 && connections > 1) {
+                    throw CLI::ValidationError("--connections", "cannot be combined with --multipath");
+                }
+
                 if (udpBufferBytes < 1024 * 1024) {
                     spdlog::warn("udp-buffer-bytes is < 1MiB; this may limit throughput");
                 }
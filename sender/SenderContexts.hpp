@@ -2,16 +2,66 @@
 #include <indicators/dynamic_progress.hpp>
 #include "../common/Contexts.hpp"
 #include "../common/Stream.hpp"
+#include "../common/DiskIO.hpp"
+#include "../common/Fec.hpp"
+#include "../common/Integrity.hpp"
+#include "../common/Merkle.hpp"
+#include "../common/SendOrder.hpp"
+#include "../common/Stripe.hpp"
+#include "../common/ThreadManager.hpp"
+#include "SenderConfig.hpp"
 #include <llfio/llfio.hpp>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <functional>
+#include <unordered_set>
 
 namespace sender {
+    //readahead covers this much of the current send rate, within the bounds below
+    inline static constexpr double READAHEAD_SECONDS = 0.25;
+    inline static constexpr uint64_t READAHEAD_MIN = 4 * 1024 * 1024;
+    inline static constexpr uint64_t READAHEAD_MAX = 256 * 1024 * 1024;
+    //pages within this distance behind the slowest receiver are kept for its in flight reads
+    inline static constexpr uint64_t DROP_BEHIND_SLACK = 16 * 1024 * 1024;
+    //fully passed files smaller than this are left to the kernel rather than reopened just to drop them
+    inline static constexpr uint64_t DROP_BEHIND_MIN_FILE = 8 * 1024 * 1024;
+    //upcoming files opened on the worker pool so small-file runs don't stall on open()
+    inline static constexpr uint32_t OPEN_AHEAD_FILES = 8;
+    //--merkle: bytes of consecutive chunks one hashing job covers
+    inline static constexpr uint64_t HASH_JOB_BYTES = 64 * 1024 * 1024;
+    //upper bound on automatically chosen QUIC engine shards
+    inline static constexpr size_t MAX_ENGINE_SHARDS = 8;
+    //with --cc auto, how long a connection moves data before its goodput and loss count for its algorithm
+    inline static constexpr double CC_PROBE_SECONDS = 5.0;
+    //multipath: a lane's units hold about this much of its own recent send rate, so a slow path never sits on
+    //a large share of the tail; bounds below
+    inline static constexpr double STRIPE_UNIT_SECONDS = 0.25;
+    inline static constexpr uint64_t STRIPE_MIN_UNIT = 256 * 1024;
+
     struct FileInfo {
         uint32_t id;
         uint64_t size;
         std::string path;
         std::string relativePath;
+        //data extents of a sparse file; empty for dense files
+        common::ExtentMap extents;
     };
 
+    //one receiver bar as the progress reporter draws it; taken from the session's published counters
+    struct BarSnapshot {
+        enum State { STARTING, RUNNING, DONE, FAILED };
+        size_t bar = 0;
+        State state = RUNNING;
+        double rate = 0.0;
+        uint64_t sent = 0;
+        uint64_t logical = 0;
+        uint64_t resumed = 0;
+        int files = 0;
+        bool relayed = false;
+    };
 
     struct SenderPersistentContext {
         std::string joinCode;
@@ -22,6 +72,10 @@ namespace sender {
         std::list<std::unique_ptr<indicators::ProgressBar> > progressBarsStorage;
         indicators::DynamicProgress<indicators::ProgressBar> progressBars;
         common::FileHandleCache cache;
+        std::unique_ptr<indicators::ProgressBar> scannerBar;
+        //final state of the bars whose connection closed, handed from the data plane to the progress reporter
+        std::mutex closedBarsMutex;
+        std::vector<BarSnapshot> closedBars;
 
 
         SenderPersistentContext() {
@@ -31,15 +85,150 @@ namespace sender {
         std::vector<uint64_t> fileChunkBase;
         uint64_t totalChunks = 0;
         std::atomic<int> receiversCount{0};
+        //receivers that still hold this exact manifest from an earlier run get a reference to it instead
+        common::Digest128 manifestHash{};
+        std::unordered_set<std::string> manifestCachedBy;
+        common::MerkleTree merkle;
+        common::SendOrder sendOrder;
+
+        const FileInfo &fileAt(const size_t position) const {
+            return files[sendOrder.idAt(position)];
+        }
 
+        //a whole chunk read back unchanged is already hashed: its merkle leaf is its digest
+        std::optional<common::Digest128> leafFor(const uint32_t id, const uint64_t offset, const uint64_t len) const {
+            if (merkle.leaves.empty() || id >= files.size() || offset % common::CHUNK_SIZE != 0) return std::nullopt;
+            if (len != std::min<uint64_t>(common::CHUNK_SIZE, files[id].size - offset)) return std::nullopt;
+            return merkle.leaves[fileChunkBase[id] + offset / common::CHUNK_SIZE];
+        }
+        size_t droppedFileIndex = 0;
+        uint64_t droppedOffset = 0;
+        std::mutex dropMutex;
+
+        //evicts pages that every active receiver has already read past; a shard that finds another one
+        //already dropping simply skips its turn
+        void dropPagesBefore(const size_t fileIndex, const uint64_t offset) {
+            if (cache.directIo) return;
+            std::unique_lock lock(dropMutex, std::try_to_lock);
+            if (!lock.owns_lock()) return;
+
+            while (droppedFileIndex < fileIndex && droppedFileIndex < files.size()) {
+                const auto &f = fileAt(droppedFileIndex);
+                const uint64_t rest = f.size > droppedOffset ? f.size - droppedOffset : 0;
+                if (rest > 0 && (cache.isOpen(f.id) || f.size >= DROP_BEHIND_MIN_FILE)) {
+                    if (auto *handle = cache.acquire(f.id)) {
+                        common::DiskIO::adviseDontNeed(*handle, droppedOffset, rest);
+                        cache.release(f.id);
+                    }
+                }
+                ++droppedFileIndex;
+                droppedOffset = 0;
+            }
+
+            if (droppedFileIndex != fileIndex || droppedFileIndex >= files.size()) return;
+            if (offset < droppedOffset + 2 * DROP_BEHIND_SLACK) return;
+
+            const auto &f = fileAt(droppedFileIndex);
+            const uint64_t upTo = offset - DROP_BEHIND_SLACK;
+            if (auto *handle = cache.acquire(f.id)) {
+                common::DiskIO::adviseDontNeed(*handle, droppedOffset, upTo - droppedOffset);
+                cache.release(f.id);
+            }
+            droppedOffset = upTo;
+        }
 
-        void buildManifest(const std::vector<std::string> &paths) {
+        struct HashProgress {
+            std::atomic<size_t> jobsLeft{0};
+            std::atomic<uint64_t> hashedBytes{0};
+            std::atomic<bool> failed{false};
+            std::mutex printMutex;
+            std::chrono::steady_clock::time_point lastPrint{};
+            std::function<void(bool)> done;
+        };
+
+        //hashes every chunk across the pool in runs of about HASH_JOB_BYTES, so one large file spreads over every
+        //worker and small files share a job. nothing waits on the jobs: the last one to finish runs done on its
+        //own worker. the leaves stay cached for every receiver of this session
+        void hashChunks(std::function<void(bool)> done) {
+            merkle.leaves.assign(totalChunks, {});
+
+            struct Range {
+                uint32_t id;
+                uint64_t from;
+                uint64_t to;
+            };
+            auto progress = std::make_shared<HashProgress>();
+            progress->done = std::move(done);
+
+            std::vector<std::vector<Range> > jobs(1);
+            uint64_t jobBytes = 0;
+            for (const auto &f: files) {
+                for (uint64_t off = 0; off < f.size;) {
+                    const uint64_t room = std::max<uint64_t>(HASH_JOB_BYTES - jobBytes, common::CHUNK_SIZE);
+                    const uint64_t to = std::min(f.size, off + common::Utils::ceilDiv(room, common::CHUNK_SIZE) *
+                                                          common::CHUNK_SIZE);
+                    jobs.back().push_back({f.id, off, to});
+                    jobBytes += to - off;
+                    off = to;
+                    if (jobBytes >= HASH_JOB_BYTES) {
+                        jobs.emplace_back();
+                        jobBytes = 0;
+                    }
+                }
+            }
+            if (jobs.back().empty()) jobs.pop_back();
+
+            scannerBar->set_option(indicators::option::PrefixText{"Hashing chunks... "});
+            progress->jobsLeft = jobs.size();
+            for (auto &ranges: jobs) {
+                common::ThreadManager::postWork([this, progress, ranges = std::move(ranges)]() {
+                    for (const auto &r: ranges) {
+                        uint64_t leaf = fileChunkBase[r.id] + r.from / common::CHUNK_SIZE;
+                        for (uint64_t off = r.from; off < r.to && !progress->failed.load(); off += common::CHUNK_SIZE,
+                             ++leaf) {
+                            const auto len = static_cast<uint32_t>(std::min<uint64_t>(common::CHUNK_SIZE, r.to - off));
+                            const auto digest = common::Integrity::digestFileRange(cache, r.id, false, off, len);
+                            if (!digest.has_value()) {
+                                spdlog::error("Failed to hash {} at offset {}", files[r.id].path, off);
+                                progress->failed.store(true);
+                                break;
+                            }
+                            merkle.leaves[leaf] = digest.value();
+                            progress->hashedBytes += len;
+                        }
+                        printHashProgress(*progress);
+                    }
+                    if (progress->jobsLeft.fetch_sub(1) != 1) return;
+                    if (progress->failed.load()) merkle = {};
+                    progress->done(!progress->failed.load());
+                }, common::WorkStage::HASH);
+            }
+        }
+
+        //whichever worker gets here first after the interval prints; the rest skip
+        void printHashProgress(HashProgress &progress) {
+            std::unique_lock lock(progress.printMutex, std::try_to_lock);
+            if (!lock.owns_lock()) return;
+            const auto now = std::chrono::steady_clock::now();
+            if (now - progress.lastPrint < std::chrono::milliseconds(250)) return;
+            progress.lastPrint = now;
+            scannerBar->set_option(indicators::option::PostfixText{
+                common::Utils::sizeToReadableFormat(progress.hashedBytes.load()) + " / " +
+                common::Utils::sizeToReadableFormat(totalExpectedBytes)
+            });
+            scannerBar->print_progress();
+        }
+
+
+        //catalogs on the calling worker; with --merkle the chunks are hashed across the pool and whichever worker
+        //finishes last seals the manifest. then runs on the data plane once the manifest is sealed
+        void buildManifest(const std::vector<std::string> &paths, std::function<void()> then) {
             files.clear();
 
             std::uint64_t totalSize = 0;
             int filesCount = 0;
 
-            indicators::ProgressBar scannerBar{
+            scannerBar = std::make_unique<indicators::ProgressBar>(
                 indicators::option::BarWidth{0},
                 indicators::option::Start{""},
                 indicators::option::End{""},
@@ -47,7 +236,7 @@ namespace sender {
                 indicators::option::PrefixText{"Cataloging... "},
                 indicators::option::PostfixText{"0 file(s), 0 B"},
                 indicators::option::ForegroundColor{indicators::Color::white}
-            };
+            );
 
             for (auto &path: paths) {
                 std::filesystem::path root(path);
@@ -72,8 +261,8 @@ namespace sender {
                     if (filesCount % 1000 == 0) {
                         std::string stats = std::to_string(filesCount) + " file(s), " +
                                             common::Utils::sizeToReadableFormat(totalSize);
-                        scannerBar.set_option(indicators::option::PostfixText{stats});
-                        scannerBar.print_progress();
+                        scannerBar->set_option(indicators::option::PostfixText{stats});
+                        scannerBar->print_progress();
                     }
                 } else {
                     for (const auto &entry: std::filesystem::recursive_directory_iterator(root)) {
@@ -97,8 +286,8 @@ namespace sender {
                                 std::string stats =
                                         std::to_string(filesCount) + " file(s), " + common::Utils::sizeToReadableFormat(
                                             totalSize);
-                                scannerBar.set_option(indicators::option::PostfixText{stats});
-                                scannerBar.print_progress();
+                                scannerBar->set_option(indicators::option::PostfixText{stats});
+                                scannerBar->print_progress();
                             }
                         }
                     }
@@ -116,18 +305,67 @@ namespace sender {
 
             cache.reset(files.size());
             for (auto &f: files) cache.registerPath(f.id, f.path);
+            cache.directIo = SenderConfig::directIo;
 
 
             std::string stats = std::to_string(filesCount) + " file(s), " + common::Utils::sizeToReadableFormat(
                                     totalSize);
-            scannerBar.set_option(indicators::option::PrefixText{"Encoding Manifest... "});
-            scannerBar.set_option(indicators::option::PostfixText{stats});
-            scannerBar.print_progress();
+            scannerBar->set_option(indicators::option::PrefixText{"Encoding Manifest... "});
+            scannerBar->set_option(indicators::option::PostfixText{stats});
+            scannerBar->print_progress();
 
 
             totalExpectedBytes = totalSize;
             totalExpectedFilesCount = filesCount;
 
+            fileChunkBase.resize(files.size());
+            totalChunks = 0;
+            for (const auto &f: files) {
+                fileChunkBase[f.id] = totalChunks;
+                totalChunks += common::Utils::ceilDiv(f.size, common::CHUNK_SIZE);
+            }
+
+            //holes are skipped on the wire, so only data extents cost transfer time
+            uint64_t holeBytes = 0;
+            for (auto &f: files) {
+                if (!common::DiskIO::mayBeSparse(f.path, f.size)) continue;
+                auto extents = common::DiskIO::dataExtents(f.path);
+                if (!extents.has_value()) continue;
+                const uint64_t dataBytes = common::Extents::dataBytes(extents.value());
+                if (dataBytes >= f.size) continue;
+                holeBytes += f.size - dataBytes;
+                f.extents = std::move(extents.value());
+            }
+            if (holeBytes > 0) {
+                spdlog::info("Sparse files detected: {} of holes will not be sent",
+                             common::Utils::sizeToReadableFormat(holeBytes));
+            }
+
+            sendOrder = {};
+            if (SenderConfig::sendOrder != "name") {
+                computeSendOrder(*scannerBar);
+            }
+
+            merkle = {};
+            if (!SenderConfig::merkle || totalChunks == 0) {
+                sealManifest();
+                common::ThreadManager::postTask(std::move(then));
+                return;
+            }
+            hashChunks([this, then = std::move(then)](const bool ok) mutable {
+                if (!ok) spdlog::warn("Chunk hashing failed; the manifest will be sealed without chunk digests");
+                sealManifest();
+                common::ThreadManager::postTask(std::move(then));
+            });
+        }
+
+        void sealManifest() {
+            scannerBar->set_option(indicators::option::PrefixText{"Encoding Manifest... "});
+            scannerBar->set_option(indicators::option::PostfixText{
+                std::to_string(totalExpectedFilesCount) + " file(s), " +
+                common::Utils::sizeToReadableFormat(totalExpectedBytes)
+            });
+
             size_t estimatedSize = 4;
             for (const auto &f: files) estimatedSize += (14 + f.relativePath.size());
             manifestBlob.clear();
@@ -149,17 +387,69 @@ namespace sender {
                 p += nl;
             }
 
-            fileChunkBase.resize(files.size());
-            totalChunks = 0;
+            if (!merkle.leaves.empty()) {
+                std::vector<uint8_t> section;
+                merkle.encode(section);
+                appendManifestSection(common::MANIFEST_SECTION_MERKLE, section);
+            }
+
+            if (!sendOrder.isIdentity()) {
+                std::vector<uint8_t> section;
+                sendOrder.encode(section);
+                appendManifestSection(common::MANIFEST_SECTION_ORDER, section);
+            }
+
+            std::vector<std::pair<uint32_t, const common::ExtentMap *> > sparseFiles;
             for (const auto &f: files) {
-                fileChunkBase[f.id] = totalChunks;
-                totalChunks += common::Utils::ceilDiv(f.size, common::CHUNK_SIZE);
+                if (!f.extents.empty()) sparseFiles.emplace_back(f.id, &f.extents);
+            }
+            if (!sparseFiles.empty()) {
+                std::vector<uint8_t> section;
+                common::Extents::encode(sparseFiles, section);
+                appendManifestSection(common::MANIFEST_SECTION_EXTENTS, section);
+            }
+
+            manifestHash = common::Hash::digest(manifestBlob.data(), manifestBlob.size());
+
+            scannerBar->set_option(indicators::option::PrefixText{"Manifest Sealed. "});
+            scannerBar->mark_as_completed();
+        }
+
+
+        //walks files in on-disk order to cut seeks on spinning disks; ids stay sorted by path for resume
+        void computeSendOrder(indicators::ProgressBar &scannerBar) {
+            scannerBar.set_option(indicators::option::PrefixText{"Mapping disk layout... "});
+            scannerBar.print_progress();
+
+            const bool physical = SenderConfig::sendOrder == "physical";
+            std::vector<common::DiskIO::Placement> keys(files.size());
+            for (const auto &f: files) {
+                const auto key = physical ? common::DiskIO::physicalPlacement(f.path) : std::nullopt;
+                keys[f.id] = key.has_value() ? key.value() : common::DiskIO::inodePlacement(f.path);
             }
 
-            scannerBar.set_option(indicators::option::PrefixText{"Manifest Sealed. "});
-            scannerBar.mark_as_completed();
+            std::vector<uint32_t> order(files.size());
+            for (uint32_t i = 0; i < order.size(); ++i) order[i] = i;
+            std::stable_sort(order.begin(), order.end(), [&keys](const uint32_t a, const uint32_t b) {
+                return keys[a] < keys[b];
+            });
+            sendOrder.assign(std::move(order));
         }
 
+        void appendManifestSection(const uint8_t tag, const std::vector<uint8_t> &section) {
+            const uint64_t sectionLen = section.size();
+            const size_t base = manifestBlob.size();
+            manifestBlob.resize(base + common::MANIFEST_SECTION_HEADER_SIZE + section.size());
+            manifestBlob[base] = tag;
+            memcpy(manifestBlob.data() + base + 1, &sectionLen, 8);
+            memcpy(manifestBlob.data() + base + common::MANIFEST_SECTION_HEADER_SIZE, section.data(), section.size());
+        }
+
+        void noteCachedManifests(const std::string &receiverId, const std::vector<std::string> &cached) {
+            if (std::ranges::find(cached, common::Hash::toHex(manifestHash)) != cached.end()) {
+                manifestCachedBy.insert(receiverId);
+            }
+        }
 
         int addNewProgressBar(std::string prefix) {
             progressBarsStorage.push_back(common::Utils::createProgressBarUniquePtr(std::move(prefix)));
@@ -171,29 +461,272 @@ namespace sender {
     inline SenderPersistentContext senderPersistentContext;
 
 
+    //multipath: hands the send order out from the resume point in units that never cross a chunk; units a lost
+    //lane was still sending come back and go out first. lanes on other shards share it, hence the lock
+    class StripeScheduler {
+        mutable std::mutex mutex_;
+        uint32_t position_ = 0;
+        uint64_t offset_ = 0;
+        std::deque<common::StripeUnit> returned_;
+        //starts of the units out on some path
+        std::multiset<std::pair<uint32_t, uint64_t> > inFlight_;
+
+        //past empty files and leading holes; returns the hole bytes passed. caller holds mutex_
+        uint64_t skipEmpty() {
+            auto &p = senderPersistentContext;
+            uint64_t holes = 0;
+            while (position_ < p.files.size()) {
+                const auto &f = p.fileAt(position_);
+                if (!f.extents.empty() && offset_ < f.size) {
+                    const auto start = common::Extents::dataAt(f.extents, offset_, f.size).first;
+                    holes += start - offset_;
+                    offset_ = start;
+                }
+                if (offset_ < f.size) break;
+                ++position_;
+                offset_ = 0;
+                for (size_t pos = position_; pos < std::min<size_t>(p.files.size(), position_ + OPEN_AHEAD_FILES); ++pos) {
+                    if (!p.cache.prefetch(p.sendOrder.idAt(pos))) break;
+                }
+            }
+            return holes;
+        }
+
+    public:
+        void reset(const uint32_t position, const uint64_t offset) {
+            std::lock_guard lock(mutex_);
+            position_ = position;
+            offset_ = offset;
+            returned_.clear();
+            inFlight_.clear();
+        }
+
+        std::optional<common::StripeUnit> next(const uint64_t maxLen, uint64_t &holes) {
+            std::lock_guard lock(mutex_);
+            if (!returned_.empty()) {
+                const auto unit = returned_.front();
+                returned_.pop_front();
+                inFlight_.emplace(unit.position, unit.offset);
+                return unit;
+            }
+            holes += skipEmpty();
+            if (position_ >= senderPersistentContext.files.size()) return std::nullopt;
+            const uint64_t size = senderPersistentContext.fileAt(position_).size;
+            const uint64_t chunkEnd = offset_ - offset_ % common::CHUNK_SIZE + common::CHUNK_SIZE;
+            const common::StripeUnit unit{position_, offset_, std::min({offset_ + maxLen, chunkEnd, size})};
+            offset_ = unit.end;
+            inFlight_.emplace(unit.position, unit.offset);
+            return unit;
+        }
+
+        void done(const common::StripeUnit &unit) {
+            std::lock_guard lock(mutex_);
+            if (const auto it = inFlight_.find({unit.position, unit.offset}); it != inFlight_.end()) inFlight_.erase(it);
+        }
+
+        void giveBack(const common::StripeUnit &unit) {
+            std::lock_guard lock(mutex_);
+            if (const auto it = inFlight_.find({unit.position, unit.offset}); it != inFlight_.end()) inFlight_.erase(it);
+            returned_.push_front(unit);
+        }
+
+        //every unit handed out and through; only true once next() has walked off the end
+        bool drained() const {
+            std::lock_guard lock(mutex_);
+            return returned_.empty() && inFlight_.empty() && position_ >= senderPersistentContext.files.size();
+        }
+
+        //the earliest data not yet through on any path
+        std::pair<size_t, uint64_t> low() const {
+            std::lock_guard lock(mutex_);
+            std::pair<size_t, uint64_t> at{position_, offset_};
+            if (!inFlight_.empty()) at = std::min<std::pair<size_t, uint64_t> >(at, *inFlight_.begin());
+            for (const auto &unit: returned_) at = std::min<std::pair<size_t, uint64_t> >(at, {unit.position, unit.offset});
+            return at;
+        }
+    };
+
+
+    struct SenderConnectionContext;
+
+    //multipath / parallel connections: what a session's paths share. lanes run on their own engine shards and
+    //may outlive the session's connection, so this is reference counted; connection contexts in it are only
+    //dereferenced on their own shard (see SenderStream::onPath)
+    struct StripeSession {
+        StripeScheduler stripes;
+        std::atomic<bool> striped{false};
+        std::atomic<bool> finished{false};
+        //set once the session's connection is gone; its lanes then wind down
+        std::atomic<bool> closed{false};
+        //bytes the lanes moved, shown as part of the session
+        std::atomic<uint64_t> bytesMoved{0};
+        std::atomic<uint64_t> logicalBytesMoved{0};
+        std::mutex mutex;
+        SenderConnectionContext *primary = nullptr;
+        std::vector<SenderConnectionContext *> lanes;
+    };
+
+
+    struct SenderStreamContext;
+
     //1 connection = 1 transfer = 1 receiver
     struct SenderConnectionContext : common::ConnectionContext {
         std::string receiverId;
         bool manifestStreamCreated = false;
         bool dataStreamCreated = false;
-        size_t currentFileIndex = 0;
-        uint64_t currentFileOffset = 0;
+        //position in send order of the file being streamed
+        //position and offset of the data stream; read by other engine shards for drop-behind
+        std::atomic<size_t> currentFileIndex = 0;
+        std::atomic<uint64_t> currentFileOffset = 0;
         bool manifestCreated = false;
         size_t manifestSent = 0;
+        bool manifestByReference = false;
         size_t progressBarIndex = 0;
         std::vector<uint8_t> ackBuf;
-        uint64_t logicalBytesMoved = 0;
+        std::atomic<uint64_t> logicalBytesMoved = 0;
         uint64_t lastLogicalBytesMoved = 0;
-        uint32_t resumeFileId = 0;
+        //position in send order, see common::SendOrder
+        uint32_t resumePosition = 0;
         uint64_t resumeOffset = 0;
+        bool integrityStreamCreated = false;
+        bool digestsEnded = false;
+        //digests of this session still hashing on the pool; lanes count theirs here too
+        std::atomic<uint32_t> digestsPending = 0;
+        //hash completions check this on the connection's shard, since the context is deleted there
+        std::shared_ptr<bool> alive = std::make_shared<bool>(true);
+        common::IntegrityChannel integrity;
+        uint64_t lastDropCheckBytes = 0;
+        bool ccProbed = false;
+        //--fec: file data travels as datagrams; the data stream only carries its tag and the final FIN
+        bool fecActive = false;
+        bool fecReadAll = false;
+        bool fecFinished = false;
+        common::FecEncoder fec;
+        lsquic_stream_t *dataStream = nullptr;
+        SenderStreamContext *dataCtx = nullptr;
+        std::chrono::steady_clock::time_point fecLastAck{};
+        //multipath / parallel connections: lanes are extra connections to the same receiver that only carry a
+        //stripe stream. the first connection keeps the manifest and integrity streams; all of them share one
+        //StripeSession, which is null for a session with a single path
+        bool lane = false;
+        std::shared_ptr<StripeSession> stripeSession;
+        //bytes this connection itself wrote into its stripe stream, and the rate that makes of them
+        uint64_t laneBytes = 0;
+        uint64_t laneSampleBytes = 0;
+        std::chrono::steady_clock::time_point laneSampleTime{};
+        double laneRate = 0.0;
+
+        bool striped() const {
+            return stripeSession && stripeSession->striped;
+        }
+
+        //counts file data toward the session; a lane's land in the shared totals
+        void addMoved(const uint64_t bytes, const uint64_t logical) {
+            if (lane) {
+                stripeSession->bytesMoved += bytes;
+                stripeSession->logicalBytesMoved += logical;
+                bytesMoved += bytes;
+                return;
+            }
+            bytesMoved += bytes;
+            logicalBytesMoved += logical;
+        }
+
+        uint64_t sessionBytesMoved() const {
+            return bytesMoved + (stripeSession ? stripeSession->bytesMoved.load() : 0);
+        }
+
+        uint64_t sessionLogicalBytesMoved() const {
+            return logicalBytesMoved + (stripeSession ? stripeSession->logicalBytesMoved.load() : 0);
+        }
+
+        //where the data still to be sent starts; with stripes, the earliest unit not yet through
+        std::pair<size_t, uint64_t> cursor() const {
+            if (striped()) return stripeSession->stripes.low();
+            return {currentFileIndex.load(), currentFileOffset.load()};
+        }
+
+        int filesDone() const {
+            if (!striped()) return filesMoved;
+            return static_cast<int>(cursor().first - resumePosition);
+        }
+
+        //multipath: the size of the next unit this lane takes, from what it has been sending lately
+        uint64_t unitBudget() {
+            const auto now = std::chrono::steady_clock::now();
+            const double elapsed = std::chrono::duration<double>(now - laneSampleTime).count();
+            if (laneSampleTime.time_since_epoch().count() == 0) {
+                laneSampleTime = now;
+            } else if (elapsed >= 0.1) {
+                const double instant = static_cast<double>(laneBytes - laneSampleBytes) / elapsed;
+                laneRate = laneRate == 0.0 ? instant : 0.3 * instant + 0.7 * laneRate;
+                laneSampleTime = now;
+                laneSampleBytes = laneBytes;
+            }
+            const auto wanted = static_cast<uint64_t>(laneRate * STRIPE_UNIT_SECONDS);
+            return std::clamp<uint64_t>(wanted - wanted % STRIPE_MIN_UNIT, STRIPE_MIN_UNIT, common::CHUNK_SIZE);
+        }
+
+        uint64_t readaheadWindow() const {
+            //a stripe path reads only its own units, so its own rate is what it needs covered
+            const double rate = stripeSession ? laneRate : ewmaThroughput.load();
+            const auto wanted = static_cast<uint64_t>(rate * READAHEAD_SECONDS);
+            return std::clamp(wanted, READAHEAD_MIN, READAHEAD_MAX);
+        }
+
+        void endDigests() {
+            if (digestsEnded) return;
+            digestsEnded = true;
+            //digests still being hashed on the pool queue the end once the last of them lands
+            if (digestsPending.load() == 0) integrity.queueEnd();
+        }
+
+        //a digest hashed off the data plane, delivered on this connection's shard
+        void digestReady(const common::ChunkDigest &digest) {
+            integrity.queue(common::INTEGRITY_CHUNK_DIGEST, digest);
+            if (digestsPending.fetch_sub(1) == 1 && digestsEnded) integrity.queueEnd();
+        }
+
+        //re-reads a chunk the receiver failed to verify and ships it back on the integrity stream
+        bool repairChunk(const common::ChunkDigest &request) {
+            if (request.fileId >= senderPersistentContext.files.size()) return false;
+            const auto &f = senderPersistentContext.files[request.fileId];
+            if (request.offset >= f.size || request.len == 0 || request.len > common::CHUNK_SIZE) return false;
+
+            //repairs are rare and arbitrary ranges, so they go through the buffered handle next to a direct one
+            auto &cache = senderPersistentContext.cache;
+            if (!cache.acquire(f.id)) return false;
+            std::vector<uint8_t> buf(std::min<uint64_t>(request.len, f.size - request.offset));
+            auto *fh = cache.buffered(f.id);
+            const bool read = fh && common::DiskIO::readBuffered(*fh, request.offset, buf.data(), buf.size());
+            cache.release(f.id);
+            if (!read) return false;
+
+            common::ChunkDigest repaired = request;
+            repaired.len = static_cast<uint32_t>(buf.size());
+            repaired.digest = common::Hash::digest(buf.data(), buf.size());
+            integrity.queue(common::INTEGRITY_CHUNK_REPAIR, repaired, buf.data());
+            return true;
+        }
 
+        //ships a block the receiver could not decode over the integrity stream; blocks acked since are ignored
+        void resendFecBlock(const uint64_t seq) {
+            const auto bytes = fec.block(seq);
+            if (bytes.empty()) return;
+            integrity.queue(common::INTEGRITY_FEC_BLOCK, common::ChunkDigest{
+                                .offset = seq,
+                                .len = static_cast<uint32_t>(bytes.size())
+                            }, bytes.data());
+        }
     };
 
     struct SenderStreamContext {
         SenderConnectionContext *connectionContext = nullptr;
         bool typeByteSent = false;
         bool isManifestStream = false;
-        std::vector<uint8_t> readBuf;
+        bool isIntegrityStream = false;
+        //shared with a hash of its contents still running on the pool; fillBuf never reads into a buffer in use
+        std::shared_ptr<common::AlignedBuffer> readBuf = std::make_shared<common::AlignedBuffer>();
         int id = 0;
         uint32_t pinnedFileId = UINT32_MAX;
         llfio::file_handle *pinnedHandle = nullptr;
@@ -202,9 +735,24 @@ namespace sender {
         size_t bufReady = 0;
         size_t bufSent = 0;
         bool eofAll = false;
+        uint64_t advisedUpTo = 0;
+        //multipath: the unit this stream is sending; its end stands in for the file size
+        bool striped = false;
+        bool unitActive = false;
+        common::StripeUnit unit;
+        uint8_t unitHeader[common::STRIPE_HEADER_SIZE];
+        size_t headerSent = 0;
+        //digests of what was read, for SenderStream::forwardDigests to send on the session's integrity stream.
+        //reads without a merkle leaf still need hashing, which happens on the pool
+        std::vector<common::ChunkDigest> digestsOut;
+        struct PendingHash {
+            common::ChunkDigest chunk;
+            std::shared_ptr<const common::AlignedBuffer> data;
+        };
+        std::vector<PendingHash> hashesOut;
 
         void initialize() {
-            if (readBuf.empty()) readBuf.resize(common::CHUNK_SIZE);
+            if (readBuf->empty()) readBuf->resize(common::CHUNK_SIZE);
 
             if (!openCurrentFile()) {
                 eofAll = true;
@@ -222,7 +770,7 @@ namespace sender {
             if (connectionContext->currentFileIndex >= senderPersistentContext.files.size())
                 return false;
 
-            auto &f = senderPersistentContext.files[connectionContext->currentFileIndex];
+            auto &f = senderPersistentContext.fileAt(connectionContext->currentFileIndex);
 
             fileSize = f.size;
             fileOffset = connectionContext->currentFileOffset;
@@ -234,8 +782,44 @@ namespace sender {
                 pinnedFileId = f.id;
                 pinnedHandle = senderPersistentContext.cache.acquire(f.id);
                 if (!pinnedHandle) return false;
+                if (!senderPersistentContext.cache.directIo) common::DiskIO::adviseSequential(*pinnedHandle);
+                advisedUpTo = 0;
+                openAhead();
+            }
+
+            return true;
+        }
+
+        void openAhead() const {
+            auto &p = senderPersistentContext;
+            const size_t end = std::min<size_t>(p.files.size(),
+                                                connectionContext->currentFileIndex + 1 + OPEN_AHEAD_FILES);
+            for (size_t pos = connectionContext->currentFileIndex + 1; pos < end; ++pos) {
+                if (!p.cache.prefetch(p.sendOrder.idAt(pos))) break;
             }
+        }
 
+        bool startUnit(const common::StripeUnit &next) {
+            const auto &f = senderPersistentContext.fileAt(next.position);
+            if (pinnedFileId != f.id) {
+                if (pinnedFileId != UINT32_MAX) senderPersistentContext.cache.release(pinnedFileId);
+                pinnedFileId = f.id;
+                pinnedHandle = senderPersistentContext.cache.acquire(f.id);
+                if (!pinnedHandle) {
+                    pinnedFileId = UINT32_MAX;
+                    return false;
+                }
+                if (!senderPersistentContext.cache.directIo) common::DiskIO::adviseSequential(*pinnedHandle);
+                advisedUpTo = 0;
+            }
+            unit = next;
+            unit.encode(unitHeader);
+            headerSent = 0;
+            fileOffset = next.offset;
+            fileSize = next.end;
+            bufReady = 0;
+            bufSent = 0;
+            unitActive = true;
             return true;
         }
 
@@ -256,27 +840,120 @@ namespace sender {
             if (!pinnedHandle) return false;
             if (fileOffset >= fileSize) return true;
 
-            const size_t len = std::min<uint64_t>(readBuf.size(), fileSize - fileOffset);
+            uint64_t dataEnd = fileSize;
+            const auto &extents = senderPersistentContext.files[pinnedFileId].extents;
+            if (!extents.empty()) {
+                const auto [start, end] = common::Extents::dataAt(extents, fileOffset, fileSize);
+                if (start > fileOffset) {
+                    //the receiver knows the hole map too, so the hole simply never goes on the wire
+                    connectionContext->addMoved(0, start - fileOffset);
+                    fileOffset = start;
+                    if (!striped) connectionContext->currentFileOffset = fileOffset;
+                    if (fileOffset >= fileSize) return true;
+                }
+                dataEnd = end;
+            }
+
+            //reads stay chunk aligned so every digest covers at most one chunk
+            const uint64_t chunkRoom = common::CHUNK_SIZE - (fileOffset % common::CHUNK_SIZE);
+            const size_t len = std::min<uint64_t>({readBuf->size(), chunkRoom, dataEnd - fileOffset});
 
-            llfio::byte_io_handle::buffer_type reqBuf({
-                reinterpret_cast<llfio::byte *>(readBuf.data()),
-                len
-            });
-            llfio::file_handle::io_request<llfio::file_handle::buffers_type> req(
-                llfio::file_handle::buffers_type{&reqBuf, 1},
-                fileOffset
-            );
+            if (readBuf.use_count() > 1) {
+                readBuf = std::make_shared<common::AlignedBuffer>(readBuf->size());
+            } else {
+                //pairs with the release of the hashing worker's reference
+                std::atomic_thread_fence(std::memory_order_acquire);
+            }
 
-            auto result = pinnedHandle->read(req);
-            if (!result) return false;
+            size_t got = 0;
+            {
+                common::ScopedLatency timed(connectionContext->stats.diskRead);
+                if (senderPersistentContext.cache.directIo && !common::DiskIO::isAligned(fileOffset)) {
+                    //only a resumed or hole-adjacent start lands here; the next read is chunk aligned again
+                    auto *buffered = senderPersistentContext.cache.buffered(pinnedFileId);
+                    if (!buffered || !common::DiskIO::readBuffered(*buffered, fileOffset, readBuf->data(), len)) {
+                        return false;
+                    }
+                    got = len;
+                } else {
+                    //direct reads must cover whole blocks; the unaligned file tail just comes back short
+                    const size_t reqLen = senderPersistentContext.cache.directIo
+                                              ? std::min<uint64_t>(common::DiskIO::alignUp(len), readBuf->size())
+                                              : len;
+                    llfio::byte_io_handle::buffer_type reqBuf({
+                        reinterpret_cast<llfio::byte *>(readBuf->data()),
+                        reqLen
+                    });
+                    llfio::file_handle::io_request<llfio::file_handle::buffers_type> req(
+                        llfio::file_handle::buffers_type{&reqBuf, 1},
+                        fileOffset
+                    );
 
-            const auto got = result.bytes_transferred();
+                    auto result = pinnedHandle->read(req);
+                    if (!result) return false;
+
+                    got = std::min(result.bytes_transferred(), len);
+                }
+            }
 
             if (got == 0) return false;
 
+            if (!senderPersistentContext.cache.directIo) {
+                //keep the kernel reading ahead of us by a window sized from the current send rate
+                const uint64_t window = connectionContext->readaheadWindow();
+                if (advisedUpTo < fileOffset + window && advisedUpTo < fileSize) {
+                    const uint64_t from = std::max(advisedUpTo, fileOffset + got);
+                    const uint64_t to = std::min(fileOffset + 2 * window, fileSize);
+                    if (to > from) common::DiskIO::adviseWillNeed(*pinnedHandle, from, to - from);
+                    advisedUpTo = to;
+                }
+            }
+
+            common::ChunkDigest digest{
+                .fileId = pinnedFileId,
+                .offset = fileOffset,
+                .len = static_cast<uint32_t>(got)
+            };
+            if (const auto leaf = senderPersistentContext.leafFor(pinnedFileId, fileOffset, got)) {
+                digest.digest = leaf.value();
+                digestsOut.push_back(digest);
+            } else {
+                hashesOut.push_back({digest, readBuf});
+            }
+
             bufReady = got;
             bufSent = 0;
             return true;
         }
+
+        //copies up to max bytes of the ordered file data into dst for fec; short only at the very end
+        size_t read(uint8_t *dst, const size_t max, bool &failed) {
+            size_t got = 0;
+            while (got < max && !eofAll) {
+                if (bufSent >= bufReady) {
+                    if (fileOffset >= fileSize && !advanceFile()) {
+                        eofAll = true;
+                        break;
+                    }
+                    if (!fillBuf()) {
+                        failed = true;
+                        break;
+                    }
+                    //only holes were left in the file
+                    if (bufSent >= bufReady) continue;
+                }
+
+                const size_t n = std::min(max - got, bufReady - bufSent);
+                memcpy(dst + got, readBuf->data() + bufSent, n);
+                got += n;
+                bufSent += n;
+                fileOffset += n;
+
+                connectionContext->currentFileOffset = fileOffset;
+                connectionContext->bytesMoved += n;
+                connectionContext->logicalBytesMoved += n;
+            }
+            return got;
+        }
     };
 }
@@ -14,6 +14,10 @@ namespace sender {
     inline int run(const int argc, char **argv) {
         spdlog::set_pattern("%v");
         common::Utils::disableLibniceLogging();
+        common::ThreadManager::configureWorkers(SenderConfig::workerThreads, SenderConfig::pinWorkers);
+        //file handle caches size themselves from the raised limit
+        common::FileHandleCache::raiseFdLimit();
+        if (!common::StatsSink::open(SenderConfig::statsJson)) return 1;
 
         std::vector<std::string> rawStunUrls;
         boost::split(rawStunUrls, sender::SenderConfig::stunServer, boost::is_any_of(","), boost::token_compress_on);
@@ -74,11 +78,15 @@ namespace sender {
 
         socketClient.stop();
 
+        common::ThreadManager::joinWorkers();
+
         common::IceHandler::destroy();
 
         sender::SenderStream::dispose();
 
 
+        common::StatsSink::close();
+
         ix::uninitNetSystem();
         return 0;
     }
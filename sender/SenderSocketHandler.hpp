@@ -16,10 +16,23 @@ namespace sender {
     public:
         static void onConnect(ix::WebSocket &socket) {
             spdlog::info("Signaling Server Cnnected: {}", SenderConfig::serverUrl);
+            common::IceHandler::onRestart([&socket](const std::string &receiverId, common::CandidatesResult result,
+                                                    const int generation) {
+                socket.send(nlohmann::json(common::RestartIcePayload{
+                    .candidatesResult = std::move(result),
+                    .receiverId = receiverId,
+                    .generation = generation
+                }).dump());
+            });
         }
 
         static void onClose(ix::WebSocket &socket, std::string_view reason) {
             spdlog::info("Signaling Server Disconnected: {} Reason: {}", SenderConfig::serverUrl, reason);
+            //transfers already on a P2P route do not need the server; finish them, then exit
+            if (SenderStream::loseSignaling()) {
+                spdlog::warn("No new receivers can join; running transfers continue");
+                return;
+            }
             common::ThreadManager::terminate();
         }
 
@@ -41,16 +54,19 @@ namespace sender {
                                 }
                             }
 
-                            senderPersistentContext.buildManifest(SenderConfig::paths);
-
-                            const auto createTransferSessionPayload =
-                                    common::CreateTransferSessionPayload{
-                                        .maxReceivers = SenderConfig::maxReceivers,
-                                        .totalSize = senderPersistentContext.totalExpectedBytes,
-                                        .filesCount = senderPersistentContext.totalExpectedFilesCount,
-                                    };
+                            //scanning and hashing can take minutes; keep the data plane responsive meanwhile
+                            common::ThreadManager::postWork([&socket]() {
+                                senderPersistentContext.buildManifest(SenderConfig::paths, [&socket]() {
+                                    const auto createTransferSessionPayload =
+                                            common::CreateTransferSessionPayload{
+                                                .maxReceivers = SenderConfig::maxReceivers,
+                                                .totalSize = senderPersistentContext.totalExpectedBytes,
+                                                .filesCount = senderPersistentContext.totalExpectedFilesCount,
+                                            };
 
-                            socket.send(nlohmann::json(createTransferSessionPayload).dump());
+                                    socket.send(nlohmann::json(createTransferSessionPayload).dump());
+                                });
+                            }, common::WorkStage::MANIFEST);
                         });
                 } else if (type == "created_transfer_session_payload") {
                     const auto createdTransferPayload = j.get<common::CreatedTransferSessionPayload>();
@@ -72,7 +88,9 @@ namespace sender {
                     common::ThreadManager::postTask(
                         [&socket,joinTransferSessionPayload = std::move(joinTransferSessionPayload)]() {
                             auto &receiverId = joinTransferSessionPayload.receiverId;
-                            common::IceHandler::gatherLocalCandidates(true, receiverId, 1,
+                            senderPersistentContext.noteCachedManifests(receiverId,
+                                                                        joinTransferSessionPayload.cachedManifests);
+                            common::IceHandler::gatherLocalCandidates(true, receiverId, SenderConfig::components(),
                                                                       [&socket, receiverId = std::move(receiverId),
                                                                           payload = std::move(
                                                                               joinTransferSessionPayload)](
@@ -125,8 +143,16 @@ namespace sender {
                         [quitTransferSessionPayload = std::move(quitTransferSessionPayload)]() {
                             senderPersistentContext.receiversCount.fetch_sub(1);
                             auto &receiverId = quitTransferSessionPayload.receiverId;
+                            senderPersistentContext.manifestCachedBy.erase(receiverId);
                             SenderStream::disposeReceiverConnection(receiverId);
                         });
+                } else if (type == "restart_ice_payload") {
+                    const auto restartIcePayload = j.get<common::RestartIcePayload>();
+                    common::ThreadManager::postTask([restartIcePayload = std::move(restartIcePayload)]() {
+                        common::IceHandler::applyRestart(true, restartIcePayload.receiverId,
+                                                         restartIcePayload.candidatesResult,
+                                                         restartIcePayload.generation);
+                    });
                 } else if (type == "acknowledge_transfer_session_payload") {
                     const auto acknowledgeTransferSessionPayload = j.get<common::AcknowledgeTransferSessionPayload>();
 
@@ -136,7 +162,8 @@ namespace sender {
                                 acknowledgeTransferSessionPayload.receiverId];
 
                             SenderStream::startTransfer(iceContext.agent, iceContext.streamId,
-                                                        acknowledgeTransferSessionPayload.receiverId);
+                                                        acknowledgeTransferSessionPayload.receiverId,
+                                                        iceContext.components);
                         });
                 }
             } catch (const std::exception &e) {
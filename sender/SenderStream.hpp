@@ -11,85 +11,467 @@
 
 namespace sender {
     class SenderStream : public common::Stream {
-        //unlike receiver, sender's progress reporter should run persistently
-        static void watchProgress() {
-            g_timeout_add_full(
-                G_PRIORITY_HIGH,
-                1000,
-                [](gpointer) -> gboolean {
-                    const auto now = std::chrono::steady_clock::now();
-                    const double totalBytes = static_cast<double>(senderPersistentContext.totalExpectedBytes);
+        //nullopt with --cc auto
+        inline static std::optional<common::CongestionControl> fixedCc_;
+        inline static common::CongestionSelector ccSelector_;
+        //the signaling server is gone: nobody new can join, so the process ends with its last transfer
+        inline static std::atomic<bool> signalingLost_ = false;
+
+        static size_t liveSessions() {
+            std::lock_guard lock(contextsMutex_);
+            return std::ranges::count_if(connectionContexts_, [](const common::ConnectionContext *c) {
+                return !static_cast<const SenderConnectionContext *>(c)->lane;
+            });
+        }
 
-                    for (const auto &context: connectionContexts_) {
-                        if (!context || !context->started || context->complete) continue;
+        static common::CongestionSelector::PathClass pathClass(const common::ConnectionContext *ctx) {
+            return ctx->connectionType == common::ConnectionContext::RELAYED
+                       ? common::CongestionSelector::RELAYED
+                       : common::CongestionSelector::DIRECT;
+        }
+
+        //auto cc: once a connection has moved data for CC_PROBE_SECONDS it scores its shard's algorithm
+        static void startProbing(EngineShard *shard) {
+            common::ThreadManager::addTimeout(1000, [](gpointer data) -> gboolean {
+                auto *owner = static_cast<EngineShard *>(data);
+                if (!owner->engine) return G_SOURCE_REMOVE;
+                const auto now = std::chrono::steady_clock::now();
+                std::lock_guard lock(contextsMutex_);
+                for (auto *context: connectionContexts_) {
+                    auto *ctx = static_cast<SenderConnectionContext *>(context);
+                    if (!ctx || !ctx->connection || !ctx->started || ctx->ccProbed || ctx->lane ||
+                        shardOf(ctx) != owner) {
+                        continue;
+                    }
+                    const double elapsed = std::chrono::duration<double>(now - ctx->startTime).count();
+                    if (elapsed < CC_PROBE_SECONDS) continue;
+                    lsquic_conn_info info{};
+                    if (lsquic_conn_get_info(ctx->connection, &info) != 0) continue;
+                    ctx->ccProbed = true;
+                    const double goodput = static_cast<double>(ctx->bytesMoved) / elapsed;
+                    const double loss = info.lci_pkts_sent == 0
+                                            ? 0.0
+                                            : 100.0 * static_cast<double>(info.lci_pkts_lost) /
+                                              static_cast<double>(info.lci_pkts_sent);
+                    ccSelector_.record(pathClass(ctx), owner->cc, goodput, loss);
+                    spdlog::debug("Receiver {} on {}: {}/s goodput, {:.2f}% loss",
+                                  ctx->receiverId, common::congestionControlName(owner->cc),
+                                  common::Utils::sizeToReadableFormat(goodput), loss);
+                }
+                return G_SOURCE_CONTINUE;
+            }, shard, G_PRIORITY_LOW, shard->context);
+        }
+
+        //fec: reads the next block of file data and queues its symbols; false once there is nothing left
+        static bool encodeNextBlock(SenderConnectionContext *connCtx) {
+            bool failed = false;
+            const auto readStart = std::chrono::steady_clock::now();
+            const size_t got = connCtx->dataCtx->read(connCtx->fec.slab(), common::FEC_BLOCK_BYTES, failed);
+            connCtx->stats.bufferStalled(std::chrono::steady_clock::now() - readStart);
+            forwardDigests(connCtx, connCtx->dataCtx);
+            if (failed) {
+                spdlog::error("Failed to read file data for receiver {}", connCtx->receiverId);
+                connCtx->fecFinished = true;
+                lsquic_stream_close(connCtx->dataStream);
+                return false;
+            }
+            if (got == 0) return false;
+            connCtx->fec.encode(got);
+
+            if (connCtx->bytesMoved - connCtx->lastDropCheckBytes >= DROP_BEHIND_SLACK) {
+                connCtx->lastDropCheckBytes = connCtx->bytesMoved;
+                dropPassedPages();
+            }
+            return true;
+        }
 
-                        auto &progressBar = senderPersistentContext.progressBars[static_cast<SenderConnectionContext *>(
-                            context)->progressBarIndex];
+        //fec: the repair count follows the loss lsquic saw since the previous stats tick
+        static void observeFecLoss(common::ConnectionContext *context) {
+            auto *ctx = static_cast<SenderConnectionContext *>(context);
+            if (!ctx->fecActive || ctx->fecFinished) return;
+            ctx->fec.observeLoss(ctx->stats.path.pktsSent, ctx->stats.path.pktsLost);
+        }
+
+        //fec: once every block is read and delivered, finish exactly like the stream path does
+        static void maybeFinishFec(SenderConnectionContext *connCtx) {
+            if (connCtx->fecFinished || !connCtx->fecReadAll || !connCtx->fec.drained()) return;
+            connCtx->fecFinished = true;
+            lsquic_conn_want_datagram_write(connCtx->connection, 0);
+            connCtx->endDigests();
+            //the FIN also walks the receiver past any empty files at the very end
+            if (connCtx->dataStream) lsquic_stream_shutdown(connCtx->dataStream, 1);
+            lsquic_stream_wantread(connCtx->manifestStream, 1);
+        }
 
-                        if (context->lastTime.time_since_epoch().count() == 0) {
-                            context->lastTime = now;
-                            context->lastBytesMoved = context->bytesMoved;
-                            progressBar.set_option(
-                                indicators::option::PostfixText{"starting..."});
-                            progressBar.set_progress(0);
+        static void onFecAck(SenderConnectionContext *connCtx, const uint64_t deliveredBelow) {
+            connCtx->fec.ack(deliveredBelow);
+            connCtx->fecLastAck = std::chrono::steady_clock::now();
+            if (!connCtx->connection || connCtx->fecFinished) return;
+            if (!connCtx->fecReadAll && !connCtx->fec.windowFull()) {
+                lsquic_conn_want_datagram_write(connCtx->connection, 1);
+            }
+            maybeFinishFec(connCtx);
+        }
+
+        //fec: a receiver that never saw a single symbol of the last blocks cannot ask for them, so when the
+        //window stays full or the tail stays unacked, the blocks go over the integrity stream unasked
+        static void watchFecTail(EngineShard *shard) {
+            common::ThreadManager::addTimeout(500, [](gpointer data) -> gboolean {
+                auto *owner = static_cast<EngineShard *>(data);
+                if (!owner->engine) return G_SOURCE_REMOVE;
+                const auto now = std::chrono::steady_clock::now();
+                bool resent = false;
+                {
+                    std::lock_guard lock(contextsMutex_);
+                    for (auto *context: connectionContexts_) {
+                        auto *ctx = static_cast<SenderConnectionContext *>(context);
+                        if (!ctx || !ctx->connection || !ctx->fecActive || ctx->fecFinished || shardOf(ctx) != owner) {
                             continue;
                         }
+                        if (!ctx->fecReadAll && !ctx->fec.windowFull()) continue;
+                        //the receiver's own nacks get the first chance
+                        if (ctx->fec.hasDatagram() || now - ctx->fecLastAck < 2 * common::FEC_STALL_TIMEOUT) continue;
+                        for (const auto seq: ctx->fec.unresent()) {
+                            ctx->resendFecBlock(seq);
+                            resent = true;
+                        }
+                        ctx->fecLastAck = now;
+                    }
+                }
+                if (resent) process(owner);
+                return G_SOURCE_CONTINUE;
+            }, shard, G_PRIORITY_LOW, shard->context);
+        }
 
-                        const double elapsedSeconds =
-                                std::chrono::duration<double>(now - context->startTime).count();
-                        const double deltaSeconds =
-                                std::chrono::duration<double>(now - context->lastTime).count();
-
-                        const double safeDelta = (deltaSeconds > 1e-6) ? deltaSeconds : 1e-6;
-                        const double safeElapsed = (elapsedSeconds > 1e-6) ? elapsedSeconds : 1e-6;
-
-                        const double bytesMoved = static_cast<double>(context->bytesMoved);
-                        const double lastBytesMoved = static_cast<double>(context->lastBytesMoved);
-
-                        const double instantThroughput = (bytesMoved - lastBytesMoved) / safeDelta;
-                        const double averageThroughput = bytesMoved / safeElapsed;
-
-                        const double ewmaThroughput =
-                                (context->ewmaThroughput == 0.0)
-                                    ? instantThroughput
-                                    : 0.2 * instantThroughput + 0.8 * context->ewmaThroughput;
-
-                        context->ewmaThroughput = ewmaThroughput;
-
-                        const double percent = (totalBytes <= 0.0)
-                                                   ? 0.0
-                                                   : (static_cast<SenderConnectionContext *>(
-                                                          context)->logicalBytesMoved / totalBytes) * 100.0;
-                        int p = static_cast<int>(std::lround(percent));
-                        if (p < 0) p = 0;
-                        if (p > 100) p = 100;
-
-                        std::string postfix;
-                        postfix.reserve(256);
-                        postfix += common::Utils::sizeToReadableFormat(ewmaThroughput);
-                        postfix += "/s sent ";
-                        postfix += common::Utils::sizeToReadableFormat(context->bytesMoved);
-                        postfix += " resumed ";
-                        postfix += common::Utils::sizeToReadableFormat(context->skippedBytes);
-                        postfix += " files ";
-                        postfix += std::to_string(context->filesMoved);
-                        postfix += "/";
-                        postfix += std::to_string(senderPersistentContext.totalExpectedFilesCount);
-                        postfix += " ";
-                        postfix += context->connectionType == common::ConnectionContext::RELAYED ? "relayed" : "direct";
-
-                        progressBar.set_option(indicators::option::PostfixText{postfix});
-                        progressBar.set_progress(p);
-
-                        context->lastTime = now;
-                        context->lastBytesMoved = context->bytesMoved;
-                    }
-
-                    return G_SOURCE_CONTINUE;
-                },
-                nullptr,
-                nullptr
-            );
+        //finds the slowest active receiver; everything behind its cursor is no longer needed in the page cache
+        static void dropPassedPages() {
+            size_t lowFile = SIZE_MAX;
+            uint64_t lowOffset = 0;
+            std::lock_guard lock(contextsMutex_);
+            for (const auto *context: connectionContexts_) {
+                const auto *c = static_cast<const SenderConnectionContext *>(context);
+                //a lane's units are part of its session's cursor
+                if (!c || !c->started || c->complete || c->lane) continue;
+                const auto [file, offset] = c->cursor();
+                if (file < lowFile || (file == lowFile && offset < lowOffset)) {
+                    lowFile = file;
+                    lowOffset = offset;
+                }
+            }
+            if (lowFile != SIZE_MAX) senderPersistentContext.dropPagesBefore(lowFile, lowOffset);
+        }
+
+        //runs task on ctx's own shard while ctx is still one of the session's paths; contexts are only ever
+        //deleted on their own shard, so it stays valid for the task once the check passed
+        static void onPath(const std::shared_ptr<StripeSession> &session, SenderConnectionContext *ctx,
+                           std::function<void(SenderConnectionContext *)> task) {
+            auto *owner = shardOf(ctx);
+            common::ThreadManager::postTask(owner->context, [session, ctx, owner, task = std::move(task)]() {
+                {
+                    std::lock_guard lock(session->mutex);
+                    if (ctx != session->primary && std::ranges::find(session->lanes, ctx) == session->lanes.end()) {
+                        return;
+                    }
+                }
+                task(ctx);
+                process(owner);
+            });
+        }
+
+        static void onPrimary(const std::shared_ptr<StripeSession> &session,
+                              std::function<void(SenderConnectionContext *)> task) {
+            SenderConnectionContext *primary;
+            {
+                std::lock_guard lock(session->mutex);
+                primary = session->primary;
+            }
+            if (primary) onPath(session, primary, std::move(task));
+        }
+
+        static void wakePaths(const std::shared_ptr<StripeSession> &session) {
+            std::vector<SenderConnectionContext *> paths;
+            {
+                std::lock_guard lock(session->mutex);
+                if (session->primary) paths.push_back(session->primary);
+                paths.insert(paths.end(), session->lanes.begin(), session->lanes.end());
+            }
+            for (auto *path: paths) {
+                onPath(session, path, [](SenderConnectionContext *c) {
+                    if (c->dataStream) lsquic_stream_wantwrite(c->dataStream, 1);
+                });
+            }
+        }
+
+        //multipath: once every unit is through, each stripe stream ends (in its own on_write) and the session
+        //waits for the receiver's completion ack as usual
+        static void finishStripes(const std::shared_ptr<StripeSession> &session) {
+            if (!session->stripes.drained() || session->finished.exchange(true)) return;
+            onPrimary(session, [](SenderConnectionContext *c) {
+                c->currentFileIndex = senderPersistentContext.files.size();
+                c->currentFileOffset = 0;
+                c->filesMoved = static_cast<int>(senderPersistentContext.files.size() - c->resumePosition);
+                c->endDigests();
+                lsquic_stream_wantread(c->manifestStream, 1);
+            });
+            wakePaths(session);
+        }
+
+        //digests only go out on the session's integrity stream, which lives on the session's shard. reads that
+        //had no merkle leaf are hashed on the pool and land there when done
+        static void forwardDigests(SenderConnectionContext *connCtx, SenderStreamContext *ctx) {
+            if (!ctx->digestsOut.empty()) {
+                if (!connCtx->lane) {
+                    for (const auto &digest: ctx->digestsOut) {
+                        connCtx->integrity.queue(common::INTEGRITY_CHUNK_DIGEST, digest);
+                    }
+                } else {
+                    onPrimary(connCtx->stripeSession, [digests = ctx->digestsOut](SenderConnectionContext *c) {
+                        for (const auto &digest: digests) c->integrity.queue(common::INTEGRITY_CHUNK_DIGEST, digest);
+                    });
+                }
+                ctx->digestsOut.clear();
+            }
+            if (ctx->hashesOut.empty()) return;
+
+            SenderConnectionContext *primary = connCtx;
+            if (connCtx->lane) {
+                std::lock_guard lock(connCtx->stripeSession->mutex);
+                primary = connCtx->stripeSession->primary;
+            }
+            if (!primary) {
+                ctx->hashesOut.clear();
+                return;
+            }
+            primary->digestsPending += static_cast<uint32_t>(ctx->hashesOut.size());
+            auto *owner = shardOf(primary);
+            for (auto &pending: ctx->hashesOut) {
+                common::ThreadManager::submit(common::WorkStage::HASH,
+                    [chunk = pending.chunk, data = std::move(pending.data)]() mutable {
+                        chunk.digest = common::Hash::digest(data->data(), chunk.len);
+                        return chunk;
+                    },
+                    [primary, owner, token = std::weak_ptr<bool>(primary->alive)](common::ChunkDigest chunk) {
+                        common::ThreadManager::postTask(owner->context, [primary, owner, token, chunk]() {
+                            if (token.expired()) return;
+                            primary->digestReady(chunk);
+                            process(owner);
+                        });
+                    });
+            }
+            ctx->hashesOut.clear();
+        }
+
+        //multipath: one path's stripe stream. each unit goes out as its header followed by its data bytes (holes
+        //left out, as on the data stream); a path takes its next unit as soon as it has sent the last one
+        static void writeStripes(lsquic_stream_t *stream, SenderStreamContext *ctx, SenderConnectionContext *connCtx) {
+            const auto &session = connCtx->stripeSession;
+            if (session->closed) {
+                //the session is gone; nothing to send for
+                lsquic_stream_close(stream);
+                return;
+            }
+            if (session->finished) {
+                lsquic_stream_shutdown(stream, 1);
+                return;
+            }
+
+            connCtx->stats.creditResumed();
+            while (true) {
+                if (!ctx->unitActive) {
+                    uint64_t holes = 0;
+                    const auto unit = session->stripes.next(connCtx->unitBudget(), holes);
+                    connCtx->addMoved(0, holes);
+                    if (!unit) {
+                        lsquic_stream_wantwrite(stream, 0);
+                        finishStripes(session);
+                        return;
+                    }
+                    if (!ctx->startUnit(*unit)) {
+                        spdlog::error("Failed to open file id {} for receiver {}",
+                                      senderPersistentContext.fileAt(unit->position).id, connCtx->receiverId);
+                        session->stripes.done(*unit);
+                        lsquic_stream_close(stream);
+                        return;
+                    }
+                }
+
+                if (ctx->headerSent < common::STRIPE_HEADER_SIZE) {
+                    const ssize_t nw = lsquic_stream_write(stream, ctx->unitHeader + ctx->headerSent,
+                                                           common::STRIPE_HEADER_SIZE - ctx->headerSent);
+                    if (nw <= 0) {
+                        connCtx->stats.creditBlocked();
+                        return;
+                    }
+                    ctx->headerSent += static_cast<size_t>(nw);
+                    continue;
+                }
+
+                if (ctx->bufSent >= ctx->bufReady) {
+                    if (ctx->fileOffset >= ctx->fileSize) {
+                        ctx->unitActive = false;
+                        session->stripes.done(ctx->unit);
+                        continue;
+                    }
+                    const auto readStart = std::chrono::steady_clock::now();
+                    const bool filled = ctx->fillBuf();
+                    connCtx->stats.bufferStalled(std::chrono::steady_clock::now() - readStart);
+                    forwardDigests(connCtx, ctx);
+                    if (!filled) {
+                        lsquic_stream_close(stream);
+                        return;
+                    }
+                    //only holes were left in the unit
+                    if (ctx->bufSent >= ctx->bufReady) continue;
+                }
+
+                const ssize_t nw = lsquic_stream_write(stream, ctx->readBuf->data() + ctx->bufSent,
+                                                       ctx->bufReady - ctx->bufSent);
+                if (nw <= 0) {
+                    connCtx->stats.creditBlocked();
+                    return;
+                }
+
+                ctx->bufSent += static_cast<size_t>(nw);
+                ctx->fileOffset += static_cast<uint64_t>(nw);
+
+                connCtx->laneBytes += nw;
+                connCtx->addMoved(nw, nw);
+
+                if (connCtx->laneBytes - connCtx->lastDropCheckBytes >= DROP_BEHIND_SLACK) {
+                    connCtx->lastDropCheckBytes = connCtx->laneBytes;
+                    dropPassedPages();
+                }
+            }
+        }
+
+        //unlike receiver, sender's progress reporter should run persistently. it owns the bars and the rate fields;
+        //the data plane only publishes counters, and on_conn_closed a final snapshot, so terminal output never runs
+        //inside the packet loop. the context lock is held for the sampling only, never while drawing
+        static void watchProgress() {
+            common::ThreadManager::setProgressReporter([] {
+                std::vector<BarSnapshot> bars;
+                {
+                    std::lock_guard lock(contextsMutex_);
+                    for (const auto &context: connectionContexts_) {
+                        if (!context || !context->started || context->complete) continue;
+                        auto *session = static_cast<SenderConnectionContext *>(context);
+                        //lanes count toward their session's bar
+                        if (session->lane) continue;
+                        bars.push_back(sampleProgress(session));
+                    }
+                }
+                {
+                    std::lock_guard lock(senderPersistentContext.closedBarsMutex);
+                    bars.insert(bars.end(), senderPersistentContext.closedBars.begin(),
+                                senderPersistentContext.closedBars.end());
+                    senderPersistentContext.closedBars.clear();
+                }
+                for (const auto &bar: bars) drawProgress(bar);
+            });
+        }
+
+        //what a session's bar shows right now; reporter only, under contextsMutex_
+        static BarSnapshot sampleProgress(SenderConnectionContext *session) {
+            const auto now = std::chrono::steady_clock::now();
+            BarSnapshot bar{
+                .bar = session->progressBarIndex,
+                .sent = session->sessionBytesMoved(),
+                .logical = session->sessionLogicalBytesMoved(),
+                .resumed = session->skippedBytes,
+                .files = session->filesDone(),
+                .relayed = session->connectionType == common::ConnectionContext::RELAYED
+            };
+
+            if (session->lastTime.time_since_epoch().count() == 0) {
+                session->lastTime = now;
+                session->lastBytesMoved = bar.sent;
+                bar.state = BarSnapshot::STARTING;
+                return bar;
+            }
+
+            const double deltaSeconds =
+                    std::chrono::duration<double>(now - session->lastTime).count();
+            const double safeDelta = (deltaSeconds > 1e-6) ? deltaSeconds : 1e-6;
+
+            const double instantThroughput =
+                    (static_cast<double>(bar.sent) - static_cast<double>(session->lastBytesMoved)) / safeDelta;
+            bar.rate = (session->ewmaThroughput == 0.0)
+                           ? instantThroughput
+                           : 0.2 * instantThroughput + 0.8 * session->ewmaThroughput;
+            session->ewmaThroughput = bar.rate;
+
+            session->lastTime = now;
+            session->lastBytesMoved = bar.sent;
+            return bar;
+        }
+
+        //the connection is gone: its bar's last numbers, for the reporter to draw as done or failed
+        static void publishClosedBar(SenderConnectionContext *ctx) {
+            BarSnapshot bar{
+                .bar = ctx->progressBarIndex,
+                .state = ctx->complete ? BarSnapshot::DONE : BarSnapshot::FAILED,
+                .sent = ctx->sessionBytesMoved(),
+                .logical = ctx->sessionLogicalBytesMoved(),
+                .resumed = ctx->skippedBytes,
+                .files = ctx->filesDone(),
+                .relayed = ctx->connectionType == common::ConnectionContext::RELAYED
+            };
+            std::lock_guard lock(senderPersistentContext.closedBarsMutex);
+            senderPersistentContext.closedBars.push_back(bar);
+        }
+
+        static void drawProgress(const BarSnapshot &bar) {
+            auto &progressBar = senderPersistentContext.progressBars[bar.bar];
+            if (bar.state == BarSnapshot::STARTING) {
+                progressBar.set_option(indicators::option::PostfixText{"starting..."});
+                progressBar.set_progress(0);
+                return;
+            }
+
+            std::string postfix;
+            postfix.reserve(256);
+            if (bar.state == BarSnapshot::RUNNING) {
+                postfix += common::Utils::sizeToReadableFormat(bar.rate);
+                postfix += "/s";
+            }
+            postfix += " sent ";
+            postfix += common::Utils::sizeToReadableFormat(static_cast<double>(bar.sent));
+            postfix += " resumed ";
+            postfix += common::Utils::sizeToReadableFormat(static_cast<double>(bar.resumed));
+            postfix += " files ";
+            postfix += std::to_string(bar.files);
+            postfix += "/";
+            postfix += std::to_string(senderPersistentContext.totalExpectedFilesCount);
+            postfix += " ";
+            postfix += bar.relayed ? "relayed" : "direct";
+
+            if (bar.state == BarSnapshot::DONE) {
+                postfix += " [DONE]";
+                progressBar.set_option(indicators::option::ForegroundColor{indicators::Color::green});
+                progressBar.set_option(indicators::option::PostfixText{postfix});
+                progressBar.set_progress(100);
+                senderPersistentContext.progressBars.print_progress();
+                return;
+            }
+            if (bar.state == BarSnapshot::FAILED) {
+                postfix += " [FAILED]";
+                progressBar.set_option(indicators::option::ForegroundColor{indicators::Color::red});
+                progressBar.set_option(indicators::option::PostfixText{postfix});
+                progressBar.mark_as_completed();
+                senderPersistentContext.progressBars.print_progress();
+                return;
+            }
+
+            const double totalBytes = static_cast<double>(senderPersistentContext.totalExpectedBytes);
+            const double percent = (totalBytes <= 0.0)
+                                       ? 0.0
+                                       : (static_cast<double>(bar.logical) / totalBytes) * 100.0;
+            int p = static_cast<int>(std::lround(percent));
+            if (p < 0) p = 0;
+            if (p > 100) p = 100;
+
+            progressBar.set_option(indicators::option::PostfixText{postfix});
+            progressBar.set_progress(p);
         }
 
         inline static lsquic_stream_if streamCallbacks = {
@@ -97,6 +479,11 @@ namespace sender {
             .on_new_conn = [](void *streamIfCtx, lsquic_conn_t *connection) -> lsquic_conn_ctx * {
                 auto *ctx = static_cast<SenderConnectionContext *>(lsquic_conn_get_peer_ctx(connection, nullptr));
                 ctx->connection = connection;
+                if (ctx->lane) {
+                    //a lane only ever opens its stripe stream, once its session has the manifest acked
+                    if (ctx->stripeSession->striped) lsquic_conn_make_stream(connection);
+                    return reinterpret_cast<lsquic_conn_ctx *>(ctx);
+                }
                 //open manifest stream
                 lsquic_conn_make_stream(connection);
                 return reinterpret_cast<lsquic_conn_ctx *>(ctx);
@@ -105,55 +492,64 @@ namespace sender {
             .on_conn_closed = [](lsquic_conn_t *connection) {
                 auto *ctx = reinterpret_cast<SenderConnectionContext *>(lsquic_conn_get_ctx(connection));
                 lsquic_conn_set_ctx(connection, nullptr);
+                if (ctx && ctx->lane) {
+                    //a lane has no bar or agent of its own; the session carries on over its other paths
+                    reportStats(ctx, connection);
+                    {
+                        std::lock_guard lock(contextsMutex_);
+                        std::erase(connectionContexts_, ctx);
+                    }
+                    {
+                        std::lock_guard lock(ctx->stripeSession->mutex);
+                        std::erase(ctx->stripeSession->lanes, ctx);
+                    }
+                    ctx->connection = nullptr;
+                    if (ctx->agent) {
+                        nice_agent_attach_recv(ctx->agent, ctx->streamId, ctx->componentId, shardOf(ctx)->context,
+                                               nullptr, nullptr);
+                    }
+                    delete ctx;
+                    return;
+                }
                 if (ctx) {
-                    if (ctx->complete) {
-                        auto &progressBar = senderPersistentContext.progressBars[ctx->progressBarIndex];
-                        progressBar.set_option(
-                            indicators::option::ForegroundColor{indicators::Color::green});
-                        std::string postfix;
-                        postfix.reserve(256);
-                        postfix += " sent ";
-                        postfix += common::Utils::sizeToReadableFormat(ctx->bytesMoved);
-                        postfix += " resumed ";
-                        postfix += common::Utils::sizeToReadableFormat(ctx->skippedBytes);
-                        postfix += " files ";
-                        postfix += std::to_string(ctx->filesMoved);
-                        postfix += "/";
-                        postfix += std::to_string(senderPersistentContext.totalExpectedFilesCount);
-                        postfix += " ";
-                        postfix += ctx->connectionType == common::ConnectionContext::RELAYED ? "relayed" : "direct";
-                        postfix += " [DONE]";
-
-                        progressBar.set_option(indicators::option::PostfixText{postfix});
-                        progressBar.set_progress(100);
-                        senderPersistentContext.progressBars.print_progress();
-                    } else {
-                        auto &progressBar = senderPersistentContext.progressBars[ctx->progressBarIndex];
-                        progressBar.set_option(
-                            indicators::option::ForegroundColor{indicators::Color::red});
-                        std::string postfix;
-                        postfix.reserve(256);
-                        postfix += " sent ";
-                        postfix += common::Utils::sizeToReadableFormat(ctx->bytesMoved);
-                        postfix += " resumed ";
-                        postfix += common::Utils::sizeToReadableFormat(ctx->skippedBytes);
-                        postfix += " files ";
-                        postfix += std::to_string(ctx->filesMoved);
-                        postfix += "/";
-                        postfix += std::to_string(senderPersistentContext.totalExpectedFilesCount);
-                        postfix += " ";
-                        postfix += ctx->connectionType == common::ConnectionContext::RELAYED ? "relayed" : "direct";
-                        postfix += " [FAILED]";
-                        progressBar.set_option(indicators::option::PostfixText{postfix});
-                        progressBar.mark_as_completed();
-                        senderPersistentContext.progressBars.print_progress();
-                    }
-                    std::erase(connectionContexts_, ctx);
+                    reportStats(ctx, connection);
+                    {
+                        std::lock_guard lock(contextsMutex_);
+                        std::erase(connectionContexts_, ctx);
+                    }
+                    //only once the reporter can no longer sample the session, so the final state is drawn last
+                    publishClosedBar(ctx);
                     ctx->connection = nullptr;
+                    //the lanes end with their session, each on its own shard
+                    if (const auto session = ctx->stripeSession) {
+                        std::vector<SenderConnectionContext *> lanes;
+                        {
+                            std::lock_guard lock(session->mutex);
+                            session->primary = nullptr;
+                            lanes = session->lanes;
+                        }
+                        session->closed = true;
+                        for (auto *lane: lanes) {
+                            onPath(session, lane, [](SenderConnectionContext *c) {
+                                if (c->connection) {
+                                    lsquic_conn_close(c->connection);
+                                    c->connection = nullptr;
+                                }
+                            });
+                        }
+                    }
+                    //stop packets reaching ctx before the agent itself is torn down on the main data plane
+                    if (ctx->agent) {
+                        nice_agent_attach_recv(ctx->agent, ctx->streamId, ctx->componentId, shardOf(ctx)->context,
+                                               nullptr, nullptr);
+                    }
 
-                    common::IceHandler::dispose(ctx->receiverId);
+                    common::ThreadManager::postTask([receiverId = ctx->receiverId]() {
+                        common::IceHandler::dispose(receiverId);
+                    });
 
                     delete ctx;
+                    if (signalingLost_ && liveSessions() == 0) common::ThreadManager::terminate();
                 }
             },
 
@@ -165,16 +561,53 @@ namespace sender {
                 auto *ctx = new SenderStreamContext();
 
                 ctx->connectionContext = connCtx;
-                ctx->readBuf.resize(common::CHUNK_SIZE);
+                ctx->readBuf->resize(common::CHUNK_SIZE);
 
 
-                if (!connCtx->manifestStreamCreated) {
+                if (connCtx->lane) {
+                    if (connCtx->dataStreamCreated || connCtx->stripeSession->closed) {
+                        lsquic_stream_shutdown(stream, 1);
+                        delete ctx;
+                        return nullptr;
+                    }
+                    connCtx->dataStreamCreated = true;
+                    ctx->striped = true;
+                    connCtx->dataStream = stream;
+                    connCtx->dataCtx = ctx;
+                    if (!connCtx->started) {
+                        connCtx->startTime = std::chrono::steady_clock::now();
+                        connCtx->started = true;
+                    }
+                } else if (!connCtx->manifestStreamCreated) {
                     ctx->isManifestStream = true;
                     connCtx->manifestStreamCreated = true;
                 } else if (!connCtx->dataStreamCreated) {
                     ctx->isManifestStream = false;
                     connCtx->dataStreamCreated = true;
-                    ctx->initialize();
+                    connCtx->dataStream = stream;
+                    connCtx->dataCtx = ctx;
+                    if (connCtx->striped()) {
+                        //units are opened as they are handed out
+                        ctx->striped = true;
+                    } else {
+                        ctx->initialize();
+                        forwardDigests(connCtx, ctx);
+                    }
+                    if (SenderConfig::fec && !ctx->striped && !ctx->eofAll) {
+                        //a peer without datagram support leaves us on the ordered stream
+                        connCtx->fecActive = lsquic_conn_want_datagram_write(connCtx->connection, 1) >= 0;
+                        connCtx->fecLastAck = std::chrono::steady_clock::now();
+                        if (!connCtx->fecActive) {
+                            spdlog::warn("Receiver {} does not accept datagrams; sending without FEC",
+                                         connCtx->receiverId);
+                        }
+                    }
+                } else if (!connCtx->integrityStreamCreated) {
+                    ctx->isIntegrityStream = true;
+                    ctx->readBuf->clear();
+                    connCtx->integrityStreamCreated = true;
+                    connCtx->integrity.stream = stream;
+                    lsquic_stream_wantread(stream, 1);
                 } else {
                     lsquic_stream_shutdown(stream, 1);
                     delete ctx;
@@ -190,6 +623,26 @@ namespace sender {
                 auto *connCtx = reinterpret_cast<SenderConnectionContext *>(lsquic_conn_get_ctx(
                     lsquic_stream_conn(stream)));
 
+                if (ctx->isIntegrityStream) {
+                    if (!connCtx->integrity.drain()) {
+                        lsquic_stream_wantread(stream, 0);
+                    }
+                    uint8_t kind;
+                    common::ChunkDigest request;
+                    std::vector<uint8_t> unused;
+                    while (connCtx->integrity.next(kind, request, unused)) {
+                        if (kind == common::INTEGRITY_FEC_ACK) {
+                            onFecAck(connCtx, request.offset);
+                        } else if (kind == common::INTEGRITY_FEC_NACK) {
+                            connCtx->resendFecBlock(request.offset);
+                        } else if (kind == common::INTEGRITY_CHUNK_RETRY && !connCtx->repairChunk(request)) {
+                            spdlog::error("Could not repair chunk of file id {} at offset {} for receiver {}",
+                                          request.fileId, request.offset, connCtx->receiverId);
+                        }
+                    }
+                    return;
+                }
+
                 if (ctx->isManifestStream) {
                     uint8_t tmp[4096];
                     const ssize_t nr = lsquic_stream_read(stream, tmp, sizeof(tmp));
@@ -204,33 +657,33 @@ namespace sender {
                     if (code == common::RECEIVER_MANIFEST_RECEIVED_ACK) {
                         const size_t need = 1 + 4 + 8;
                         if (connCtx->ackBuf.size() < need) return;
-                        uint32_t fid = 0;
+                        uint32_t pos = 0;
                         uint64_t off = 0;
-                        memcpy(&fid, connCtx->ackBuf.data() + 1, 4);
+                        memcpy(&pos, connCtx->ackBuf.data() + 1, 4);
                         memcpy(&off, connCtx->ackBuf.data() + 5, 8);
                         connCtx->ackBuf.erase(connCtx->ackBuf.begin(), connCtx->ackBuf.begin() + need);
-                        connCtx->resumeFileId = fid;
+                        connCtx->resumePosition = pos;
                         connCtx->resumeOffset = off;
 
-                        if (connCtx->resumeFileId >= senderPersistentContext.files.size()) {
-                            connCtx->resumeFileId = senderPersistentContext.files.size();
+                        if (connCtx->resumePosition >= senderPersistentContext.files.size()) {
+                            connCtx->resumePosition = senderPersistentContext.files.size();
                             connCtx->resumeOffset = 0;
                         } else {
-                            auto sz = senderPersistentContext.files[connCtx->resumeFileId].size;
+                            auto sz = senderPersistentContext.fileAt(connCtx->resumePosition).size;
                             if (connCtx->resumeOffset > sz) connCtx->resumeOffset = sz;
-                            while (connCtx->resumeFileId < senderPersistentContext.files.size() &&
-                                   connCtx->resumeOffset >= senderPersistentContext.files[connCtx->resumeFileId].size) {
+                            while (connCtx->resumePosition < senderPersistentContext.files.size() &&
+                                   connCtx->resumeOffset >= senderPersistentContext.fileAt(connCtx->resumePosition).size) {
                                 connCtx->resumeOffset = 0;
-                                connCtx->resumeFileId++;
+                                connCtx->resumePosition++;
                             }
                         }
 
-                        connCtx->currentFileIndex = connCtx->resumeFileId;
+                        connCtx->currentFileIndex = connCtx->resumePosition;
                         connCtx->currentFileOffset = connCtx->resumeOffset;
 
                         uint64_t resumedBytes = 0;
-                        for (uint32_t i = 0; i < connCtx->resumeFileId && i < senderPersistentContext.files.size(); ++i)
-                            resumedBytes += senderPersistentContext.files[i].size;
+                        for (uint32_t i = 0; i < connCtx->resumePosition && i < senderPersistentContext.files.size(); ++i)
+                            resumedBytes += senderPersistentContext.fileAt(i).size;
                         resumedBytes += connCtx->resumeOffset;
 
                         connCtx->logicalBytesMoved = resumedBytes;
@@ -238,18 +691,32 @@ namespace sender {
 
                         //Time to blast data!
                         if (!connCtx->started) {
-                            auto &progressBar = senderPersistentContext.progressBars[connCtx->progressBarIndex];
-                            progressBar.set_option(indicators::option::PostfixText{"starting..."});
-                            progressBar.set_progress(0);
-                            connCtx->started = true;
                             connCtx->startTime = std::chrono::steady_clock::now();
+                            connCtx->started = true;
+                        }
+
+                        //with other paths up, file data is striped over all of them from the resume point
+                        std::vector<SenderConnectionContext *> lanes;
+                        if (const auto &session = connCtx->stripeSession) {
+                            std::lock_guard lock(session->mutex);
+                            lanes = session->lanes;
+                        }
+                        if (!lanes.empty()) {
+                            connCtx->stripeSession->stripes.reset(connCtx->resumePosition, connCtx->resumeOffset);
+                            connCtx->stripeSession->striped = true;
                         }
 
                         //save the manifest stream for reading future ack
                         connCtx->manifestStream = stream;
                         lsquic_stream_wantread(stream, 0);
-                        //Open data stream
+                        //Open data stream, then the integrity stream carrying its chunk digests
+                        lsquic_conn_make_stream(connCtx->connection);
                         lsquic_conn_make_stream(connCtx->connection);
+                        for (auto *lane: lanes) {
+                            onPath(connCtx->stripeSession, lane, [](SenderConnectionContext *c) {
+                                if (c->connection) lsquic_conn_make_stream(c->connection);
+                            });
+                        }
                     } else if (code == common::RECEIVER_TRANSFER_COMPLETE_ACK) {
                         connCtx->ackBuf.erase(connCtx->ackBuf.begin());
                         connCtx->complete = true;
@@ -266,14 +733,23 @@ namespace sender {
                 auto *connCtx = reinterpret_cast<SenderConnectionContext *>(lsquic_conn_get_ctx(
                     lsquic_stream_conn(stream)));
 
-                if (ctx->eofAll) {
+                if (ctx->eofAll && !connCtx->fecActive) {
+                    connCtx->endDigests();
                     lsquic_stream_shutdown(stream, 1);
                     lsquic_stream_wantread(connCtx->manifestStream, 1);
                     return;
                 }
 
                 if (!ctx->typeByteSent) {
-                    uint8_t tag = ctx->isManifestStream ? 0x00 : 0x01;
+                    uint8_t tag = ctx->isManifestStream
+                                      ? connCtx->manifestByReference
+                                            ? common::STREAM_TAG_MANIFEST_REF
+                                            : common::STREAM_TAG_MANIFEST
+                                      : ctx->isIntegrityStream
+                                            ? common::STREAM_TAG_INTEGRITY
+                                            : ctx->striped
+                                                  ? common::STREAM_TAG_STRIPE
+                                                  : common::STREAM_TAG_DATA;
                     ssize_t nw = lsquic_stream_write(stream, &tag, 1);
                     if (nw > 0) {
                         ctx->typeByteSent = true;
@@ -282,13 +758,34 @@ namespace sender {
                     }
                 }
 
+                if (ctx->isIntegrityStream) {
+                    connCtx->integrity.flush();
+                    return;
+                }
+
+                if (ctx->striped) {
+                    writeStripes(stream, ctx, connCtx);
+                    return;
+                }
+
+                if (connCtx->fecActive && !ctx->isManifestStream) {
+                    //file data leaves through on_dg_write
+                    lsquic_stream_wantwrite(stream, 0);
+                    return;
+                }
 
                 if (ctx->isManifestStream) {
-                    size_t total = senderPersistentContext.manifestBlob.size();
+                    uint8_t reference[common::DIGEST_SIZE];
+                    common::Hash::write(reference, senderPersistentContext.manifestHash);
+                    const uint8_t *manifest = connCtx->manifestByReference
+                                                  ? reference
+                                                  : senderPersistentContext.manifestBlob.data();
+                    size_t total = connCtx->manifestByReference
+                                       ? sizeof(reference)
+                                       : senderPersistentContext.manifestBlob.size();
                     size_t sent = connCtx->manifestSent;
                     if (sent < total) {
-                        ssize_t nw = lsquic_stream_write(stream, senderPersistentContext.manifestBlob.data() + sent,
-                                                         total - sent);
+                        ssize_t nw = lsquic_stream_write(stream, manifest + sent, total - sent);
                         if (nw > 0) connCtx->manifestSent += nw;
                     }
                     if (connCtx->manifestSent == total) {
@@ -301,27 +798,39 @@ namespace sender {
                     return;
                 }
 
+                //being called again means the stream can take data; close any credit stall left open
+                connCtx->stats.creditResumed();
                 while (true) {
                     if (ctx->bufSent >= ctx->bufReady) {
                         if (ctx->fileOffset >= ctx->fileSize) {
                             if (!ctx->advanceFile()) {
+                                connCtx->endDigests();
                                 //wait for receiver ACK
                                 lsquic_stream_shutdown(stream, 1);
                                 lsquic_stream_wantread(connCtx->manifestStream, 1);
                                 return;
                             }
                         }
-                        if (!ctx->fillBuf()) {
+                        const auto readStart = std::chrono::steady_clock::now();
+                        const bool filled = ctx->fillBuf();
+                        connCtx->stats.bufferStalled(std::chrono::steady_clock::now() - readStart);
+                        forwardDigests(connCtx, ctx);
+                        if (!filled) {
                             lsquic_stream_close(stream);
                             return;
                         }
+                        //only holes were left in the file
+                        if (ctx->bufSent >= ctx->bufReady) continue;
                     }
 
-                    const uint8_t *ptr = ctx->readBuf.data() + ctx->bufSent;
+                    const uint8_t *ptr = ctx->readBuf->data() + ctx->bufSent;
                     size_t remaining = ctx->bufReady - ctx->bufSent;
 
                     ssize_t nw = lsquic_stream_write(stream, ptr, remaining);
-                    if (nw <= 0) return;
+                    if (nw <= 0) {
+                        connCtx->stats.creditBlocked();
+                        return;
+                    }
 
                     ctx->bufSent += static_cast<size_t>(nw);
                     ctx->fileOffset += static_cast<uint64_t>(nw);
@@ -330,17 +839,56 @@ namespace sender {
 
                     connCtx->bytesMoved += nw;
                     connCtx->logicalBytesMoved += nw;
+
+                    if (connCtx->bytesMoved - connCtx->lastDropCheckBytes >= DROP_BEHIND_SLACK) {
+                        connCtx->lastDropCheckBytes = connCtx->bytesMoved;
+                        dropPassedPages();
+                    }
                 }
             },
 
             .on_close = [](lsquic_stream_t *stream, lsquic_stream_ctx_t *h) {
                 const auto *ctx = reinterpret_cast<SenderStreamContext *>(h);
+                if (!ctx) return;
+                if (ctx->striped && ctx->unitActive && ctx->connectionContext) {
+                    //the unit goes back to the session so another path sends it; the receiver takes repeats in stride
+                    const auto &session = ctx->connectionContext->stripeSession;
+                    session->stripes.giveBack(ctx->unit);
+                    if (!session->closed) wakePaths(session);
+                }
+                if (ctx->isIntegrityStream && ctx->connectionContext) {
+                    ctx->connectionContext->integrity.stream = nullptr;
+                }
+                if (ctx->connectionContext && ctx->connectionContext->dataCtx == ctx) {
+                    ctx->connectionContext->dataCtx = nullptr;
+                    ctx->connectionContext->dataStream = nullptr;
+                }
                 if (ctx->pinnedFileId != UINT32_MAX) {
                     senderPersistentContext.cache.release(ctx->pinnedFileId);
                 }
                 delete ctx;
             },
 
+            .on_dg_write = [](lsquic_conn_t *connection, void *buf, size_t size) -> ssize_t {
+                auto *connCtx = reinterpret_cast<SenderConnectionContext *>(lsquic_conn_get_ctx(connection));
+                if (!connCtx || !connCtx->fecActive || connCtx->fecFinished || !connCtx->dataCtx) {
+                    lsquic_conn_want_datagram_write(connection, 0);
+                    return -1;
+                }
+                auto &fec = connCtx->fec;
+                if (!fec.hasDatagram() && !fec.windowFull() && !connCtx->fecReadAll && !encodeNextBlock(connCtx)) {
+                    connCtx->fecReadAll = true;
+                }
+                const size_t n = fec.pop(static_cast<uint8_t *>(buf), size);
+                if (n == 0) {
+                    //window full or everything read; acks start it again
+                    lsquic_conn_want_datagram_write(connection, 0);
+                    maybeFinishFec(connCtx);
+                    return -1;
+                }
+                return static_cast<ssize_t>(n);
+            },
+
             .on_hsk_done = [](lsquic_conn_t *connection, enum lsquic_hsk_status status) {
             },
 
@@ -361,7 +909,6 @@ namespace sender {
             lsquic_engine_settings settings;
             lsquic_engine_init_settings(&settings, 0);
             settings.es_versions = (1 << LSQVER_I001);
-            settings.es_cc_algo = 2;
             settings.es_init_max_data = SenderConfig::quicConnWindowBytes;
             settings.es_init_max_streams_uni = 0;
             settings.es_init_max_streams_bidi = 2;
@@ -370,7 +917,8 @@ namespace sender {
             settings.es_init_max_stream_data_bidi_local = SenderConfig::quicStreamWindowBytes;
             settings.es_init_max_stream_data_bidi_remote = SenderConfig::quicStreamWindowBytes;
             settings.es_handshake_to = 30000000;
-            settings.es_allow_migration = 0;
+            //the receiver follows the route libnice moves to, see ReceiverStream::followRoutes
+            settings.es_allow_migration = 1;
             settings.es_pace_packets = 1;
             settings.es_delayed_acks = 0;
             settings.es_max_batch_size = 64;
@@ -378,6 +926,8 @@ namespace sender {
             settings.es_max_cfcw = SenderConfig::quicConnWindowBytes * 2;
             settings.es_max_sfcw = SenderConfig::quicStreamWindowBytes * 2;
             settings.es_progress_check = 10000;
+            settings.es_datagrams = SenderConfig::fec ? 1 : 0;
+            configurePathMtu(settings, SenderConfig::pmtud, SenderConfig::basePlpmtu, SenderConfig::maxPlpmtu);
 
 
             char err_buf[256];
@@ -390,17 +940,61 @@ namespace sender {
             api.ea_stream_if = &streamCallbacks;
             api.ea_packets_out = sendPackets;
             api.ea_get_ssl_ctx = getSslCtx;
-            engine = lsquic_engine_new(0, &api);
+
+            //each shard drives its own engine on its own loop; shard 0 shares the main data plane with ICE
+            size_t shards = SenderConfig::engineShards > 0
+                                      ? static_cast<size_t>(SenderConfig::engineShards)
+                                      : std::clamp<size_t>(std::thread::hardware_concurrency(), 1,
+                                                           std::min<size_t>(MAX_ENGINE_SHARDS,
+                                                                            std::max(1, SenderConfig::maxReceivers) *
+                                                                            SenderConfig::components()));
+            //the controller is per engine, so auto needs at least one engine of each kind to place receivers on
+            fixedCc_ = common::parseCongestionControl(SenderConfig::congestionControl);
+            if (!fixedCc_) shards = std::max<size_t>(shards, 2);
+            common::ThreadManager::addDataPlaneLoops(shards);
+            for (size_t i = 0; i < shards; ++i) {
+                const auto cc = fixedCc_.value_or(i % 2 == 0 ? common::CongestionControl::BBR
+                                                             : common::CongestionControl::CUBIC);
+                //lsquic copies the settings into each engine
+                settings.es_cc_algo = static_cast<int>(cc);
+                lsquic_engine_t *shardEngine = lsquic_engine_new(0, &api);
+                if (!shardEngine) {
+                    spdlog::error("Failed to create QUIC engine shard {}", i);
+                    return;
+                }
+                auto *shard = addEngineShard(shardEngine, common::ThreadManager::getContext(i));
+                shard->cc = cc;
+                startTicking(shard);
+                if (SenderConfig::fec) shard->onStatsTick = observeFecLoss;
+                startStats(shard);
+                if (!fixedCc_) startProbing(shard);
+                if (SenderConfig::fec) watchFecTail(shard);
+            }
+            if (shards > 1) spdlog::info("Running {} QUIC engine shards", shards);
 
             watchProgress();
-            g_timeout_add(0, engineTick, nullptr);
+        }
+
+        //the shard with the fewest live connections, among those running cc if one is asked for
+        static size_t pickShard(const std::optional<common::CongestionControl> cc = std::nullopt) {
+            std::vector<size_t> load(engineShards_.size(), 0);
+            std::lock_guard lock(contextsMutex_);
+            for (const auto *context: connectionContexts_) {
+                if (context && context->shard < load.size()) ++load[context->shard];
+            }
+            size_t best = 0;
+            bool found = false;
+            for (size_t i = 0; i < load.size(); ++i) {
+                if (cc && engineShards_[i]->cc != *cc) continue;
+                if (!found || load[i] < load[best]) best = i;
+                found = true;
+            }
+            return best;
         }
 
 
         static void startTransfer(NiceAgent *agent, const guint streamId,
-                                  std::string receiverId) {
-            setAndVerifySocketBuffers(agent, streamId, 1, SenderConfig::udpBufferBytes);
-
+                                  std::string receiverId, const int components) {
             NiceCandidate *local = nullptr, *remote = nullptr;
             if (!nice_agent_get_selected_pair(agent, streamId, 1, &local, &remote)) {
                 spdlog::error("QUIC connection not ready");
@@ -409,65 +1003,146 @@ namespace sender {
 
 
             auto *ctx = new SenderConnectionContext();
-            ctx->agent = agent;
-            ctx->streamId = streamId;
+            preparePath(ctx, agent, streamId, 1, local, remote);
             ctx->receiverId = receiverId;
+            ctx->manifestByReference = senderPersistentContext.manifestCachedBy.erase(receiverId) > 0;
+            ctx->stats.peer = receiverId;
             ctx->progressBarIndex = senderPersistentContext.addNewProgressBar("Receiver ID: " + ctx->receiverId);
-            ctx->connectionType = (local->type == NICE_CANDIDATE_TYPE_RELAYED || remote->type ==
-                                   NICE_CANDIDATE_TYPE_RELAYED)
-                                      ? common::ConnectionContext::RELAYED
-                                      : common::ConnectionContext::DIRECT;
             if (ctx->connectionType == common::ConnectionContext::RELAYED) {
                 senderPersistentContext.progressBars[ctx->progressBarIndex].set_option(
                     indicators::option::ForegroundColor{indicators::Color::yellow});
             }
+            ctx->shard = fixedCc_ ? pickShard() : pickShard(ccSelector_.choose(pathClass(ctx)));
+
+            //every further path that came up becomes a lane of this session, each on the next shard along so
+            //that one session's crypto and packet work spreads over as many cores as it has paths
+            std::vector<SenderConnectionContext *> lanes;
+            for (int k = 2; k <= components; ++k) {
+                if (nice_agent_get_component_state(agent, streamId, k) != NICE_COMPONENT_STATE_READY ||
+                    !nice_agent_get_selected_pair(agent, streamId, k, &local, &remote)) {
+                    continue;
+                }
+                if (!ctx->stripeSession) {
+                    ctx->stripeSession = std::make_shared<StripeSession>();
+                    ctx->stripeSession->primary = ctx;
+                }
+                auto *lane = new SenderConnectionContext();
+                preparePath(lane, agent, streamId, static_cast<guint>(k), local, remote);
+                lane->lane = true;
+                lane->stripeSession = ctx->stripeSession;
+                lane->receiverId = receiverId;
+                lane->stats.peer = receiverId + " path " + std::to_string(k);
+                lane->shard = (ctx->shard + k - 1) % engineShards_.size();
+                lanes.push_back(lane);
+            }
+            if (!lanes.empty()) {
+                ctx->stripeSession->lanes = lanes;
+                spdlog::info("Receiver {}: sending over {} paths", receiverId, lanes.size() + 1);
+            }
+
+            connectPath(ctx);
+            for (auto *lane: lanes) connectPath(lane);
+        }
+
+
+        //true if transfers are still running and should be left to finish
+        static bool loseSignaling() {
+            signalingLost_ = true;
+            return liveSessions() > 0;
+        }
+
+        static void disposeReceiverConnection(std::string_view receiverId) {
+            size_t shard = SIZE_MAX;
+            {
+                std::lock_guard lock(contextsMutex_);
+                for (const auto *ctx: connectionContexts_) {
+                    if (((SenderConnectionContext *) ctx)->receiverId == receiverId) {
+                        shard = ctx->shard;
+                        break;
+                    }
+                }
+            }
+            if (shard == SIZE_MAX) return;
+
+            //the connection may be gone by the time its shard runs this, so look it up again there
+            auto *owner = engineShards_[shard].get();
+            common::ThreadManager::postTask(owner->context, [owner, receiverId = std::string(receiverId)]() {
+                {
+                    std::lock_guard lock(contextsMutex_);
+                    for (const auto *ctx: connectionContexts_) {
+                        //lanes follow their session
+                        if (((SenderConnectionContext *) ctx)->receiverId == receiverId &&
+                            !((SenderConnectionContext *) ctx)->lane) {
+                            if (ctx->connection) {
+                                lsquic_conn_close(ctx->connection);
+                                ctx->connection = nullptr;
+                            }
+                            break;
+                        }
+                    }
+                }
+                process(owner);
+            });
+        }
+
+    private:
+        static void preparePath(SenderConnectionContext *ctx, NiceAgent *agent, const guint streamId,
+                                const guint componentId, const NiceCandidate *local, const NiceCandidate *remote) {
+            setAndVerifySocketBuffers(agent, streamId, componentId, SenderConfig::udpBufferBytes);
+            if (SenderConfig::pmtud) setDontFragment(agent, streamId, componentId);
+
+            ctx->agent = agent;
+            ctx->streamId = streamId;
+            ctx->componentId = componentId;
+            ctx->connectionType = (local->type == NICE_CANDIDATE_TYPE_RELAYED || remote->type ==
+                                   NICE_CANDIDATE_TYPE_RELAYED)
+                                      ? common::ConnectionContext::RELAYED
+                                      : common::ConnectionContext::DIRECT;
 
             nice_address_copy_to_sockaddr(&local->addr, reinterpret_cast<sockaddr *>(&ctx->localAddr));
             nice_address_copy_to_sockaddr(&remote->addr, reinterpret_cast<sockaddr *>(&ctx->remoteAddr));
+        }
 
-            connectionContexts_.push_back(ctx);
+        static void connectPath(SenderConnectionContext *ctx) {
+            {
+                std::lock_guard lock(contextsMutex_);
+                connectionContexts_.push_back(ctx);
+            }
 
 
-            nice_agent_attach_recv(agent, streamId, 1, common::ThreadManager::getContext(),
+            //packets for this receiver are delivered straight to the loop of the shard that owns it
+            auto *shard = shardOf(ctx);
+            nice_agent_attach_recv(ctx->agent, ctx->streamId, ctx->componentId, shard->context,
                                    [](NiceAgent *agent, guint stream_id, guint component_id,
                                       guint len, gchar *buf, gpointer user_data) {
                                        auto *c = static_cast<common::ConnectionContext *>(user_data);
+                                       auto *owner = shardOf(c);
 
-                                       lsquic_engine_packet_in(engine, (unsigned char *) buf, len,
+                                       lsquic_engine_packet_in(owner->engine, (unsigned char *) buf, len,
                                                                (sockaddr *) &c->localAddr,
                                                                (sockaddr *) &c->remoteAddr,
                                                                c, 0);
 
-                                       process();
+                                       process(owner);
                                    },
                                    ctx
             );
 
 
-            lsquic_engine_connect(
-                engine,
-                LSQVER_I001,
-                reinterpret_cast<const sockaddr *>(&ctx->localAddr),
-                reinterpret_cast<const sockaddr *>(&ctx->remoteAddr),
-                ctx,
-                nullptr,
-                "thruflux.local", 0, nullptr, 0, nullptr, 0
-            );
-        }
-
-
-        static void disposeReceiverConnection(std::string_view receiverId) {
-            for (const auto *ctx: connectionContexts_) {
-                if (((SenderConnectionContext *) ctx)->receiverId == receiverId) {
-                    if (ctx->connection) {
-                        lsquic_conn_close(ctx->connection);
-                        ctx->connection = nullptr;
-                    }
-                    break;
-                }
-            }
-
-            process();
+            common::ThreadManager::postTask(shard->context, [ctx, shard]() {
+                lsquic_engine_connect(
+                    shard->engine,
+                    LSQVER_I001,
+                    reinterpret_cast<const sockaddr *>(&ctx->localAddr),
+                    reinterpret_cast<const sockaddr *>(&ctx->remoteAddr),
+                    ctx,
+                    nullptr,
+                    "thruflux.local",
+                    ctx->connectionType == common::ConnectionContext::RELAYED ? RELAYED_BASE_PLPMTU : 0,
+                    nullptr, 0, nullptr, 0
+                );
+                process(shard);
+            });
         }
     };
 }
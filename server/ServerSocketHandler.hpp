@@ -122,6 +122,24 @@ namespace server {
                         session->end(4004, "No Session Found While Acknowledging");
                     }
                 }
+                else if (type == "restart_ice_payload") {
+                    auto payload = j.get<common::RestartIcePayload>();
+                    if (isSender) {
+                        if (const auto transferSession = TransferSessionStore::instance().getTransferSession(
+                            session->getUserData()->id); transferSession.has_value()) {
+                            if (const auto receiverSession = transferSession.value()->getReceiver(payload.receiverId)) {
+                                receiverSession->send(j.dump());
+                            }
+                        }
+                    } else if (const auto transferSession = TransferSessionStore::instance().
+                            getTransferSessionByReceiverId(session->getUserData()->id);
+                        transferSession.has_value()) {
+                        payload.receiverId = session->getUserData()->id;
+                        if (const auto senderSession = transferSession.value()->senderSession()) {
+                            senderSession->send(nlohmann::json(payload).dump());
+                        }
+                    }
+                }
                 else if (isSender && type == "reject_transfer_session_payload") {
                     auto payload = j.get<common::RejectTransferSessionPayload>();
                     const auto receiverSession = sessionTracker[payload.receiverId];
@@ -0,0 +1,235 @@
+//erasure round trips through ReedSolomon::decode and the encoder/reassembler pair, and the bounds
+//FecSymbolHeader::read enforces on untrusted datagrams. exits non-zero on the first failed check
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "../common/Fec.hpp"
+
+namespace {
+    int failures = 0;
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            ++failures; \
+        } \
+    } while (0)
+
+    std::vector<uint8_t> randomBytes(std::mt19937 &rng, const size_t n) {
+        std::vector<uint8_t> out(n);
+        for (auto &b: out) b = static_cast<uint8_t>(rng());
+        return out;
+    }
+
+    //encodes k random symbols with m repair symbols, erases the given indices and decodes
+    bool roundTrip(std::mt19937 &rng, const size_t k, const size_t m, const std::vector<size_t> &erased) {
+        const size_t len = common::FEC_SYMBOL_SIZE;
+        std::vector<std::vector<uint8_t> > symbols(k + m);
+        std::vector<const uint8_t *> source(k);
+        std::vector<uint8_t *> repair(m);
+        for (size_t j = 0; j < k; ++j) {
+            symbols[j] = randomBytes(rng, len);
+            source[j] = symbols[j].data();
+        }
+        for (size_t i = 0; i < m; ++i) {
+            symbols[k + i].resize(len);
+            repair[i] = symbols[k + i].data();
+        }
+        common::ReedSolomon::encode(source, repair, len);
+
+        const auto original = symbols;
+        for (const auto index: erased) symbols[index].clear();
+        if (!common::ReedSolomon::decode(symbols, k, len)) return false;
+        for (size_t j = 0; j < k; ++j) {
+            if (symbols[j] != original[j]) return false;
+        }
+        return true;
+    }
+
+    void testReedSolomon() {
+        std::mt19937 rng(1);
+        //nothing lost, only repair lost, single source lost
+        CHECK(roundTrip(rng, 8, 2, {}));
+        CHECK(roundTrip(rng, 8, 2, {8, 9}));
+        CHECK(roundTrip(rng, 8, 2, {3}));
+        //as many sources lost as there are repair symbols, at the edges and spread out
+        CHECK(roundTrip(rng, 8, 2, {0, 7}));
+        CHECK(roundTrip(rng, 1, 2, {0}));
+        CHECK(roundTrip(rng, 128, 64, [] {
+            std::vector<size_t> e;
+            for (size_t j = 0; j < 64; ++j) e.push_back(j * 2);
+            return e;
+        }()));
+        //a mix of lost sources and lost repair symbols still leaves k
+        CHECK(roundTrip(rng, 16, 4, {2, 5, 16, 19}));
+
+        //random erasure patterns up to m
+        for (int round = 0; round < 50; ++round) {
+            const size_t k = 1 + rng() % common::FEC_SOURCE_SYMBOLS;
+            const size_t m = common::FEC_MIN_REPAIR + rng() % (common::FEC_MAX_REPAIR - common::FEC_MIN_REPAIR + 1);
+            std::vector<size_t> all(k + m);
+            for (size_t i = 0; i < all.size(); ++i) all[i] = i;
+            std::shuffle(all.begin(), all.end(), rng);
+            all.resize(rng() % (m + 1));
+            CHECK(roundTrip(rng, k, m, all));
+        }
+
+        //one erasure more than there are repair symbols cannot be rebuilt
+        CHECK(!roundTrip(rng, 8, 2, {0, 1, 2}));
+        CHECK(!roundTrip(rng, 8, 2, {0, 1, 8}));
+    }
+
+    std::vector<uint8_t> datagram(const common::FecSymbolHeader &h) {
+        std::vector<uint8_t> dg(common::FEC_HEADER_SIZE + common::FEC_SYMBOL_SIZE, 0);
+        h.write(dg.data());
+        return dg;
+    }
+
+    void testHeaderBounds() {
+        using common::FecSymbolHeader;
+        constexpr size_t S = common::FEC_SYMBOL_SIZE;
+        const FecSymbolHeader good{.block = 7, .blockLen = 3 * S - 1, .k = 3, .m = 2, .index = 4};
+
+        auto dg = datagram(good);
+        const auto parsed = FecSymbolHeader::read(dg.data(), dg.size());
+        CHECK(parsed && parsed->block == 7 && parsed->blockLen == 3 * S - 1 && parsed->k == 3 && parsed->m == 2 &&
+            parsed->index == 4);
+
+        //the datagram must be exactly one header and one symbol, of the symbol type
+        CHECK(!FecSymbolHeader::read(dg.data(), dg.size() - 1));
+        CHECK(!FecSymbolHeader::read(dg.data(), common::FEC_HEADER_SIZE));
+        dg.push_back(0);
+        CHECK(!FecSymbolHeader::read(dg.data(), dg.size()));
+        dg = datagram(good);
+        dg[0] = 0x02;
+        CHECK(!FecSymbolHeader::read(dg.data(), dg.size()));
+
+        const auto rejects = [](FecSymbolHeader h) {
+            const auto d = datagram(h);
+            return !FecSymbolHeader::read(d.data(), d.size());
+        };
+        auto h = good;
+        h.k = 0;
+        h.blockLen = 1;
+        h.index = 0;
+        CHECK(rejects(h));
+        h = good;
+        h.k = common::FEC_SOURCE_SYMBOLS + 1;
+        h.blockLen = static_cast<uint32_t>(h.k * S);
+        CHECK(rejects(h));
+        h = good;
+        h.m = common::FEC_MAX_REPAIR + 1;
+        CHECK(rejects(h));
+        h = good;
+        h.index = h.k + h.m;
+        CHECK(rejects(h));
+        h = good;
+        h.blockLen = 0;
+        CHECK(rejects(h));
+        h = good;
+        h.blockLen = 3 * S + 1;
+        CHECK(rejects(h));
+        //a block whose last symbol would be empty claims one symbol too many
+        h = good;
+        h.blockLen = 2 * S;
+        CHECK(rejects(h));
+
+        //the largest block is still accepted
+        h = good;
+        h.k = common::FEC_SOURCE_SYMBOLS;
+        h.m = common::FEC_MAX_REPAIR;
+        h.index = h.k + h.m - 1;
+        h.blockLen = common::FEC_BLOCK_BYTES;
+        CHECK(!rejects(h));
+    }
+
+    //whole blocks through the encoder's slab ring and the reassembler, with up to m datagrams of each dropped
+    void testEncoderRoundTrip() {
+        std::mt19937 rng(2);
+        common::FecEncoder encoder;
+        common::FecReassembler reassembler;
+        std::vector<uint8_t> sent;
+        std::vector<uint8_t> dg(common::FEC_HEADER_SIZE + common::FEC_SYMBOL_SIZE);
+
+        const std::vector<size_t> sizes = {common::FEC_BLOCK_BYTES, 1, common::FEC_SYMBOL_SIZE, 5000,
+                                           common::FEC_BLOCK_BYTES - 1};
+        for (int round = 0; round < 3; ++round) {
+            for (const auto size: sizes) {
+                CHECK(!encoder.windowFull());
+                const auto bytes = randomBytes(rng, size);
+                memcpy(encoder.slab(), bytes.data(), size);
+                encoder.encode(size);
+                sent.insert(sent.end(), bytes.begin(), bytes.end());
+
+                const size_t k = (size + common::FEC_SYMBOL_SIZE - 1) / common::FEC_SYMBOL_SIZE;
+                const size_t m = encoder.repairFor(k);
+                size_t dropped = 0;
+                CHECK(encoder.pop(dg.data(), dg.size() - 1) == 0);
+                while (encoder.hasDatagram()) {
+                    CHECK(encoder.pop(dg.data(), dg.size()) == dg.size());
+                    if (dropped < m && rng() % 2 == 0) {
+                        ++dropped;
+                        continue;
+                    }
+                    reassembler.addSymbol(dg.data(), dg.size());
+                }
+            }
+            //loss raises the repair count for the next round
+            encoder.observeLoss(1000ull * (round + 1), 100ull * (round + 1));
+        }
+
+        std::vector<uint8_t> received(sent.size() + 1);
+        CHECK(reassembler.read(received.data(), received.size()) == sent.size());
+        received.resize(sent.size());
+        CHECK(received == sent);
+
+        //acked blocks leave the ring; the rest can still be resent
+        const uint64_t blocks = reassembler.delivered();
+        CHECK(blocks == 3 * sizes.size());
+        CHECK(!encoder.drained());
+        const auto last = encoder.block(blocks - 1);
+        CHECK(last.size() == sizes.back() && std::equal(last.begin(), last.end(), sent.end() - last.size()));
+        CHECK(encoder.unresent().size() == blocks - 1);
+        encoder.ack(blocks);
+        CHECK(encoder.drained());
+        CHECK(encoder.block(blocks - 1).empty());
+    }
+
+    void testWindow() {
+        common::FecEncoder encoder;
+        std::vector<uint8_t> dg(common::FEC_HEADER_SIZE + common::FEC_SYMBOL_SIZE);
+        for (uint64_t seq = 0; seq < common::FEC_WINDOW_BLOCKS; ++seq) {
+            CHECK(!encoder.windowFull());
+            encoder.slab()[0] = static_cast<uint8_t>(seq);
+            encoder.encode(1);
+            while (encoder.pop(dg.data(), dg.size()) != 0) {
+            }
+        }
+        CHECK(encoder.windowFull());
+        encoder.ack(1);
+        CHECK(!encoder.windowFull());
+        //the freed slab is the one block 0 used; block 1 is untouched until acked
+        encoder.slab()[0] = 0xff;
+        encoder.encode(1);
+        CHECK(encoder.block(1).size() == 1 && encoder.block(1)[0] == 1);
+        CHECK(encoder.block(common::FEC_WINDOW_BLOCKS)[0] == 0xff);
+        CHECK(encoder.block(0).empty());
+    }
+}
+
+int main() {
+    testReedSolomon();
+    testHeaderBounds();
+    testEncoderRoundTrip();
+    testWindow();
+    if (failures != 0) {
+        std::fprintf(stderr, "%d check(s) failed\n", failures);
+        return EXIT_FAILURE;
+    }
+    std::puts("fec: all checks passed");
+    return EXIT_SUCCESS;
+}